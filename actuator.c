@@ -0,0 +1,253 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* actuator.c - multi-actuator and LBA-partitioned unit detection
+ *
+ * A multi-actuator HDD serves each part of its LBA range (e.g. each half)
+ * with its own set of heads, so readers confined to different parts
+ * don't wait for each other; readers spread over the whole range collide
+ * on the same actuator much of the time. This mode runs N readers, each
+ * confined to its own 1/N of the device, and compares their scaling with
+ * N readers over the whole device. The baseline of the confined readers
+ * is a single reader within 1/N, so that the shorter seeks of a smaller
+ * range don't count as parallelism.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "actuator.h"
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "workload.h"
+
+
+/* Default size of the reads. */
+#define DEFAULT_READ_BYTES 4096
+
+/* Number of splits, and the readers of each (halves and quarters). */
+#define NUM_SPLITS 2
+static const unsigned int split_readers[NUM_SPLITS] = { 2, 4 };
+
+/* Confined readers must scale to at least this fraction of N... */
+#define MIN_SPLIT_EFFICIENCY 0.8
+
+/* ... and this many times better than readers over the whole device, for
+ * the ranges to count as independent units. */
+#define MIN_SPLIT_ADVANTAGE 1.2
+
+/* Most readers in any run. */
+#define MAX_READERS 4
+
+
+struct run_result {
+    struct latency_stats stats;
+    uint64_t bytes;
+    uint64_t elapsed_ns;
+    double iops;
+};
+
+/* Results for N readers. */
+struct split_result {
+    struct run_result shared;       /* N readers, whole device */
+    struct run_result one_part;     /* 1 reader, within 1/N */
+    struct run_result split;        /* N readers, each within its 1/N */
+    double shared_scaling;          /* shared over a single whole reader */
+    double split_scaling;           /* split over one_part */
+};
+
+
+
+/*
+ * Run num_readers random readers for duration_ns. If parts isn't zero,
+ * reader i is confined to the i-th 1/parts of the device; otherwise,
+ * all of them read from the whole device. Stores the combined results in
+ * res.
+ */
+static void run_readers(int fd, const struct blkdev_info *info,
+        size_t read_size, unsigned int num_readers, unsigned int parts,
+        uint64_t duration_ns, struct run_result *res)
+{
+    const uint64_t part_blocks = parts != 0 ? info->num_blocks / parts : 0;
+    struct rr_worker workers[MAX_READERS];
+    struct sample_buf all;
+    unsigned int i;
+
+    assert(num_readers <= MAX_READERS);
+    assert(parts == 0 || num_readers <= parts);
+
+    res->bytes = 0;
+    res->elapsed_ns = 0;
+    sample_buf_init(&all);
+
+    for (i=0; i<num_readers; i++)
+    {
+        init_rr_worker(&workers[i], fd, info, read_size, duration_ns);
+        if (parts != 0)
+        {
+            workers[i].first_block = i * part_blocks;
+            workers[i].num_blocks = part_blocks;
+        }
+    }
+
+    run_random_read_workers(workers, num_readers);
+
+    for (i=0; i<num_readers; i++)
+    {
+        sample_buf_append(&all, &workers[i].lat);
+        res->bytes += workers[i].bytes;
+        res->elapsed_ns = max(res->elapsed_ns, workers[i].elapsed_ns);
+        sample_buf_free(&workers[i].lat);
+    }
+
+    get_latency_stats(&all, &res->stats);
+    res->iops = all.count / ((double)max(res->elapsed_ns, (uint64_t)1)
+                             / NS_PER_SEC);
+    sample_buf_free(&all);
+}
+
+
+
+/*
+ * Look for independent actuators or LBA-partitioned units in a block
+ * device, and print the results.
+ *
+ * Each run does random reads of opts->read_size (DEFAULT_READ_BYTES if
+ * zero), one at a time per reader, for opts->duration_ns. Exits in case
+ * of error.
+ */
+void run_and_print_actuator(const char *devname,
+        const struct bench_options *opts)
+{
+    struct split_result splits[NUM_SPLITS];
+    struct run_result whole;
+    struct blkdev_info info;
+    size_t read_size;
+    char *duration;
+    char label[32];
+    int units = 1;
+    int fd;
+    unsigned int i;
+
+    fd = open_blkdev(devname);
+    get_blkdev_info(fd, &info);
+    init_randomness();
+
+    read_size = align_ceil(opts->read_size != 0
+                           ? opts->read_size : DEFAULT_READ_BYTES,
+                           info.block_size);
+    if (read_size * split_readers[NUM_SPLITS - 1] > info.dev_size)
+    {
+        fprintf(stderr, "error: device too small for %u ranges of %zu-byte reads\n",
+                split_readers[NUM_SPLITS - 1], read_size);
+        exit(1);
+    }
+
+    duration = humanize_time(opts->duration_ns, 3);
+
+    printf("Reading %zu-byte blocks with 1 reader for %s, please wait...\n",
+           read_size, duration);
+    run_readers(fd, &info, read_size, 1, 0, opts->duration_ns, &whole);
+
+    for (i=0; i<NUM_SPLITS; i++)
+    {
+        const unsigned int n = split_readers[i];
+        struct split_result *const s = &splits[i];
+
+        printf("Reading with %u readers over the whole device for %s, please wait...\n",
+               n, duration);
+        run_readers(fd, &info, read_size, n, 0, opts->duration_ns,
+                    &s->shared);
+
+        printf("Reading with 1 reader within 1/%u of the device for %s, please wait...\n",
+               n, duration);
+        run_readers(fd, &info, read_size, 1, n, opts->duration_ns,
+                    &s->one_part);
+
+        printf("Reading with %u readers, each within its own 1/%u, for %s, please wait...\n",
+               n, n, duration);
+        run_readers(fd, &info, read_size, n, n, opts->duration_ns,
+                    &s->split);
+
+        s->shared_scaling = s->shared.iops / max(whole.iops, 1.0);
+        s->split_scaling = s->split.iops / max(s->one_part.iops, 1.0);
+
+        if (s->split_scaling >= MIN_SPLIT_EFFICIENCY * n
+            && s->split_scaling >= MIN_SPLIT_ADVANTAGE * s->shared_scaling)
+            units = n;
+    }
+
+    free(duration);
+    close(fd);
+
+    printf("\n%s (%zu-byte random reads, 1 in flight per reader):\n\n",
+           devname, read_size);
+
+    print_stats_header("readers");
+    print_stats_row("1, whole", &whole.stats, whole.bytes, whole.elapsed_ns);
+    for (i=0; i<NUM_SPLITS; i++)
+    {
+        const unsigned int n = split_readers[i];
+        const struct split_result *const s = &splits[i];
+
+        snprintf(label, sizeof(label), "%u, whole", n);
+        print_stats_row(label, &s->shared.stats, s->shared.bytes,
+                        s->shared.elapsed_ns);
+        snprintf(label, sizeof(label), "1, in 1/%u", n);
+        print_stats_row(label, &s->one_part.stats, s->one_part.bytes,
+                        s->one_part.elapsed_ns);
+        snprintf(label, sizeof(label), "%u, split", n);
+        print_stats_row(label, &s->split.stats, s->split.bytes,
+                        s->split.elapsed_ns);
+    }
+
+    printf("\n");
+    for (i=0; i<NUM_SPLITS; i++)
+        printf(" %u readers: %.2fx over the whole device, %.2fx split into %u ranges\n",
+               split_readers[i], splits[i].shared_scaling,
+               splits[i].split_scaling, split_readers[i]);
+
+    if (units > 1)
+        printf(" The device has ~%d independent units by LBA range (e.g. actuators);\n"
+               " split workloads across its 1/%d ranges to use them all.\n",
+               units, units);
+    else if (splits[0].shared_scaling >= MIN_SPLIT_EFFICIENCY * split_readers[0])
+        printf(" Reads scale with concurrency wherever they land; no LBA-partitioned\n"
+               " units found.\n");
+    else
+        printf(" No independent units by LBA range found.\n");
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
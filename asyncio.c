@@ -0,0 +1,278 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* asyncio.c - asynchronous reads through Linux native AIO
+ *
+ * glibc has no wrappers for the native AIO system calls (only for the
+ * thread-based POSIX AIO), so we call them directly. This avoids a
+ * dependency on libaio or liburing, and works with O_DIRECT on any block
+ * device.
+ *
+ * Requests are registered with the watchdog from submission to reaping.
+ * To find its watchdog slot on completion, a request's aio_data is
+ * swapped for a record of the context's own, which keeps the caller's
+ * value; async_reap puts it back before returning the event.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "asyncio.h"
+#include "watchdog.h"
+
+
+/* Older kernel headers lack per-request priorities. */
+#ifndef IOCB_FLAG_IOPRIO
+#  define IOCB_FLAG_IOPRIO (1 << 1)
+#endif
+
+
+
+/*
+ * Create an AIO context able to hold depth requests in flight. Exits in
+ * case of error.
+ */
+void async_init(struct async_ctx *a, unsigned int depth)
+{
+    unsigned int i;
+    int retval;
+
+    assert(depth > 0);
+
+    a->ctx = 0;
+    a->depth = depth;
+    a->watched = malloc(depth * sizeof(*a->watched));
+    a->free_watched = malloc(depth * sizeof(*a->free_watched));
+    die_if(a->watched == NULL || a->free_watched == NULL, "malloc");
+
+    for (i=0; i<depth; i++)
+    {
+        a->watched[i].slot = -1;
+        a->free_watched[i] = i;
+    }
+    a->num_free = depth;
+
+    retval = syscall(SYS_io_setup, depth, &a->ctx);
+    die_if(retval != 0, "io_setup");
+}
+
+
+
+/*
+ * Destroy an AIO context. Any requests still in flight are waited for.
+ */
+void async_destroy(struct async_ctx *a)
+{
+    unsigned int i;
+
+    (void)syscall(SYS_io_destroy, a->ctx);
+    a->ctx = 0;
+
+    /* requests completed, but never reaped */
+    for (i=0; i<a->depth; i++)
+        watchdog_end(a->watched[i].slot);
+
+    free(a->watched);
+    free(a->free_watched);
+}
+
+
+
+/*
+ * Prepare a read request.
+ *
+ * Fills cb with a request to read count bytes into buffer, at the
+ * specified offset of fd. data is an opaque value, returned in the
+ * request's completion event.
+ */
+void async_prep_read(struct iocb *cb, int fd, void *buffer, size_t count,
+        uint64_t offset, void *data)
+{
+    memset(cb, 0, sizeof(*cb));
+    cb->aio_data = (uint64_t)(uintptr_t)data;
+    cb->aio_lio_opcode = IOCB_CMD_PREAD;
+    cb->aio_fildes = fd;
+    cb->aio_buf = (uint64_t)(uintptr_t)buffer;
+    cb->aio_nbytes = count;
+    cb->aio_offset = (int64_t)offset;
+}
+
+
+
+/*
+ * Prepare a vectored read request. Same as async_prep_read, but scatters
+ * the data into iovcnt buffers, described by iov. The iovec array must
+ * remain valid until the request is submitted.
+ */
+void async_prep_readv(struct iocb *cb, int fd, const struct iovec *iov,
+        int iovcnt, uint64_t offset, void *data)
+{
+    memset(cb, 0, sizeof(*cb));
+    cb->aio_data = (uint64_t)(uintptr_t)data;
+    cb->aio_lio_opcode = IOCB_CMD_PREADV;
+    cb->aio_fildes = fd;
+    cb->aio_buf = (uint64_t)(uintptr_t)iov;
+    cb->aio_nbytes = iovcnt;
+    cb->aio_offset = (int64_t)offset;
+}
+
+
+
+/*
+ * Tag a prepared request with an I/O priority, as built by
+ * IOPRIO_PRIO_VALUE. Overrides the priority of the submitting thread.
+ */
+void async_set_ioprio(struct iocb *cb, int ioprio)
+{
+    cb->aio_flags |= IOCB_FLAG_IOPRIO;
+    cb->aio_reqprio = ioprio;
+}
+
+
+
+/*
+ * Register a request with the watchdog, if it's running and there's a
+ * free record.
+ */
+static void watch_request(struct async_ctx *a, struct iocb *cb)
+{
+    struct async_watched *w;
+    size_t count = cb->aio_nbytes;
+    int slot;
+
+    if (a->num_free == 0)
+        return;
+
+    if (cb->aio_lio_opcode == IOCB_CMD_PREADV)
+    {
+        const struct iovec *iov = (const struct iovec *)(uintptr_t)cb->aio_buf;
+        size_t i;
+
+        count = 0;
+        for (i=0; i<cb->aio_nbytes; i++)
+            count += iov[i].iov_len;
+    }
+
+    slot = watchdog_begin((int)cb->aio_fildes, (uint64_t)cb->aio_offset,
+                          count);
+    if (slot < 0)
+        return;
+
+    w = &a->watched[a->free_watched[--a->num_free]];
+    w->data = cb->aio_data;
+    w->slot = slot;
+    cb->aio_data = (uint64_t)(uintptr_t)w;
+}
+
+
+
+/*
+ * Unregister a completed request from the watchdog, if it was watched,
+ * and give its event back the request's own aio_data.
+ */
+static void unwatch_request(struct async_ctx *a, struct io_event *event)
+{
+    struct async_watched *const w =
+        (struct async_watched *)(uintptr_t)event->data;
+
+    if (w < a->watched || w >= a->watched + a->depth)
+        return;
+
+    watchdog_end(w->slot);
+    event->data = w->data;
+    w->slot = -1;
+    a->free_watched[a->num_free++] = w - a->watched;
+}
+
+
+
+/*
+ * Submit count prepared requests. If the kernel accepts only part of the
+ * requests, the rest are resubmitted. The requests are watched for hangs,
+ * if the watchdog is running. Exits in case of error.
+ */
+void async_submit(struct async_ctx *a, struct iocb **cbs, int count)
+{
+    int done = 0;
+    int i;
+
+    for (i=0; i<count; i++)
+        watch_request(a, cbs[i]);
+
+    while (done < count)
+    {
+        const long retval = syscall(SYS_io_submit, a->ctx,
+                                    (long)(count - done), cbs + done);
+
+        if (retval < 0 && errno == EAGAIN)
+            continue;
+
+        die_if(retval <= 0, "io_submit");
+        done += retval;
+    }
+}
+
+
+
+/*
+ * Wait for completed requests.
+ *
+ * Waits for at least min_nr and at most max_nr requests to complete,
+ * storing their completion events in events. timeout, if non-NULL, limits
+ * the time spent waiting. Returns the number of completion events, which
+ * may be lower than min_nr if the timeout expired. Exits in case of error.
+ *
+ * Each event's res field holds the number of bytes read, or a negated
+ * error number; the caller must check it.
+ */
+int async_reap(struct async_ctx *a, struct io_event *events, int min_nr,
+        int max_nr, struct timespec *timeout)
+{
+    long retval, i;
+
+    do
+    {
+        retval = syscall(SYS_io_getevents, a->ctx, (long)min_nr,
+                         (long)max_nr, events, timeout);
+    } while (retval < 0 && errno == EINTR);
+
+    die_if(retval < 0, "io_getevents");
+
+    for (i=0; i<retval; i++)
+        unwatch_request(a, &events[i]);
+
+    return (int)retval;
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
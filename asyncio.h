@@ -0,0 +1,77 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* asyncio.h - asynchronous reads through Linux native AIO */
+
+
+#ifndef _ASYNCIO_H
+#define _ASYNCIO_H
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+
+#include <time.h>
+#include <sys/uio.h>
+#include <linux/aio_abi.h>
+
+/* get size_t */
+#include <stddef.h>
+
+/* get uint64_t */
+#include <stdint.h>
+
+
+/* A request in flight, registered with the watchdog. */
+struct async_watched {
+    uint64_t data;              /* the request's own aio_data */
+    int slot;                   /* in the watchdog; -1 = unused */
+};
+
+struct async_ctx {
+    aio_context_t ctx;
+    unsigned int depth;
+    struct async_watched *watched;      /* depth entries */
+    unsigned int *free_watched;
+    unsigned int num_free;
+};
+
+
+void async_init(struct async_ctx *a, unsigned int depth);
+
+void async_destroy(struct async_ctx *a);
+
+void async_prep_read(struct iocb *cb, int fd, void *buffer, size_t count,
+        uint64_t offset, void *data);
+
+void async_prep_readv(struct iocb *cb, int fd, const struct iovec *iov,
+        int iovcnt, uint64_t offset, void *data);
+
+void async_set_ioprio(struct iocb *cb, int ioprio);
+
+void async_submit(struct async_ctx *a, struct iocb **cbs, int count);
+
+int async_reap(struct async_ctx *a, struct io_event *events, int min_nr,
+        int max_nr, struct timespec *timeout);
+
+
+#endif  /* _ASYNCIO_H */
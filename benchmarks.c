@@ -47,39 +47,34 @@
 #endif
 #include <assert.h>
 
+#include "devio.h"
 #include "humanize.h"
+#include "latency.h"
+#include "profile.h"
+#include "benchmarks.h"
+#include "watchdog.h"
 
 
-#define min(x, y) ({  \
-  __typeof__(x) _x = (x); \
-  __typeof__(y) _y = (y); \
-  _x < _y ? _x : _y;  \
-})
-
-#define max(x, y) ({  \
-  __typeof__(x) _x = (x); \
-  __typeof__(y) _y = (y); \
-  _x > _y ? _x : _y;  \
-})
-
-/* CLOCK_MONOTONIC_RAW is immune to incremental adjustments performed by
- * adjtime() or NTP; however, it is Linux-specific */
-#ifndef CLOCK_MONOTONIC_RAW
-#  define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
-#endif
-
-
-#define MIB (1024UL * 1024UL)
-
 /* Default amount of random reads to do in the seek test. */
-#define DEFAULT_RAND_READ_SEEKS 200
+#define DEFAULT_RAND_READ_SEEKS 64
 
-/* Minimum amount of nanoseconds to spend in the random access test. */
+/* Minimum amount of nanoseconds to spend in the random access test, unless
+ * the access time is already known within AUTO_RAND_READ_PRECISION. */
 #define MIN_AUTO_RAND_READ_NS (1000000000UL)
 
+/* Stop autodetecting the amount of random reads once the 95% confidence
+ * interval of the access time is within this fraction of it. */
+#define AUTO_RAND_READ_PRECISION 0.025
+
 /* Maximum amount of random reads to do in seek test when autodetecting. */
 #define MAX_AUTO_RAND_READ_SEEKS 25600
 
+/* Largest transfer size in the random access test. */
+#define MAX_FIT_READ_BYTES (1 * MIB)
+
+/* Maximum number of transfer sizes in the random access test. */
+#define MAX_FIT_SIZES 16
+
 /* Default amount of bytes to read sequentially in a single block. */
 #define DEFAULT_SEQ_READ_BYTES (64 * MIB)
 
@@ -90,14 +85,6 @@
 #define MAX_AUTO_SEQ_READ_BYTES (1024UL * MIB)
 
 
-struct blkdev_info {
-    uint64_t dev_size;
-    uint64_t num_blocks;
-    unsigned int block_size;
-    size_t alignment;
-};
-
-
 struct benchmark_results {
     char *path;
     struct blkdev_info dev_info;
@@ -106,301 +93,13 @@ struct benchmark_results {
     uint64_t seq_read_ns;
     uint64_t block_read_ns;
     uint64_t total_randaccess_ns;
-    uint64_t randaccess_reading_ns;
-    uint64_t seek_ns;
+    size_t min_fit_size;
+    size_t max_fit_size;
+    struct linear_fit access_fit;
 };
 
 
 
-/*
- * Terminate the program if error is true.
- *
- * Prints the message to stderr before terminating, followed by a message
- * describing the specified error number.
- */
-static inline void die_if_with_errno(int error, const char *msg, int errnum)
-{
-    if (error) {
-        fprintf(stderr, "%s: %s\n", msg, strerror(errnum));
-        exit(EXIT_FAILURE);
-    }
-}
-
-
-
-/*
- * Terminate the program if error is true.
- *
- * Prints the message to stderr before terminating, followed by a message
- * describing the current value in errno.
- */
-static inline void die_if(int error, const char *msg)
-{
-    if (error) {
-        perror(msg);
-        exit(EXIT_FAILURE);
-    }
-}
-
-
-
-static inline size_t align_ceil(size_t n, size_t alignment)
-{
-    const size_t remainder = n % alignment;
-
-    return remainder != 0 ? (n - remainder) + alignment : n;
-}
-
-
-
-/*
- * 64-bit version of random().
- *
- * Returns a random unsigned 64-bit number. Uses random() and scales it
- * proportionally up to 0..2**64-1.
- */
-static inline uint64_t random64(void)
-{
-    if (RAND_MAX < ~(uint64_t)0)
-        return random() * (~(uint64_t)0 / RAND_MAX);
-    else
-        /* cover system whose RAND_MAX (long int) doesn't fit in 64 bits */
-        return (uint64_t)random();
-}
-
-
-
-/*
- * Return the logarithm of x to base 2, rounded down to zero.
- *
- * x must not be zero.
- */
-static unsigned int log2_floor(unsigned int x)
-{
-    unsigned int exp = 0;
-
-    assert(x != 0);
-
-    while (x > 1)
-    {
-        exp++;
-        x >>= 1;
-    }
-
-    assert(exp <= sizeof(x) * CHAR_BIT);
-
-    return exp;
-}
-
-
-
-/*
- * Return the smallest power of 2 larger than or equal to x.
- *
- * Exits if x is larger than the largest power of 2 that will fit in an
- * unsigned int.
- */
-static unsigned int smallest_power_of_2_that_holds(unsigned int x)
-{
-    unsigned int exp;
-
-    if (x == 0)
-        /* can't calculate log(0); just return the correct result (first power
-         * of 2, 2**0 = 1) */
-        return 1;
-
-    /* make sure x fits in the largest power of 2 an unsigned int can hold */
-    if (x > (1U << (sizeof(unsigned int)*CHAR_BIT - 1)))
-    {
-        fprintf(stderr,
-                "error: %u doesn't fit in largest power of 2 an unsigned int can hold\n",
-                x);
-        exit(1);
-    }
-
-    exp = log2_floor(x);
-
-    return 1U << exp == x ? x : 1U << (exp + 1);
-}
-
-
-
-/*
- * Convert a struct timespec to nanoseconds.
- *
- * May return undefined results due to integer overflow, if the seconds field
- * contains a value greater than (2**64 - 1) / 10**9 ~= 2**34 s ~= 584 years.
- */
-static inline uint64_t timespec_to_ns(const struct timespec *ts)
-{
-    return (uint64_t)ts->tv_sec*1000000000UL + ts->tv_nsec;
-}
-
-
-
-/*
- * Calculate difference between two struct timespec, in nanoseconds.
- *
- * Returns the difference in nanoseconds between time t1 and time t0,
- * represented as an uint64_t. May have undefined behavior if t0 is greater
- * than t1, due to integer overflow.
- */
-static uint64_t timespec_diff_ns(const struct timespec *t1,
-        const struct timespec *t0)
-{
-    return timespec_to_ns(t1) - timespec_to_ns(t0);
-}
-
-
-
-/*
- * Get a device's physical block size. Receives an open file descriptor for the
- * device. Exits in case of error.
- */
-static unsigned int get_physical_block_size(int fd)
-{
-    unsigned int block_size;
-    int retval;
-
-    retval = ioctl(fd, BLKPBSZGET, &block_size);
-    die_if(retval == -1, "ioctl(BLKPBSZGET)");
-
-    return block_size;
-}
-
-
-
-/*
- * Get buffer alignment for reading from fd.
- *
- * Uses the POSIX fpathconf interface to query proper alignment from the
- * system. In case of error or unspecified alignment, assumes fd is a block
- * device and falls back to checking its block size.
- */
-static size_t get_readbuf_align(int fd)
-{
-    long align_l;
-
-    errno = 0;
-    align_l = fpathconf(fd, _PC_REC_XFER_ALIGN);
-
-    assert(align_l >= -1);
-
-    /* fallback to device's block size in case of error or useless value */
-    switch (align_l)
-    {
-        case -1:    /* no specific align recommendation, or error */
-            die_if(errno != 0, "fpathconf");
-            /* FALL THROUGH */
-        case 0:     /* 0 align makes no sense */
-            align_l = (long)get_physical_block_size(fd);
-    }
-
-    return (size_t)align_l;
-}
-
-
-
-/*
- * Get the size of a device. Receives an open file descriptor for the device.
- * Exits in case of error.
- */
-static uint64_t get_dev_size(int fd)
-{
-    uint64_t size;
-    int retval;
-
-    retval = ioctl(fd, BLKGETSIZE64, &size);
-    die_if(retval == -1, "ioctl(BLKGETSIZE64)");
-
-    return size;
-}
-
-
-
-/*
- * Wrapper for read() that does an lseek first. Exits in case of error.
- */
-static void read_at(int fd, void *buffer, size_t count, off64_t offset)
-{
-    off64_t seek_ok;
-    ssize_t read_ok;
-
-    seek_ok = lseek64(fd, offset, SEEK_SET);
-    die_if(seek_ok == (off64_t)-1, "lseek64");
-    read_ok = read(fd, buffer, count);
-    die_if(read_ok < 0, "read");
-}
-
-
-
-/*
- * Get a timestamp in seconds, with very high precision.
- *
- * Receives a pointer to a struct timespec, where the timestamp will be stored.
- * The time value is relative to some unspecified starting point; useful for
- * relative time calculations (timing measurements).
- */
-static void get_cur_timestamp(struct timespec *now)
-{
-    int retval;
-
-    retval = clock_gettime(CLOCK_MONOTONIC_RAW, now);
-    die_if(retval == -1, "clock_gettime");
-}
-
-
-
-/*
- * Calculate the tolerance in taking two time measurements and calculating the
- * time delta. Returns half the maximum error in nanoseconds; the actual
- * tolerance is +/- the returned value.
- */
-static uint64_t get_timing_tolerance_ns(void)
-{
-    struct timespec res;
-    int retval;
-    struct timespec t0, t1;
-    uint64_t resolution_ns, delta_ns;
-
-    /* get the underlying clock's resolution (lower bound) */
-    retval = clock_getres(CLOCK_MONOTONIC_RAW, &res);
-    die_if(retval == -1, "clock_getres");
-
-    resolution_ns = timespec_to_ns(&res);
-
-    /* measure the actual overhead of measuring time */
-    get_cur_timestamp(&t0);
-    get_cur_timestamp(&t1);
-    delta_ns = timespec_diff_ns(&t1, &t0);
-
-    /* tolerance is +/- half the maximum error */
-    return max(resolution_ns, delta_ns) / 2;
-}
-
-
-
-/*
- * Allocate a block of memory of the specified size, aligned to the specified
- * alignment. Returns a pointer to the newly allocated memory. The memory
- * should be released with free() when no longer necessary. Exits in case of
- * error.
- */
-static void *allocate_aligned_memory(size_t alignment, size_t size)
-{
-    void *buffer;
-    int retval;
-
-    retval = posix_memalign(&buffer,
-                            smallest_power_of_2_that_holds(alignment),
-                            size);
-    die_if_with_errno(retval != 0, "posix_memalign", retval);
-
-    return buffer;
-}
-
-
-
 /*
  * Get a block device's average block read time, for a given read size.
  *
@@ -507,7 +206,8 @@ static uint64_t get_block_read_ns(int fd, const struct blkdev_info *blkdev_info,
         /* loop increasing read size until we take at least a certain amount
          * of time doing the read; keep track of total time and bytes read */
         for (read_size = DEFAULT_SEQ_READ_BYTES;
-             total_read_ns < MIN_AUTO_SEQ_READ_NS && read_size <= MAX_AUTO_SEQ_READ_BYTES;
+             total_read_ns < MIN_AUTO_SEQ_READ_NS && read_size <= MAX_AUTO_SEQ_READ_BYTES
+             && !watchdog_aborting();
              read_size *= 2)
         {
             size_t _total_bytes;
@@ -523,7 +223,8 @@ static uint64_t get_block_read_ns(int fd, const struct blkdev_info *blkdev_info,
 
         /* calculate the time it takes to read one block, based on the
          * average time it took to make all automated reads */
-        block_read_ns = total_read_ns / (total_bytes / blkdev_info->block_size);
+        block_read_ns = total_read_ns
+                        / max(total_bytes / blkdev_info->block_size, (size_t)1);
 
         if (p_total_bytes != NULL)
             *p_total_bytes = total_bytes;
@@ -541,205 +242,191 @@ static uint64_t get_block_read_ns(int fd, const struct blkdev_info *blkdev_info,
 
 
 /*
- * Get a block device's average seek time, for a given number of seeks.
- *
- * Does a random access read test on a block device, to find its average seek
- * time. Receives the file descriptor of the block device, a pointer to a
- * struct with information about the device, the number of seeks to be
- * performed, and the amount of time it takes to read a single block of the
- * device, in nanoseconds.
- *
- * p_total_ns, if non-NULL, should point to a uint64_t which will be set to
- * the amount of time that was spent seeking and reading block data, in
- * nanoseconds.
- *
- * Returns the average seek time of the block device, in nanoseconds. Exits in
- * case of error.  Requires randomness to be previously initialized (call
- * init_randomness).
+ * Do random reads of several transfer sizes, timing each one.
+ *
+ * Does num_reads random reads on a block device, cycling through the
+ * num_sizes transfer sizes in sizes (each a multiple of the device's block
+ * size). Appends each read's size to x and its latency, in nanoseconds, to
+ * y, starting at index *p_count, which is updated. buffer must hold the
+ * largest size.
+ *
+ * The offsets for each size follow the van der Corput sequence, rotated by
+ * that size's entry in shifts (random fractions of 2^64), and continue
+ * from one call to the next. Every part of the device is then sampled
+ * evenly, which makes the mean access time converge much faster than with
+ * independent offsets, while the random rotation keeps it unbiased.
+ *
+ * Returns the time spent in the whole test, in nanoseconds. Exits in case
+ * of error.
  */
-static uint64_t get_seek_for_count(int fd, const struct blkdev_info *blkdev_info,
-        unsigned int num_seeks, uint64_t block_read_ns, uint64_t *p_total_ns)
+static uint64_t get_random_read_samples(int fd,
+        const struct blkdev_info *blkdev_info, unsigned int num_reads,
+        const size_t *sizes, const uint64_t *shifts, unsigned int num_sizes,
+        char *buffer, double *x, double *y, size_t *p_count)
 {
     const unsigned int block_size = blkdev_info->block_size;
-    const uint64_t num_blocks = blkdev_info->num_blocks;
-    const uint64_t randaccess_reading_ns = block_read_ns * num_seeks;
     struct timespec start, end;
-    uint64_t delta_ns;
-    char *buffer;
     unsigned int i;
 
-    assert(num_seeks > 0);
-
-    buffer = allocate_aligned_memory(blkdev_info->alignment, block_size);
+    assert(num_reads > 0 && num_sizes > 0);
 
     printf("Performing %u random reads, please wait a few seconds...\n",
-           num_seeks);
+           num_reads);
 
     get_cur_timestamp(&start);
-    for (i=0; i<num_seeks; i++)
+    for (i=0; i<num_reads && !watchdog_aborting(); i++)
     {
-        /* TODO: We shouldn't include the time it takes to generate a
-         * random number in the measurements. Take granular measurements
-         * around the read_at, and accumulate the values. */
-        uint64_t block_idx = random64() % num_blocks;
-
-        read_at(fd, buffer, block_size, block_idx * block_size);
+        const size_t n = *p_count + i;
+        const size_t size = sizes[n % num_sizes];
+        const uint64_t choices = blkdev_info->num_blocks - size / block_size + 1;
+        /* each size gets its own sequence, so sizes don't correlate with
+         * regions of the device */
+        const uint64_t point = van_der_corput64(n / num_sizes)
+                               + shifts[n % num_sizes];
+        const uint64_t block_idx = min((uint64_t)(point / 18446744073709551616.0L
+                                                  * choices),
+                                       choices - 1);
+        uint64_t t0;
+
+        /* time only the read itself, not the offset generation */
+        t0 = get_cur_ns();
+        read_at(fd, buffer, size, block_idx * block_size);
+        y[*p_count + i] = (double)(get_cur_ns() - t0);
+        x[*p_count + i] = (double)size;
     }
     get_cur_timestamp(&end);
 
-    free(buffer);
-
-    delta_ns = timespec_diff_ns(&end, &start);
-
-    if (p_total_ns != NULL)
-        *p_total_ns = delta_ns;
+    *p_count += i;
 
-    /* randaccess_reading_ns is a calculated estimate; protect against
-     * integer underflow if actual time measured (including seek time) was
-     * lower than that */
-    return (delta_ns > randaccess_reading_ns)
-           ? (delta_ns - randaccess_reading_ns) / num_seeks
-           : 0;
+    return timespec_diff_ns(&end, &start);
 }
 
 
 
 /*
- * Get a block device's average seek time.
- *
- * Does random access read tests on a block device, to find its average seek
- * time. Receives the file descriptor of the block device, a pointer to a
- * struct with information about the device, the (optional) number of seeks
- * to be performed, and the amount of time it takes to read a single block
- * of the device, in nanoseconds.
- *
- * The random access tests are done by calling get_seek_for_count.
- *
- * p_total_ns, if non-NULL, should point to a uint64_t which will be set to
- * the amount of time that was spent seeking and reading block data, in
- * nanoseconds. p_randaccess_reading_ns, if non-NULL, should point to a
- * uint64_t which will be set to the estimated amount of time that was
- * spent actually reading the data during the seek test (i.e. minus the
- * seeks themselves).
- *
- * Returns the average seek time of the block device, in nanoseconds. Exits in
- * case of error.  Requires randomness to be previously initialized (call
- * init_randomness).
+ * Fit a model of a block device's random read latency.
+ *
+ * Does random reads of transfer sizes from one block up to
+ * MAX_FIT_READ_BYTES, and fits latency = access + size / transfer_rate to
+ * them by least squares. The intercept is the access time, i.e. the time
+ * to get to the data (seek and rotational delay on disks, command and
+ * flash latency on SSDs); the slope is the inverse of the transfer rate.
+ *
+ * Unlike subtracting the sequential read time, this measures the transfer
+ * cost with the same access pattern as the access time, and can't go
+ * negative on fast devices.
+ *
+ * If num_reads is zero, it will be autodetected, by doing rounds of
+ * exponentially increasing read counts, until they take at least
+ * MIN_AUTO_RAND_READ_NS nanoseconds, or the access time is known within
+ * AUTO_RAND_READ_PRECISION. The fit uses every read.
+ *
+ * The fit, total number of reads, range of sizes and time spent are
+ * stored in res. Exits in case of error. Requires randomness to be
+ * previously initialized (call init_randomness).
  */
-static uint64_t get_seek_ns(int fd, const struct blkdev_info *blkdev_info,
-        unsigned int num_seeks, uint64_t block_read_ns, uint64_t *p_total_ns,
-        uint64_t *p_randaccess_reading_ns)
+static void get_access_model(int fd, const struct blkdev_info *blkdev_info,
+        unsigned int num_reads, struct benchmark_results *res)
 {
-    uint64_t seek_ns;
-    uint64_t randaccess_reading_ns;
-
-    if (num_seeks == 0)
-    {   /* autodetect seek count */
-        unsigned int total_seeks = 0;
-        uint64_t total_ns = 0;
-
-        /* loop increasing seek count until we take at least a certain
-         * amount of time doing the seeks; keep track of total time and
-         * seeks performed */
-        for (num_seeks = DEFAULT_RAND_READ_SEEKS;
-             total_ns < MIN_AUTO_RAND_READ_NS && num_seeks <= MAX_AUTO_RAND_READ_SEEKS;
-             num_seeks *= 2)
-        {
-            uint64_t _total_ns;
+    const uint64_t max_size = min((uint64_t)MAX_FIT_READ_BYTES,
+                                  blkdev_info->dev_size);
+    const size_t capacity = num_reads != 0 ? num_reads
+                                           : 2 * MAX_AUTO_RAND_READ_SEEKS;
+    size_t sizes[MAX_FIT_SIZES];
+    uint64_t shifts[MAX_FIT_SIZES];
+    unsigned int num_sizes = 0;
+    double *x = malloc(capacity * sizeof(*x));
+    double *y = malloc(capacity * sizeof(*y));
+    size_t count = 0;
+    uint64_t total_ns = 0;
+    size_t size;
+    char *buffer;
 
-            /* ignore the return value, we calculate it later */
-            (void)get_seek_for_count(fd, blkdev_info, num_seeks,
-                    block_read_ns, &_total_ns);
+    die_if(x == NULL || y == NULL, "malloc");
 
-            total_seeks += num_seeks;
-            total_ns += _total_ns;
-        }
-
-        /* estimate the time it takes to read the blocks of data we seeked
-         * to read, based on the average time it takes to read one block */
-        randaccess_reading_ns = block_read_ns * total_seeks;
+    for (size = blkdev_info->block_size;
+         size <= max_size && num_sizes < MAX_FIT_SIZES; size *= 2)
+    {
+        shifts[num_sizes] = random64();
+        sizes[num_sizes++] = size;
+    }
 
-        /* protect against integer overflow, as randaccess_reading_ns is an
-         * estimate and may overshoot our measured time, even with seeks*/
-        seek_ns = (total_ns > randaccess_reading_ns)
-                  ? (total_ns - randaccess_reading_ns) / total_seeks : 0;
+    buffer = allocate_aligned_memory(blkdev_info->alignment,
+            sizes[num_sizes - 1]);
 
-        if (p_total_ns != NULL)
-            *p_total_ns = total_ns;
+    if (num_reads == 0)
+    {   /* autodetect read count */
+        for (num_reads = DEFAULT_RAND_READ_SEEKS;
+             total_ns < MIN_AUTO_RAND_READ_NS && num_reads <= MAX_AUTO_RAND_READ_SEEKS
+             && !watchdog_aborting();
+             num_reads *= 2)
+        {
+            total_ns += get_random_read_samples(fd, blkdev_info, num_reads,
+                    sizes, shifts, num_sizes, buffer, x, y, &count);
+
+            fit_linear(x, y, count, &res->access_fit);
+            if (res->access_fit.intercept > 0
+                && res->access_fit.intercept_ci
+                   <= AUTO_RAND_READ_PRECISION * res->access_fit.intercept)
+                break;
+        }
     }
     else
-    {   /* use specified seek count */
-        seek_ns = get_seek_for_count(fd, blkdev_info, num_seeks, block_read_ns,
-                p_total_ns);
-
-        randaccess_reading_ns = block_read_ns * num_seeks;
+    {   /* use specified read count */
+        total_ns = get_random_read_samples(fd, blkdev_info, num_reads,
+                sizes, shifts, num_sizes, buffer, x, y, &count);
     }
 
-    if (p_randaccess_reading_ns != NULL)
-        *p_randaccess_reading_ns = randaccess_reading_ns;
-
-    return seek_ns;
-}
-
+    fit_linear(x, y, count, &res->access_fit);
 
+    res->num_seeks = count;
+    res->total_randaccess_ns = total_ns;
+    res->min_fit_size = sizes[0];
+    res->max_fit_size = sizes[num_sizes - 1];
 
-/*
- * Initialize random number generator engine.
- */
-static inline void init_randomness(void)
-{
-    srandom(time(NULL));
+    free(buffer);
+    free(y);
+    free(x);
 }
 
 
 
 /*
- * Get information about a block device.
- *
- * Receives the file descriptor of the block device, and a pointer to a struct
- * blkdev_info where the results will be stored.
+ * Run benchmarks on a block device and get results.
  *
- * Exits in case of error.
+ * Receives an open file descriptor of the block device to be tested, and a
+ * pointer to a struct benchmark_results where the results will be stored.
+ * res->dev_info must already be filled in.
  */
-static void get_blkdev_info(int fd, struct blkdev_info *blkdev_info)
+static void run_benchmarks(int fd, unsigned int num_seeks, size_t read_size,
+        struct benchmark_results *res)
 {
-    blkdev_info->block_size = get_physical_block_size(fd);
-    blkdev_info->dev_size = get_dev_size(fd);
-    blkdev_info->num_blocks = blkdev_info->dev_size / blkdev_info->block_size;
-
-    if (blkdev_info->dev_size < blkdev_info->block_size)
-    {
-        fprintf(stderr,
-                "error: block size (%u) is greater than device itself (%" PRIu64 ")\n",
-                blkdev_info->block_size,
-                blkdev_info->dev_size);
-        exit(1);
-    }
+    res->block_read_ns = get_block_read_ns(fd, &res->dev_info, read_size,
+            &res->seq_read_bytes, &res->seq_read_ns);
 
-    blkdev_info->alignment = get_readbuf_align(fd);
+    init_randomness();
+    get_access_model(fd, &res->dev_info, num_seeks, res);
 }
 
 
 
 /*
- * Run benchmarks on a block device and get results.
- *
- * Receives an open file descriptor of the block device to be tested, and a
- * pointer to a struct benchmark_results where the results will be stored.
+ * Format a time interval, centered on value_ns with the specified
+ * half-width, as "low .. high". Negative values are clamped to zero.
+ * Returns a newly allocated string.
  */
-static void run_benchmarks(int fd, unsigned int num_seeks, size_t read_size,
-        struct benchmark_results *res)
+static char *format_time_ci(double value_ns, double half_width_ns)
 {
-    get_blkdev_info(fd, &res->dev_info);
+    char *const low = humanize_time((uint64_t)max(value_ns - half_width_ns, 0.0), 3);
+    char *const high = humanize_time((uint64_t)max(value_ns + half_width_ns, 0.0), 3);
+    char *result;
 
-    res->block_read_ns = get_block_read_ns(fd, &res->dev_info, read_size,
-            &res->seq_read_bytes, &res->seq_read_ns);
+    die_if(asprintf(&result, "%s .. %s", low, high) < 0, "asprintf");
 
-    init_randomness();
-    res->seek_ns = get_seek_ns(fd, &res->dev_info, num_seeks,
-            res->block_read_ns, &res->total_randaccess_ns,
-            &res->randaccess_reading_ns);
-    res->num_seeks = num_seeks;
+    free(low);
+    free(high);
+
+    return result;
 }
 
 
@@ -752,6 +439,8 @@ static void run_benchmarks(int fd, unsigned int num_seeks, size_t read_size,
  */
 static void print_benchmarks(const char *path, const struct benchmark_results *res)
 {
+    const struct linear_fit *const fit = &res->access_fit;
+
     /* device size, in human terms */
     const struct human_value dev_size = humanize_binary_size(res->dev_info.dev_size);
 
@@ -769,24 +458,30 @@ static void print_benchmarks(const char *path, const struct benchmark_results *r
     const struct human_value seq_read_speed = humanize_binary_speed((long double)res->seq_read_bytes
             / ((long double)res->seq_read_ns / 1000000000ULL));
 
-    /* total time spent actually reading data, while doing random access reads */
-    char *const randaccess_reading_time = humanize_time(res->randaccess_reading_ns, 3);
-
     /* total time spent in the random access test, in human terms */
     char *const total_randaccess_time = humanize_time(res->total_randaccess_ns, 3);
 
-    /* total time spent seeking in seconds, while doing random access reads */
-    const uint64_t randaccess_seeking_ns =
-        res->total_randaccess_ns > res->randaccess_reading_ns
-        ? (res->total_randaccess_ns - res->randaccess_reading_ns)
-        : 0;
-    char *const randaccess_seeking_time = humanize_time(randaccess_seeking_ns, 3);
+    /* range of transfer sizes in the random access test */
+    const struct human_value min_fit_size = humanize_binary_size(res->min_fit_size);
+    const struct human_value max_fit_size = humanize_binary_size(res->max_fit_size);
 
-    /* average seek time, in human terms */
-    char *const seek_time = humanize_time(res->seek_ns, 3);
+    /* access time (the fit's intercept); clamp, as noise may make it
+     * slightly negative on very fast devices */
+    const uint64_t access_ns = (uint64_t)max(fit->intercept, 0.0);
+    char *const access_time = humanize_time(access_ns, 3);
+    char *const access_ci = format_time_ci(fit->intercept, fit->intercept_ci);
 
-    /* 1 / (seek_ns / 1000000000L) == 1000000000L / seek_ns*/
-    const long double seeks_per_second = 1000000000L / (long double)res->seek_ns;
+    /* transfer rate (the inverse of the fit's slope), in bytes/second */
+    const struct human_value rate = humanize_binary_speed(fit->slope > 0
+            ? NS_PER_SEC / (long double)fit->slope : 0);
+    const struct human_value rate_low = humanize_binary_speed(fit->slope > 0
+            ? NS_PER_SEC / (long double)(fit->slope + fit->slope_ci) : 0);
+    const struct human_value rate_high = humanize_binary_speed(
+            fit->slope > fit->slope_ci
+            ? NS_PER_SEC / (long double)(fit->slope - fit->slope_ci) : 0);
+
+    /* 1 / (access_ns / 1000000000L) == 1000000000L / access_ns*/
+    const long double seeks_per_second = 1000000000L / (long double)max(access_ns, (uint64_t)1);
 
     /* time measurement tolerance, in human terms */
     char *const timing_tolerance = humanize_time(get_timing_tolerance_ns(), 3);
@@ -799,12 +494,8 @@ static void print_benchmarks(const char *path, const struct benchmark_results *r
            " Sequential read speed: %.2Lf %s (%.2Lf %s in %s)\n"
            " Average time to read 1 physical block: %s\n"
            " Total time spent doing random reads: %s\n"
-           "   estimated time spent actually reading data inside the blocks: %s\n"
-           "   estimated time seeking: %s\n"
-           " Random access time: %s\n"
-           " Seeks/second: %.3Lf\n"
-           "\n"
-           " Minimum individual time measurement error: +/- %s\n",
+           "   %u reads of %.2Lf %s to %.2Lf %s, fit to access + size / rate\n"
+           "   (R^2 = %.3f)\n",
            path,
            res->dev_info.block_size,
            dev_size.value, dev_size.unit,
@@ -815,35 +506,114 @@ static void print_benchmarks(const char *path, const struct benchmark_results *r
            seq_read_time,
            block_read_time,
            total_randaccess_time,
-           randaccess_reading_time,
-           randaccess_seeking_time,
-           seek_time,
-           seeks_per_second,
+           res->num_seeks,
+           min_fit_size.value, min_fit_size.unit,
+           max_fit_size.value, max_fit_size.unit,
+           fit->r2);
+
+    /* too few reads to fit, e.g. if the test was stopped early */
+    if (fit->count < 3)
+        printf(" Random access time: not measured\n");
+    else
+    {
+        printf(" Random access time: %s (95%% CI: %s)\n", access_time,
+               access_ci);
+
+        if (fit->slope > 0)
+        {
+            printf(" Random transfer rate: %.2Lf %s (95%% CI: %.2Lf %s .. ",
+                   rate.value, rate.unit, rate_low.value, rate_low.unit);
+            if (fit->slope > fit->slope_ci)
+                printf("%.2Lf %s)\n", rate_high.value, rate_high.unit);
+            else
+                printf("unbounded)\n");
+        }
+        else
+        {
+            printf(" Random transfer rate: too fast to measure\n");
+        }
+
+        printf(" Seeks/second: %.3Lf\n", seeks_per_second);
+    }
+
+    printf("\n"
+           " Minimum individual time measurement error: +/- %s\n",
            timing_tolerance);
 
     free(seq_read_time);
     free(block_read_time);
-    free(randaccess_reading_time);
     free(total_randaccess_time);
-    free(randaccess_seeking_time);
-    free(seek_time);
+    free(access_time);
+    free(access_ci);
     free(timing_tolerance);
 }
 
 
-void run_and_print_benchmarks(const char *devname, unsigned int num_seeks,
-        size_t read_size)
+/*
+ * Run the sequential read and random access benchmarks on a block device,
+ * and print the results. Exits in case of error.
+ *
+ * Unless opts->no_profile_cache is set, the autodetected read size and
+ * seek count are saved in the device's profile, and reused on later runs
+ * (unless opts->recalibrate is set). Values given in opts take precedence.
+ */
+void run_and_print_benchmarks(const char *devname,
+        const struct bench_options *opts)
 {
     struct benchmark_results results;
+    struct device_profile profile;
+    char id[DEVICE_ID_LEN];
+    size_t read_size = opts->read_size;
+    unsigned int num_seeks = opts->num_seeks;
+    int have_id = 0, cached = 0;
     int fd;
 
-    fd = open(devname, O_RDONLY | O_DIRECT | O_SYNC);
-    die_if(fd < 0, "open");
+    fd = open_blkdev(devname);
+
+    get_blkdev_info(fd, &results.dev_info);
+    profile.info = results.dev_info;
+
+    if (!opts->no_profile_cache)
+        have_id = get_device_id(fd, id, sizeof(id)) == 0;
+
+    if (have_id && !opts->recalibrate && (read_size == 0 || num_seeks == 0)
+        && load_profile(id, &profile) == 0)
+    {
+        printf("Using calibration from the profile of %s\n"
+               "(use --recalibrate to detect it again)\n", id);
+
+        cached = 1;
+        if (read_size == 0)
+            read_size = profile.read_size;
+        if (num_seeks == 0)
+            num_seeks = profile.num_seeks;
+    }
 
     run_benchmarks(fd, num_seeks, read_size, &results);
 
     close(fd);
 
+    /* a single read of half the total (one at each end of the device)
+     * takes as long as the whole autodetection did; but no larger than
+     * the autodetection's largest read, as it's a single buffer; an aborted run
+     * isn't a calibration */
+    if (have_id && !cached && opts->read_size == 0 && opts->num_seeks == 0
+        && !watchdog_aborting())
+    {
+        int error;
+
+        profile.read_size = min(min(align_ceil(results.seq_read_bytes / 2,
+                                               results.dev_info.alignment),
+                                    (size_t)MAX_AUTO_SEQ_READ_BYTES),
+                                (size_t)results.dev_info.dev_size);
+        profile.num_seeks = results.num_seeks;
+
+        error = save_profile(id, &profile);
+        if (error != 0)
+            fprintf(stderr, "warning: can't save profile of %s: %s\n",
+                    id, strerror(error));
+    }
+
     print_benchmarks(devname, &results);
 }
 
@@ -30,11 +30,11 @@
 #endif
 
 
-/* get size_t */
-#include <stddef.h>
+#include "options.h"
 
-void run_and_print_benchmarks(const char *devname, unsigned int num_seeks,
-        size_t read_size);
+
+void run_and_print_benchmarks(const char *devname,
+        const struct bench_options *opts);
 
 
 #endif  /* _BENCHMARKS_H */
@@ -0,0 +1,371 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* cached.c - page cache read scalability
+ *
+ * Every other mode reads with O_DIRECT, to measure the device. This one
+ * does the opposite: it reads a region of the device into the page cache,
+ * then runs random and sequential buffered reads within it from a growing
+ * number of threads. Nothing should reach the device, so what's measured
+ * is the cost of page cache lookups and copies, and how it scales across
+ * CPUs; the ceiling of a service whose data fits in memory.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "cached.h"
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "workload.h"
+
+
+/* Default size of the random reads. */
+#define DEFAULT_READ_BYTES 4096
+
+/* Size of the sequential reads. */
+#define SEQ_READ_BYTES (128 * 1024)
+
+/* Size of the region read into the page cache, at most; also capped to a
+ * fraction of the memory, so that it stays cached. */
+#define DEFAULT_REGION_BYTES (256 * 1024 * 1024ULL)
+#define MAX_REGION_MEM_FRACTION 4
+
+/* Warn if less than this fraction of the region is cached. */
+#define MIN_RESIDENT_FRACTION 0.95
+
+/* Most thread counts in the sweep. */
+#define MAX_STEPS 16
+
+
+struct cached_worker {
+    /* parameters */
+    int fd;
+    uint64_t region_bytes;
+    size_t read_size;
+    int sequential;
+    uint64_t first_offset;      /* sequential streams start here */
+    uint64_t duration_ns;
+    uint64_t seed;
+
+    /* results */
+    struct latency_hist lat;
+    uint64_t bytes;
+    uint64_t elapsed_ns;
+};
+
+struct step_result {
+    unsigned int threads;
+    struct latency_stats stats;
+    uint64_t bytes;
+    uint64_t elapsed_ns;
+};
+
+
+
+static void *cached_worker_main(void *arg)
+{
+    struct thread_arg *t = arg;
+    struct cached_worker *w = t->data;
+    const uint64_t num_reads = w->region_bytes / w->read_size;
+    uint64_t offset = w->first_offset;
+    uint64_t start_ns, now_ns;
+    char *buffer;
+
+    buffer = malloc(w->read_size);
+    die_if(buffer == NULL, "malloc");
+
+    pthread_barrier_wait(t->start);
+
+    now_ns = start_ns = get_cur_ns();
+
+    while (now_ns - start_ns < w->duration_ns)
+    {
+        uint64_t t0;
+        ssize_t read_ok;
+
+        if (w->sequential)
+        {
+            offset += w->read_size;
+            if (offset + w->read_size > w->region_bytes)
+                offset = 0;
+        }
+        else
+            offset = (random64_r(&w->seed) % num_reads) * w->read_size;
+
+        /* not read_at: cached reads can't hang, and the watchdog's
+         * bookkeeping would be a noticeable part of each one */
+        t0 = get_cur_ns();
+        read_ok = pread64(w->fd, buffer, w->read_size, (off64_t)offset);
+        now_ns = get_cur_ns();
+        die_if(read_ok < 0, "read");
+
+        latency_hist_add(&w->lat, now_ns - t0);
+        w->bytes += w->read_size;
+    }
+
+    w->elapsed_ns = get_cur_ns() - start_ns;
+
+    free(buffer);
+
+    return NULL;
+}
+
+
+
+/*
+ * Read the region into the page cache.
+ */
+static void warm_region(int fd, uint64_t region_bytes)
+{
+    char *buffer = malloc(SEQ_READ_BYTES);
+    uint64_t offset;
+
+    die_if(buffer == NULL, "malloc");
+
+    for (offset=0; offset < region_bytes; offset += SEQ_READ_BYTES)
+        read_at(fd, buffer, min((uint64_t)SEQ_READ_BYTES,
+                                region_bytes - offset), offset);
+
+    free(buffer);
+}
+
+
+
+/*
+ * Get the fraction of the region that is in the page cache.
+ */
+static double get_resident_fraction(int fd, uint64_t region_bytes)
+{
+    const size_t page = sysconf(_SC_PAGESIZE);
+    const size_t num_pages = (region_bytes + page - 1) / page;
+    unsigned char *vec = malloc(num_pages);
+    uint64_t resident = 0;
+    void *map;
+    size_t i;
+
+    die_if(vec == NULL, "malloc");
+
+    map = mmap(NULL, region_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    die_if(map == MAP_FAILED, "mmap");
+    die_if(mincore(map, region_bytes, vec) != 0, "mincore");
+    munmap(map, region_bytes);
+
+    for (i=0; i<num_pages; i++)
+        resident += vec[i] & 1;
+
+    free(vec);
+
+    return (double)resident / num_pages;
+}
+
+
+
+/*
+ * Run one step of the sweep: threads readers, all random or all
+ * sequential, for duration_ns. Stores the results in res.
+ */
+static void run_step(int fd, uint64_t region_bytes, size_t read_size,
+        int sequential, unsigned int threads, uint64_t duration_ns,
+        struct step_result *res)
+{
+    struct cached_worker *workers = malloc(threads * sizeof(*workers));
+    struct latency_hist *all = malloc(sizeof(*all));
+    unsigned int i;
+
+    die_if(workers == NULL || all == NULL, "malloc");
+
+    for (i=0; i<threads; i++)
+    {
+        struct cached_worker *const w = &workers[i];
+
+        w->fd = fd;
+        w->region_bytes = region_bytes;
+        w->read_size = read_size;
+        w->sequential = sequential;
+        /* spread the sequential streams evenly over the region */
+        w->first_offset = region_bytes / read_size * i / threads * read_size;
+        w->duration_ns = duration_ns;
+        w->seed = random64();
+        latency_hist_init(&w->lat);
+        w->bytes = 0;
+        w->elapsed_ns = 0;
+    }
+
+    run_threads(cached_worker_main, workers, sizeof(*workers), threads);
+
+    res->threads = threads;
+    res->bytes = 0;
+    res->elapsed_ns = 0;
+    latency_hist_init(all);
+
+    for (i=0; i<threads; i++)
+    {
+        latency_hist_merge(all, &workers[i].lat);
+        res->bytes += workers[i].bytes;
+        res->elapsed_ns = max(res->elapsed_ns, workers[i].elapsed_ns);
+    }
+
+    get_hist_latency_stats(all, &res->stats);
+    free(all);
+    free(workers);
+}
+
+
+
+/*
+ * Print a sweep's results, with the scaling over a single thread.
+ */
+static void print_sweep(const char *title, const struct step_result *steps,
+        unsigned int num_steps)
+{
+    const double base = (double)steps[0].bytes
+                        / max(steps[0].elapsed_ns, (uint64_t)1);
+    unsigned int i, peak = 0;
+    char label[32];
+
+    printf("\n %s:\n\n", title);
+    print_stats_header("threads");
+
+    for (i=0; i<num_steps; i++)
+    {
+        const double speed = (double)steps[i].bytes
+                             / max(steps[i].elapsed_ns, (uint64_t)1);
+
+        snprintf(label, sizeof(label), "%u (%.1fx)", steps[i].threads,
+                 speed / max(base, 1e-9));
+        print_stats_row(label, &steps[i].stats, steps[i].bytes,
+                        steps[i].elapsed_ns);
+
+        if (speed > (double)steps[peak].bytes
+                    / max(steps[peak].elapsed_ns, (uint64_t)1))
+            peak = i;
+    }
+
+    printf(" Peak at %u threads, %.0f%% of linear scaling\n",
+           steps[peak].threads,
+           100.0 * ((double)steps[peak].bytes
+                    / max(steps[peak].elapsed_ns, (uint64_t)1))
+           / max(base * steps[peak].threads, 1e-9));
+}
+
+
+
+/*
+ * Measure the page cache read scalability of a block device's data, and
+ * print the results.
+ *
+ * The region is the first DEFAULT_REGION_BYTES of the device, or less if
+ * the device or the memory are small. The thread count doubles from 1 up
+ * to opts->jobs (the number of online CPUs if zero), and each step runs
+ * for opts->duration_ns. Random reads are opts->read_size bytes
+ * (DEFAULT_READ_BYTES if zero). Exits in case of error.
+ */
+void run_and_print_cached(const char *devname,
+        const struct bench_options *opts)
+{
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const unsigned int max_threads = opts->jobs != 0
+                                     ? opts->jobs
+                                     : (unsigned int)max(cpus, 1L);
+    const uint64_t mem = (uint64_t)sysconf(_SC_PHYS_PAGES)
+                         * sysconf(_SC_PAGESIZE);
+    struct step_result rand_res[MAX_STEPS], seq_res[MAX_STEPS];
+    unsigned int threads[MAX_STEPS];
+    unsigned int num_steps = 0, n, i;
+    struct blkdev_info info;
+    struct human_value region;
+    uint64_t region_bytes;
+    double resident;
+    size_t read_size;
+    char *duration;
+    int fd;
+
+    /* buffered, unlike open_blkdev */
+    fd = open(devname, O_RDONLY);
+    die_if(fd < 0, "open");
+    get_blkdev_info(fd, &info);
+    init_randomness();
+
+    read_size = opts->read_size != 0 ? opts->read_size : DEFAULT_READ_BYTES;
+    region_bytes = min(min((uint64_t)DEFAULT_REGION_BYTES, info.dev_size),
+                       mem / MAX_REGION_MEM_FRACTION);
+    region_bytes -= region_bytes % SEQ_READ_BYTES;
+
+    if (region_bytes < max((uint64_t)read_size, (uint64_t)SEQ_READ_BYTES))
+    {
+        fprintf(stderr, "error: device or memory too small for the test\n");
+        exit(1);
+    }
+
+    for (n=1; n < max_threads && num_steps < MAX_STEPS - 1; n *= 2)
+        threads[num_steps++] = n;
+    threads[num_steps++] = max_threads;
+
+    region = humanize_binary_size(region_bytes);
+    printf("Reading %.2Lf %s into the page cache, please wait...\n",
+           region.value, region.unit);
+    warm_region(fd, region_bytes);
+    resident = get_resident_fraction(fd, region_bytes);
+
+    duration = humanize_time(opts->duration_ns, 3);
+    for (i=0; i<num_steps; i++)
+    {
+        printf("Reading cached data with %u thread%s for %s, please wait...\n",
+               threads[i], threads[i] != 1 ? "s" : "", duration);
+        run_step(fd, region_bytes, read_size, 0, threads[i],
+                 opts->duration_ns, &rand_res[i]);
+        run_step(fd, region_bytes, SEQ_READ_BYTES, 1, threads[i],
+                 opts->duration_ns, &seq_res[i]);
+    }
+    free(duration);
+
+    /* reading may have pushed some of the region out */
+    resident = min(resident, get_resident_fraction(fd, region_bytes));
+    close(fd);
+
+    printf("\n%s, %.2Lf %s region, %.0f%% cached:\n",
+           devname, region.value, region.unit, resident * 100);
+
+    if (resident < MIN_RESIDENT_FRACTION)
+        printf(" warning: part of the region wasn't cached; results include device reads\n");
+
+    print_sweep("Random reads", rand_res, num_steps);
+    print_sweep("Sequential reads", seq_res, num_steps);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
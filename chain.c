@@ -0,0 +1,258 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* chain.c - dependent read chain (index lookup) workload
+ *
+ * Emulates index lookups, such as a B-tree descent: each lookup is a chain
+ * of reads, where the offset of each read is derived from the data
+ * returned by the previous one. Reads within a chain are thus serialized,
+ * and only independent chains can overlap.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "watchdog.h"
+#include "workload.h"
+#include "chain.h"
+
+
+/* Default number of concurrent chains. */
+#define DEFAULT_CHAINS 8
+
+/* Default number of dependent reads per lookup. */
+#define DEFAULT_CHAIN_DEPTH 4
+
+
+struct chain_worker {
+    /* parameters */
+    int fd;
+    const struct blkdev_info *info;
+    unsigned int depth;
+    uint64_t duration_ns;
+    uint64_t seed;
+
+    /* results */
+    struct sample_buf lookups;  /* whole chain latencies */
+    struct sample_buf reads;    /* individual read latencies */
+    uint64_t elapsed_ns;
+};
+
+
+
+/*
+ * Derive the offset of the next read in a chain from the data of the
+ * previous read, like following a child pointer in an index node.
+ *
+ * The data is mixed with key, drawn at the root of each lookup. On a
+ * device that holds no meaningful data (e.g. zeros), the data alone would
+ * send every lookup to the same offsets below the root, which the drive's
+ * cache would then serve; with the key, each lookup takes its own path.
+ */
+static uint64_t derive_offset(const struct chain_worker *w,
+        const char *data, uint64_t key, unsigned int level)
+{
+    uint64_t pointer;
+
+    memcpy(&pointer, data, sizeof(pointer));
+    pointer ^= key + level;
+
+    return (random64_r(&pointer) % w->info->num_blocks)
+           * w->info->block_size;
+}
+
+
+
+static void *chain_worker_main(void *arg)
+{
+    struct thread_arg *t = arg;
+    struct chain_worker *w = t->data;
+    const unsigned int block_size = w->info->block_size;
+    char *buffer;
+    uint64_t start_ns, now_ns;
+
+    buffer = allocate_aligned_memory(w->info->alignment, block_size);
+
+    pthread_barrier_wait(t->start);
+
+    start_ns = now_ns = get_cur_ns();
+
+    while (now_ns - start_ns < w->duration_ns && !watchdog_aborting())
+    {
+        /* the root of each lookup is random */
+        uint64_t offset = (random64_r(&w->seed) % w->info->num_blocks)
+                          * block_size;
+        const uint64_t key = random64_r(&w->seed);
+        const uint64_t lookup_start_ns = now_ns;
+        unsigned int level;
+
+        for (level=0; level < w->depth; level++)
+        {
+            const uint64_t t0 = get_cur_ns();
+
+            read_at(w->fd, buffer, block_size, offset);
+            now_ns = get_cur_ns();
+
+            sample_buf_add(&w->reads, now_ns - t0);
+
+            offset = derive_offset(w, buffer, key, level);
+        }
+
+        sample_buf_add(&w->lookups, now_ns - lookup_start_ns);
+    }
+
+    w->elapsed_ns = now_ns - start_ns;
+
+    free(buffer);
+
+    return NULL;
+}
+
+
+
+/*
+ * Run the dependent read chain workload on a block device, and print the
+ * results.
+ *
+ * Runs opts->jobs independent chains concurrently (DEFAULT_CHAINS if
+ * zero), each doing lookups of opts->chain_depth dependent reads, for
+ * opts->duration_ns. For comparison, then runs the same number of
+ * workers doing independent random reads. Exits in case of error.
+ */
+void run_and_print_chain(const char *devname,
+        const struct bench_options *opts)
+{
+    const unsigned int chains = opts->jobs != 0 ? opts->jobs : DEFAULT_CHAINS;
+    const unsigned int depth = opts->chain_depth != 0
+                               ? opts->chain_depth : DEFAULT_CHAIN_DEPTH;
+    struct chain_worker *workers = calloc(chains, sizeof(*workers));
+    struct rr_worker *indep = calloc(chains, sizeof(*indep));
+    struct sample_buf lookups, reads, indep_reads;
+    struct latency_stats lookup_stats, read_stats, indep_stats;
+    struct blkdev_info info;
+    uint64_t elapsed_ns = 0, indep_bytes = 0, indep_elapsed_ns = 0;
+    char *duration;
+    unsigned int i;
+    int fd;
+
+    die_if(workers == NULL || indep == NULL, "calloc");
+
+    fd = open_blkdev(devname);
+    get_blkdev_info(fd, &info);
+    init_randomness();
+
+    duration = humanize_time(opts->duration_ns, 3);
+    printf("Running %u concurrent lookups of %u dependent reads for %s, please wait...\n",
+           chains, depth, duration);
+
+    for (i=0; i<chains; i++)
+    {
+        workers[i].fd = fd;
+        workers[i].info = &info;
+        workers[i].depth = depth;
+        workers[i].duration_ns = opts->duration_ns;
+        workers[i].seed = random64();
+        sample_buf_init(&workers[i].lookups);
+        sample_buf_init(&workers[i].reads);
+    }
+
+    run_threads(chain_worker_main, workers, sizeof(workers[0]), chains);
+
+    printf("Running %u concurrent independent random readers for %s, please wait...\n",
+           chains, duration);
+
+    for (i=0; i<chains; i++)
+        init_rr_worker(&indep[i], fd, &info, info.block_size,
+                opts->duration_ns);
+
+    run_random_read_workers(indep, chains);
+
+    close(fd);
+
+    /* merge all workers' results */
+    sample_buf_init(&lookups);
+    sample_buf_init(&reads);
+    sample_buf_init(&indep_reads);
+    for (i=0; i<chains; i++)
+    {
+        sample_buf_append(&lookups, &workers[i].lookups);
+        sample_buf_append(&reads, &workers[i].reads);
+        sample_buf_append(&indep_reads, &indep[i].lat);
+        elapsed_ns = max(elapsed_ns, workers[i].elapsed_ns);
+        indep_bytes += indep[i].bytes;
+        indep_elapsed_ns = max(indep_elapsed_ns, indep[i].elapsed_ns);
+
+        sample_buf_free(&workers[i].lookups);
+        sample_buf_free(&workers[i].reads);
+        sample_buf_free(&indep[i].lat);
+    }
+
+    printf("\n"
+           "%s:\n"
+           " %u chains of %u dependent %u-byte reads, %s\n"
+           "\n",
+           devname, chains, depth, info.block_size, duration);
+
+    print_stats_header("workload");
+
+    get_latency_stats(&lookups, &lookup_stats);
+    print_stats_row("lookup", &lookup_stats,
+            (uint64_t)lookups.count * depth * info.block_size, elapsed_ns);
+
+    get_latency_stats(&reads, &read_stats);
+    print_stats_row("chained read", &read_stats,
+            (uint64_t)reads.count * info.block_size, elapsed_ns);
+
+    get_latency_stats(&indep_reads, &indep_stats);
+    print_stats_row("independent", &indep_stats, indep_bytes,
+            indep_elapsed_ns);
+
+    printf("\n"
+           " Lookups/second: %.3Lf\n"
+           " Mean lookup latency: %.2Lf times an independent read\n",
+           lookups.count / ((long double)max(elapsed_ns, (uint64_t)1) / NS_PER_SEC),
+           (long double)lookup_stats.mean / max(indep_stats.mean, (uint64_t)1));
+
+    free(duration);
+    sample_buf_free(&lookups);
+    sample_buf_free(&reads);
+    sample_buf_free(&indep_reads);
+    free(indep);
+    free(workers);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
@@ -40,8 +40,31 @@
 #include <libgen.h>
 #include <getopt.h>
 
+#include "actuator.h"
 #include "benchmarks.h"
+#include "cached.h"
+#include "chain.h"
+#include "clients.h"
+#include "clone.h"
+#include "hedge.h"
 #include "humanize.h"
+#include "inventory.h"
+#include "ioprio.h"
+#include "mq.h"
+#include "multipath.h"
+#include "options.h"
+#include "parallel.h"
+#include "periodic.h"
+#include "quick.h"
+#include "sizedist.h"
+#include "sizes.h"
+#include "slo.h"
+#include "sortread.h"
+#include "stack.h"
+#include "stripe.h"
+#include "verify.h"
+#include "vecread.h"
+#include "watchdog.h"
 
 
 #define PACKAGE_NAME "hdtime"
@@ -57,6 +80,73 @@
 /* Default value for cli_options.read_size, meaning autodetect. */
 #define DEFAULT_SEQ_READ_BYTES 0
 
+/* Default duration of each phase in timed modes, in seconds. */
+#define DEFAULT_DURATION_SECS 5
+
+/* Maximum duration of each phase in timed modes, in seconds. */
+#define MAX_DURATION_SECS (24 * 3600)
+
+/* Maximum number of concurrent workers. */
+#define MAX_JOBS 4096
+
+/* Maximum number of dependent reads per lookup, in chain mode. */
+#define MAX_CHAIN_DEPTH 64
+
+/* Maximum time series interval, in milliseconds. */
+#define MAX_INTERVAL_MS (3600 * 1000)
+
+/* Maximum queue depth. */
+#define MAX_QUEUE_DEPTH 4096
+
+/* Maximum number of offsets per batch, in sorted mode. */
+#define MAX_BATCH_SIZE (1024 * 1024)
+
+/* Maximum number of segments per vectored read (Linux's IOV_MAX). */
+#define MAX_SEGMENTS 1024
+
+/* Maximum number of parity chunks per stripe, in stripe mode. */
+#define MAX_PARITY 2
+
+/* Maximum number of clients, in clients mode. */
+#define MAX_CLIENTS (1024 * 1024)
+
+/* Default time after which a read is reported as hung, in seconds. */
+#define DEFAULT_IO_TIMEOUT_SECS 10
+
+/* Default latency percentile of an SLO, when none is given. */
+#define DEFAULT_SLO_PERCENTILE 99.0
+
+
+/* Values for long options with no short equivalent. */
+enum {
+    OPT_PRIORITIES = CHAR_MAX + 1,
+    OPT_DEPTH,
+    OPT_BATCH,
+    OPT_INTERVAL,
+    OPT_SEGMENTS,
+    OPT_SEGMENT_SIZE,
+    OPT_REQUEST_PRIO,
+    OPT_ALL_SCHEDULERS,
+    OPT_SLO,
+    OPT_IO_TIMEOUT,
+    OPT_ABORT_ON_HANG,
+    OPT_NO_CACHE,
+    OPT_RECALIBRATE,
+    OPT_INCLUDE_BUSY,
+    OPT_GROUP_BY,
+    OPT_BUDGET,
+    OPT_CHUNK_SIZE,
+    OPT_PARITY,
+    OPT_FAILED,
+    OPT_HEDGE_DELAY,
+    OPT_CLONE_FROM,
+    OPT_SLOW,
+    OPT_ALL_SELECTORS,
+    OPT_SIZE_DIST,
+    OPT_CLIENTS,
+    OPT_THINK,
+};
+
 
 /* Program's basename, for printing on error. */
 static const char *prog_name = NULL;
@@ -64,11 +154,71 @@ static const char *prog_name = NULL;
 
 struct cli_options {
     const char *devname;
-    unsigned int num_seeks;
-    size_t read_size;
+    const struct mode *mode;
+    struct bench_options bench;
+    uint64_t io_timeout_ns;     /* report hung reads; 0 = don't watch */
+    int io_timeout_given;       /* --io-timeout was given explicitly */
+    int abort_on_hang;          /* stop at the first hung read */
+};
+
+
+/* A benchmark mode, selected with --mode. */
+struct mode {
+    const char *name;
+    void (*run)(const char *devname, const struct bench_options *opts);
+    const char *desc;
+    bool all_devices;   /* works on every device; takes no device name */
 };
 
 
+static const struct mode modes[] = {
+    { "basic", run_and_print_benchmarks,
+      "sequential speed and random access time (default)", false },
+    { "ioprio", run_and_print_ioprio,
+      "random readers at different I/O priorities", false },
+    { "chain", run_and_print_chain,
+      "concurrent chains of dependent reads", false },
+    { "readv", run_and_print_vecread,
+      "vectored reads versus contiguous reads", false },
+    { "sorted", run_and_print_sortread,
+      "batches of random reads, sorted versus unsorted", false },
+    { "periodic", run_and_print_periodic,
+      "periodic latency stalls (use a long --time)", false },
+    { "slo", run_and_print_slo,
+      "highest IOPS within a latency SLO (needs --slo)", false },
+    { "parallel", run_and_print_parallel,
+      "internal parallelism of a flash device", false },
+    { "actuator", run_and_print_actuator,
+      "independent actuators or units by LBA range", false },
+    { "quick", run_and_print_quick,
+      "sequential and random triage within --budget", false },
+    { "stripe", run_and_print_stripe,
+      "simulated RAID-0/5/6 of the devices, by chunk size", false },
+    { "hedge", run_and_print_hedge,
+      "hedged reads across mirrors with the same data", false },
+    { "clone", run_and_print_clone,
+      "replay another device's reads (needs --clone-from)", false },
+    { "stack", run_and_print_stack,
+      "overhead of each layer of a stacked device", false },
+    { "mq", run_and_print_mq,
+      "blk-mq hardware queues and worker placement", false },
+    { "multipath", run_and_print_multipath,
+      "paths of a dm-multipath device and their balance", false },
+    { "cached", run_and_print_cached,
+      "page cache scalability with 1..N buffered readers", false },
+    { "verify", run_and_print_verify,
+      "re-read slow blocks to find persistently slow ones", false },
+    { "sizes", run_and_print_sizes,
+      "latency by request size, from a size distribution", false },
+    { "clients", run_and_print_clients,
+      "response time of 1..N clients that read and think", false },
+    { "inventory", run_and_print_inventory,
+      "quick probe of every disk, parallel by controller", true },
+};
+
+#define NUM_MODES (sizeof(modes)/sizeof(modes[0]))
+
+
 /*
  * Show command-line options with pretty formatting.
  *
@@ -81,6 +231,63 @@ static void show_options(void)
         { "", "(default: autodetect)" },
         { "-s, --read-size=SIZE", "size of read blocks in the sequential test" },
         { "", "(default: autodetect)" },
+        { "-m, --mode=MODE", "benchmark mode to run (default: basic)" },
+        { "-t, --time=SECONDS", "duration of each phase in timed modes" },
+        { "", "(default: 5)" },
+        { "-j, --jobs=N", "run N concurrent workers in multi-worker modes" },
+        { "", "(default: depends on the mode)" },
+        { "-q, --queue-depth=N", "keep N reads in flight in asynchronous modes" },
+        { "", "(default: depends on the mode)" },
+        { "--batch=N", "read batches of N offsets in sorted mode" },
+        { "", "(default: 64)" },
+        { "--interval=MS", "time series interval in periodic mode" },
+        { "", "(default: 100), or sampling interval in clone" },
+        { "", "mode (default: 1000)" },
+        { "--slo=[pNN:]TIME", "latency target in slo mode, e.g. p99:2ms" },
+        { "", "(default percentile: p99)" },
+        { "--depth=D", "do D dependent reads per lookup in chain mode" },
+        { "", "(default: 4)" },
+        { "--segments=N", "scatter each read into N buffers in readv mode" },
+        { "", "(default: 64)" },
+        { "--segment-size=SIZE", "size of each buffer in readv mode" },
+        { "", "(default: 4 KiB)" },
+        { "--priorities=LIST", "I/O priorities to compete in ioprio mode" },
+        { "", "(default: rt:4,be:0,...,be:7,idle)" },
+        { "--request-prio", "set priorities per request (AIO) in ioprio" },
+        { "", "mode, instead of per thread" },
+        { "--all-schedulers", "repeat ioprio mode under every I/O scheduler" },
+        { "--chunk-size=SIZE", "RAID-0 chunk size in stripe mode" },
+        { "", "(default: sweep 4 KiB to 1 MiB)" },
+        { "--parity=N", "parity chunks per stripe in stripe mode: 0, 1" },
+        { "", "or 2, for RAID-0, 5 or 6 (default: 0)" },
+        { "--failed=N", "also run degraded, with the first N devices" },
+        { "", "failed, in stripe mode (default: 0)" },
+        { "--hedge-delay=TIME", "hedge reads after TIME in hedge mode" },
+        { "", "(default: try p50, p90, p95 and p99)" },
+        { "--clone-from=DEV", "device whose workload to sample and replay" },
+        { "", "in clone mode; may be in use" },
+        { "--all-selectors", "repeat multipath mode under every path selector" },
+        { "--slow=TIME", "re-read blocks slower than TIME in verify mode" },
+        { "", "(default: 4 times the p99 of random reads)" },
+        { "--size-dist=SPEC", "request sizes in sizes mode: lognormal:MEDIAN," },
+        { "", "SIGMA, bimodal:SMALL,LARGE,P or file:PATH" },
+        { "", "(default: bimodal:4K,1M,0.1)" },
+        { "--clients=N", "grow the population up to N clients in clients" },
+        { "", "mode (default: 4096)" },
+        { "--think=TIME", "mean think time of each client in clients mode" },
+        { "", "(default: 10ms)" },
+        { "--budget=TIME", "total time of quick mode (default: 4s)" },
+        { "--include-busy", "also probe disks in use, in inventory mode" },
+        { "--group-by=GROUP", "group disks by controller or root (PCI root" },
+        { "", "complex) in inventory mode (default: controller)" },
+        { "--no-cache", "don't load or save the device's calibration" },
+        { "", "profile" },
+        { "--recalibrate", "autodetect the calibration again, and replace" },
+        { "", "the device's profile" },
+        { "--io-timeout=TIME", "report reads pending for longer than TIME" },
+        { "", "(default: 10s; 0 disables)" },
+        { "--abort-on-hang", "at the first hung read, stop the test and print" },
+        { "", "the results so far" },
         { "-h, --help", "display this help and exit" },
         { "-v, --version", "output version information and exit" },
     };
@@ -93,6 +300,21 @@ static void show_options(void)
 }
 
 
+/*
+ * Show the available benchmark modes.
+ *
+ * To be used from within show_usage.
+ */
+static void show_modes(void)
+{
+    unsigned int i;
+    for (i=0; i < NUM_MODES; i++)
+    {
+        printf("  %-28s%s\n", modes[i].name, modes[i].desc);
+    }
+}
+
+
 /*
  * Show usage information.
  */
@@ -111,12 +333,27 @@ static void show_usage(void)
            COPYRIGHT);
     printf(" Usage:\n"
            "  %s [OPTIONS] <device>\n"
+           "  %s [OPTIONS] --mode=stripe|hedge <device>...\n"
+           "  %s [OPTIONS] --mode=inventory\n"
            "\n"
            "\n"
            "OPTIONS:\n",
-           prog_name);
+           prog_name, prog_name, prog_name);
     show_options();
     printf("\n"
+           "MODES:\n");
+    show_modes();
+    printf("\n"
+           "A priority LIST is a comma-separated list of CLASS[:LEVEL], where CLASS\n"
+           "is rt, be or idle, and LEVEL is 0 (highest) to 7 (lowest).\n"
+           "\n"
+           "Autodetected read sizes and read counts are saved per device, in\n"
+           "$XDG_CACHE_HOME/hdtime/profiles (or ~/.cache/hdtime/profiles), and\n"
+           "reused on later runs.\n"
+           "\n"
+           "The TIME value can be suffixed with an optional unit: ns, us, ms or s\n"
+           "(the default).\n"
+           "\n"
            "The SIZE value can be suffixed with an optional unit: KiB, MiB, GiB\n"
            "TiB, PiB, EiB, ZiB, YiB (powers of 1024), or KB, MB, GB, TB, PB, EB,\n"
            "ZB, YB (powers of 1000). K, M, G, T, P, E, Z, Y are also accepted, as\n"
@@ -193,6 +430,87 @@ static uintmax_t get_uint_arg(const char *arg, uintmax_t min,
 
 
 
+/*
+ * Parse a latency SLO of the form [pNN:]TIME, e.g. "p99.9:2ms".
+ *
+ * Stores the percentile and latency target in opts. The percentile
+ * defaults to DEFAULT_SLO_PERCENTILE. If the argument is invalid, prints
+ * an error and exits the program.
+ */
+static void parse_slo(const char *arg, struct bench_options *opts)
+{
+    const char *time_arg = arg;
+    double pct = DEFAULT_SLO_PERCENTILE;
+
+    if (arg[0] == 'p')
+    {
+        char *end;
+
+        errno = 0;
+        pct = strtod(arg + 1, &end);
+
+        if (end == arg + 1 || *end != ':' || errno != 0
+            || !(pct > 0 && pct < 100))
+            goto invalid;
+
+        time_arg = end + 1;
+    }
+
+    if (parse_human_time(time_arg, &opts->slo_latency_ns) != 0
+        || opts->slo_latency_ns == 0)
+        goto invalid;
+
+    opts->slo_percentile = pct;
+    return;
+
+invalid:
+    fprintf(stderr, "%s: invalid SLO '%s' (e.g. p99:2ms)\n", prog_name, arg);
+    print_help_string();
+    exit(1);
+}
+
+
+
+/*
+ * Check that a request size distribution can be parsed, so that errors
+ * show up before any benchmark runs. If it can't, prints an error and
+ * exits the program.
+ */
+static void check_size_dist(const char *arg)
+{
+    struct size_dist dist;
+
+    if (parse_size_dist(arg, &dist) != 0)
+    {
+        fprintf(stderr, "%s: invalid size distribution '%s' (e.g. lognormal:16K,1.0)\n",
+                prog_name, arg);
+        print_help_string();
+        exit(1);
+    }
+
+    free_size_dist(&dist);
+}
+
+
+
+/*
+ * Find a benchmark mode by name. Returns NULL if there is no such mode.
+ */
+static const struct mode *find_mode(const char *name)
+{
+    unsigned int i;
+
+    for (i=0; i < NUM_MODES; i++)
+    {
+        if (strcmp(modes[i].name, name) == 0)
+            return &modes[i];
+    }
+
+    return NULL;
+}
+
+
+
 /*
  * Process command-line arguments.
  *
@@ -207,18 +525,54 @@ static void parse_args(int argc, char *const argv[],
     static const struct option long_opts[] = {
         {"read-count", 1, 0, 'c'},
         {"read-size", 1, 0, 's'},
+        {"mode", 1, 0, 'm'},
+        {"time", 1, 0, 't'},
+        {"jobs", 1, 0, 'j'},
+        {"queue-depth", 1, 0, 'q'},
+        {"batch", 1, 0, OPT_BATCH},
+        {"interval", 1, 0, OPT_INTERVAL},
+        {"slo", 1, 0, OPT_SLO},
+        {"depth", 1, 0, OPT_DEPTH},
+        {"segments", 1, 0, OPT_SEGMENTS},
+        {"segment-size", 1, 0, OPT_SEGMENT_SIZE},
+        {"priorities", 1, 0, OPT_PRIORITIES},
+        {"request-prio", 0, 0, OPT_REQUEST_PRIO},
+        {"all-schedulers", 0, 0, OPT_ALL_SCHEDULERS},
+        {"chunk-size", 1, 0, OPT_CHUNK_SIZE},
+        {"parity", 1, 0, OPT_PARITY},
+        {"failed", 1, 0, OPT_FAILED},
+        {"hedge-delay", 1, 0, OPT_HEDGE_DELAY},
+        {"clone-from", 1, 0, OPT_CLONE_FROM},
+        {"slow", 1, 0, OPT_SLOW},
+        {"all-selectors", 0, 0, OPT_ALL_SELECTORS},
+        {"size-dist", 1, 0, OPT_SIZE_DIST},
+        {"clients", 1, 0, OPT_CLIENTS},
+        {"think", 1, 0, OPT_THINK},
+        {"budget", 1, 0, OPT_BUDGET},
+        {"include-busy", 0, 0, OPT_INCLUDE_BUSY},
+        {"group-by", 1, 0, OPT_GROUP_BY},
+        {"no-cache", 0, 0, OPT_NO_CACHE},
+        {"recalibrate", 0, 0, OPT_RECALIBRATE},
+        {"io-timeout", 1, 0, OPT_IO_TIMEOUT},
+        {"abort-on-hang", 0, 0, OPT_ABORT_ON_HANG},
         {"help", 0, 0, 'h'},
         {"version", 0, 0, 'v'},
         {0, 0, 0, 0}
     };
 
     /* initialize defaults */
-    p_cli_options->num_seeks = DEFAULT_NUM_SEEKS;
-    p_cli_options->read_size = DEFAULT_SEQ_READ_BYTES;
+    memset(&p_cli_options->bench, 0, sizeof(p_cli_options->bench));
+    p_cli_options->mode = &modes[0];
+    p_cli_options->bench.num_seeks = DEFAULT_NUM_SEEKS;
+    p_cli_options->bench.read_size = DEFAULT_SEQ_READ_BYTES;
+    p_cli_options->bench.duration_ns = DEFAULT_DURATION_SECS * 1000000000ULL;
+    p_cli_options->io_timeout_ns = DEFAULT_IO_TIMEOUT_SECS * 1000000000ULL;
+    p_cli_options->io_timeout_given = 0;
+    p_cli_options->abort_on_hang = 0;
 
     for (;;)
     {
-        int arg = getopt_long(argc, argv, "c:s:hv", long_opts, NULL);
+        int arg = getopt_long(argc, argv, "c:s:m:t:j:q:hv", long_opts, NULL);
         int status;
 
         if (arg == -1)
@@ -227,13 +581,13 @@ static void parse_args(int argc, char *const argv[],
         switch (arg)
         {
             case 'c':   /* --read-count <n> */
-                p_cli_options->num_seeks = (unsigned int)get_uint_arg(optarg,
+                p_cli_options->bench.num_seeks = (unsigned int)get_uint_arg(optarg,
                         1, UINT_MAX, "read count", print_help_string);
                 break;
             case 's':   /* --read-size <size> */
-                status = parse_human_size(optarg, &p_cli_options->read_size);
+                status = parse_human_size(optarg, &p_cli_options->bench.read_size);
 
-                if (status != 0 || p_cli_options->read_size == 0)
+                if (status != 0 || p_cli_options->bench.read_size == 0)
                 {   /* error, or invalid size 0 specified */
                     fprintf(stderr,
                             "%s: invalid read block size given (1..%" PRIuMAX " bytes)\n",
@@ -242,6 +596,188 @@ static void parse_args(int argc, char *const argv[],
                     exit(1);
                 }
                 break;
+            case 'm':   /* --mode <mode> */
+                p_cli_options->mode = find_mode(optarg);
+                if (p_cli_options->mode == NULL)
+                {
+                    fprintf(stderr, "%s: invalid mode '%s'\n", prog_name, optarg);
+                    print_help_string();
+                    exit(1);
+                }
+                break;
+            case 't':   /* --time <seconds> */
+                p_cli_options->bench.duration_ns = get_uint_arg(optarg,
+                        1, MAX_DURATION_SECS, "time", print_help_string)
+                        * 1000000000ULL;
+                break;
+            case 'j':   /* --jobs <n> */
+                p_cli_options->bench.jobs = (unsigned int)get_uint_arg(optarg,
+                        1, MAX_JOBS, "job count", print_help_string);
+                break;
+            case 'q':   /* --queue-depth <n> */
+                p_cli_options->bench.queue_depth = (unsigned int)get_uint_arg(
+                        optarg, 1, MAX_QUEUE_DEPTH, "queue depth",
+                        print_help_string);
+                break;
+            case OPT_BATCH:     /* --batch <n> */
+                p_cli_options->bench.batch_size = (unsigned int)get_uint_arg(
+                        optarg, 1, MAX_BATCH_SIZE, "batch size",
+                        print_help_string);
+                break;
+            case OPT_INTERVAL:  /* --interval <ms> */
+                p_cli_options->bench.interval_ns = get_uint_arg(optarg,
+                        1, MAX_INTERVAL_MS, "interval", print_help_string)
+                        * 1000000ULL;
+                break;
+            case OPT_SLO:       /* --slo <[pNN:]time> */
+                parse_slo(optarg, &p_cli_options->bench);
+                break;
+            case OPT_DEPTH:     /* --depth <d> */
+                p_cli_options->bench.chain_depth = (unsigned int)get_uint_arg(
+                        optarg, 1, MAX_CHAIN_DEPTH, "chain depth",
+                        print_help_string);
+                break;
+            case OPT_SEGMENTS:  /* --segments <n> */
+                p_cli_options->bench.segments = (unsigned int)get_uint_arg(
+                        optarg, 1, MAX_SEGMENTS, "segment count",
+                        print_help_string);
+                break;
+            case OPT_SEGMENT_SIZE:  /* --segment-size <size> */
+                status = parse_human_size(optarg,
+                        &p_cli_options->bench.segment_size);
+
+                if (status != 0 || p_cli_options->bench.segment_size == 0)
+                {   /* error, or invalid size 0 specified */
+                    fprintf(stderr,
+                            "%s: invalid segment size given (1..%" PRIuMAX " bytes)\n",
+                            prog_name, SIZE_MAX);
+                    print_help_string();
+                    exit(1);
+                }
+                break;
+            case OPT_PRIORITIES:    /* --priorities <list> */
+                p_cli_options->bench.ioprio_list = optarg;
+                break;
+            case OPT_REQUEST_PRIO:  /* --request-prio */
+                p_cli_options->bench.request_prio = 1;
+                break;
+            case OPT_ALL_SCHEDULERS:    /* --all-schedulers */
+                p_cli_options->bench.all_schedulers = 1;
+                break;
+            case OPT_CHUNK_SIZE:    /* --chunk-size <size> */
+                status = parse_human_size(optarg,
+                        &p_cli_options->bench.chunk_size);
+
+                if (status != 0 || p_cli_options->bench.chunk_size == 0)
+                {   /* error, or invalid size 0 specified */
+                    fprintf(stderr,
+                            "%s: invalid chunk size given (1..%" PRIuMAX " bytes)\n",
+                            prog_name, SIZE_MAX);
+                    print_help_string();
+                    exit(1);
+                }
+                break;
+            case OPT_PARITY:        /* --parity <n> */
+                p_cli_options->bench.parity = (unsigned int)get_uint_arg(
+                        optarg, 0, MAX_PARITY, "parity chunk count",
+                        print_help_string);
+                break;
+            case OPT_FAILED:        /* --failed <n> */
+                p_cli_options->bench.failed = (unsigned int)get_uint_arg(
+                        optarg, 0, MAX_PARITY, "failed device count",
+                        print_help_string);
+                break;
+            case OPT_HEDGE_DELAY:   /* --hedge-delay <time> */
+                if (parse_human_time(optarg,
+                            &p_cli_options->bench.hedge_delay_ns) != 0
+                    || p_cli_options->bench.hedge_delay_ns == 0)
+                {
+                    fprintf(stderr, "%s: invalid hedge delay '%s'\n",
+                            prog_name, optarg);
+                    print_help_string();
+                    exit(1);
+                }
+                break;
+            case OPT_CLONE_FROM:    /* --clone-from <dev> */
+                p_cli_options->bench.clone_from = optarg;
+                break;
+            case OPT_ALL_SELECTORS: /* --all-selectors */
+                p_cli_options->bench.all_selectors = 1;
+                break;
+            case OPT_SLOW:          /* --slow <time> */
+                if (parse_human_time(optarg, &p_cli_options->bench.slow_ns) != 0
+                    || p_cli_options->bench.slow_ns == 0)
+                {
+                    fprintf(stderr, "%s: invalid slow threshold '%s'\n",
+                            prog_name, optarg);
+                    print_help_string();
+                    exit(1);
+                }
+                break;
+            case OPT_SIZE_DIST:     /* --size-dist <spec> */
+                check_size_dist(optarg);
+                p_cli_options->bench.size_dist = optarg;
+                break;
+            case OPT_CLIENTS:       /* --clients <n> */
+                p_cli_options->bench.clients = (unsigned int)get_uint_arg(
+                        optarg, 1, MAX_CLIENTS, "client count",
+                        print_help_string);
+                break;
+            case OPT_THINK:         /* --think <time> */
+                if (parse_human_time(optarg, &p_cli_options->bench.think_ns) != 0
+                    || p_cli_options->bench.think_ns == 0)
+                {
+                    fprintf(stderr, "%s: invalid think time '%s'\n",
+                            prog_name, optarg);
+                    print_help_string();
+                    exit(1);
+                }
+                break;
+            case OPT_BUDGET:        /* --budget <time> */
+                if (parse_human_time(optarg, &p_cli_options->bench.budget_ns) != 0
+                    || p_cli_options->bench.budget_ns == 0)
+                {
+                    fprintf(stderr, "%s: invalid time budget '%s'\n",
+                            prog_name, optarg);
+                    print_help_string();
+                    exit(1);
+                }
+                break;
+            case OPT_INCLUDE_BUSY:  /* --include-busy */
+                p_cli_options->bench.include_busy = 1;
+                break;
+            case OPT_GROUP_BY:      /* --group-by <controller|root> */
+                if (strcmp(optarg, "controller") == 0)
+                    p_cli_options->bench.group_by_root = 0;
+                else if (strcmp(optarg, "root") == 0)
+                    p_cli_options->bench.group_by_root = 1;
+                else
+                {
+                    fprintf(stderr, "%s: invalid grouping '%s'\n",
+                            prog_name, optarg);
+                    print_help_string();
+                    exit(1);
+                }
+                break;
+            case OPT_NO_CACHE:      /* --no-cache */
+                p_cli_options->bench.no_profile_cache = 1;
+                break;
+            case OPT_RECALIBRATE:   /* --recalibrate */
+                p_cli_options->bench.recalibrate = 1;
+                break;
+            case OPT_IO_TIMEOUT:    /* --io-timeout <time> */
+                if (parse_human_time(optarg, &p_cli_options->io_timeout_ns) != 0)
+                {
+                    fprintf(stderr, "%s: invalid I/O timeout '%s'\n",
+                            prog_name, optarg);
+                    print_help_string();
+                    exit(1);
+                }
+                p_cli_options->io_timeout_given = 1;
+                break;
+            case OPT_ABORT_ON_HANG: /* --abort-on-hang */
+                p_cli_options->abort_on_hang = 1;
+                break;
             case 'h':   /* --help */
                 show_usage();
                 exit(0);
@@ -254,6 +790,22 @@ static void parse_args(int argc, char *const argv[],
         }
     }
 
+    if (p_cli_options->mode->all_devices)
+    {
+        if (optind < argc)
+        {
+            fprintf(stderr, "%s: mode %s takes no device name\n", prog_name,
+                    p_cli_options->mode->name);
+            print_help_string();
+            exit(2);
+        }
+
+        p_cli_options->devname = NULL;
+        p_cli_options->bench.devnames = NULL;
+        p_cli_options->bench.num_devnames = 0;
+        return;
+    }
+
     if (optind >= argc)
     {
         fprintf(stderr, "%s: missing device name\n", prog_name);
@@ -262,6 +814,8 @@ static void parse_args(int argc, char *const argv[],
     }
 
     p_cli_options->devname = argv[optind];
+    p_cli_options->bench.devnames = argv + optind;
+    p_cli_options->bench.num_devnames = argc - optind;
 }
 
 
@@ -273,10 +827,15 @@ int main(int argc, char *argv[])
 
     parse_args(argc, argv, &cli_options);
 
-    run_and_print_benchmarks(cli_options.devname, cli_options.num_seeks,
-            cli_options.read_size);
+    if (cli_options.io_timeout_ns != 0)
+        watchdog_start(cli_options.io_timeout_ns, cli_options.abort_on_hang);
+
+    cli_options.mode->run(cli_options.devname, &cli_options.bench);
+
+    watchdog_stop();
+    watchdog_print_report(cli_options.io_timeout_given);
 
-    exit(0);
+    exit(watchdog_aborting() ? EXIT_HUNG : 0);
 }
 
 /* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
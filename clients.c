@@ -0,0 +1,475 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* clients.c - response time of a closed population of clients
+ *
+ * Interactive services don't keep a fixed number of requests in flight:
+ * each user issues a request, waits for the response, thinks for a while
+ * and then issues the next one. This mode models that as a population of
+ * clients with exponentially distributed think times. The clients don't
+ * get a thread each; a few event loops multiplex thousands of them over
+ * native AIO, keeping the thinking ones in a heap ordered by wake time.
+ * The population grows step by step, to show how response time and
+ * throughput follow the number of clients, and where the device
+ * saturates.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "asyncio.h"
+#include "clients.h"
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "watchdog.h"
+#include "workload.h"
+
+
+/* Default size of the reads. */
+#define DEFAULT_READ_BYTES 4096
+
+/* Default largest population. */
+#define DEFAULT_MAX_CLIENTS 4096
+
+/* Default mean think time. */
+#define DEFAULT_THINK_NS (10 * 1000 * 1000ULL)
+
+/* Default number of event loops (threads). */
+#define DEFAULT_LOOPS 2
+
+/* Most reads in flight per event loop; clients beyond this wait for a
+ * slot, and the wait counts as lag. */
+#define MAX_LOOP_INFLIGHT 4096
+
+/* The population grows by this factor at each step. */
+#define POPULATION_FACTOR 4
+
+/* Most steps in the sweep. */
+#define MAX_STEPS 16
+
+/* Warn if clients wait this fraction of their think time for the event
+ * loop to submit their reads: the loops aren't keeping up, and the load
+ * is lighter than asked for. */
+#define MAX_LAG_FRACTION 0.1
+
+
+struct client_slot {
+    struct iocb cb;
+    char *buffer;
+    uint64_t submit_ns;
+};
+
+/* Wake times of the thinking clients, as a binary min-heap. */
+struct wake_heap {
+    uint64_t *wake_ns;
+    unsigned int count;
+};
+
+struct client_loop {
+    /* parameters */
+    int fd;
+    const struct blkdev_info *info;
+    size_t read_size;
+    unsigned int num_clients;
+    uint64_t think_ns;          /* mean */
+    uint64_t duration_ns;
+    uint64_t seed;
+
+    /* results */
+    struct sample_buf lat;      /* from submission to completion */
+    uint64_t lag_ns;            /* total, from wake-up to submission */
+    uint64_t bytes;
+    uint64_t elapsed_ns;
+};
+
+struct step_result {
+    unsigned int clients;
+    struct latency_stats stats;
+    uint64_t bytes;
+    uint64_t elapsed_ns;
+    double iops;
+    uint64_t mean_lag_ns;       /* from wake-up to submission */
+};
+
+
+
+static void heap_push(struct wake_heap *h, uint64_t wake_ns)
+{
+    unsigned int i = h->count++;
+
+    while (i > 0 && h->wake_ns[(i - 1) / 2] > wake_ns)
+    {
+        h->wake_ns[i] = h->wake_ns[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    h->wake_ns[i] = wake_ns;
+}
+
+
+
+static uint64_t heap_pop(struct wake_heap *h)
+{
+    const uint64_t top = h->wake_ns[0];
+    const uint64_t last = h->wake_ns[--h->count];
+    unsigned int i = 0;
+
+    for (;;)
+    {
+        unsigned int child = 2 * i + 1;
+
+        if (child >= h->count)
+            break;
+        if (child + 1 < h->count && h->wake_ns[child + 1] < h->wake_ns[child])
+            child++;
+        if (last <= h->wake_ns[child])
+            break;
+
+        h->wake_ns[i] = h->wake_ns[child];
+        i = child;
+    }
+    h->wake_ns[i] = last;
+
+    return top;
+}
+
+
+
+/*
+ * Get a think time, exponentially distributed with the specified mean.
+ */
+static uint64_t think_time_ns(uint64_t mean_ns, uint64_t *seed)
+{
+    /* uniform in (0, 1], so log() is finite */
+    const double u = ((random64_r(seed) >> 11) + 1) * (1.0 / 9007199254740992.0);
+
+    return (uint64_t)(-log(u) * mean_ns);
+}
+
+
+
+/*
+ * Run an event loop's clients for duration_ns, then wait for the reads
+ * still in flight.
+ */
+static void *client_loop_main(void *arg)
+{
+    struct thread_arg *t = arg;
+    struct client_loop *l = t->data;
+    const uint64_t read_blocks = l->read_size / l->info->block_size;
+    const uint64_t choices = l->info->num_blocks - read_blocks + 1;
+    const unsigned int depth = min(l->num_clients,
+                                   (unsigned int)MAX_LOOP_INFLIGHT);
+    struct client_slot *slots = malloc(depth * sizeof(*slots));
+    unsigned int *free_slots = malloc(depth * sizeof(*free_slots));
+    struct iocb **to_submit = malloc(depth * sizeof(*to_submit));
+    struct io_event *events = malloc(depth * sizeof(*events));
+    unsigned int num_free = depth;
+    struct wake_heap thinking;
+    struct async_ctx actx;
+    uint64_t start_ns, now_ns;
+    unsigned int i;
+
+    thinking.wake_ns = malloc(l->num_clients * sizeof(*thinking.wake_ns));
+    thinking.count = 0;
+
+    die_if(slots == NULL || free_slots == NULL || to_submit == NULL
+           || events == NULL || thinking.wake_ns == NULL, "malloc");
+    assert(depth > 0);
+
+    for (i=0; i<depth; i++)
+    {
+        slots[i].buffer = allocate_aligned_memory(l->info->alignment,
+                l->read_size);
+        free_slots[i] = i;
+    }
+
+    async_init(&actx, depth);
+
+    pthread_barrier_wait(t->start);
+
+    start_ns = now_ns = get_cur_ns();
+
+    /* every client starts out thinking, so they don't all read at once */
+    for (i=0; i<l->num_clients; i++)
+        heap_push(&thinking, start_ns + think_time_ns(l->think_ns, &l->seed));
+
+    for (;;)
+    {
+        const int issuing = now_ns - start_ns < l->duration_ns
+                            && !watchdog_aborting();
+        struct timespec timeout;
+        int submit = 0;
+        int got;
+
+        /* wake every client whose think time is over, while there are
+         * slots; the others wait in the heap */
+        while (issuing && num_free > 0 && thinking.count > 0
+               && thinking.wake_ns[0] <= now_ns)
+        {
+            struct client_slot *slot = &slots[free_slots[--num_free]];
+            const uint64_t offset = (random64_r(&l->seed) % choices)
+                                    * l->info->block_size;
+
+            l->lag_ns += now_ns - heap_pop(&thinking);
+            slot->submit_ns = now_ns;
+            async_prep_read(&slot->cb, l->fd, slot->buffer, l->read_size,
+                    offset, slot);
+            to_submit[submit++] = &slot->cb;
+        }
+
+        if (submit > 0)
+            async_submit(&actx, to_submit, submit);
+
+        if (!issuing && num_free == depth)
+            break;
+
+        /* wait for completions, but no later than the next wake-up or
+         * the end of the run */
+        if (issuing && num_free > 0)
+        {
+            const uint64_t end_ns = start_ns + l->duration_ns;
+            const uint64_t until_ns = thinking.count > 0
+                                      ? min(thinking.wake_ns[0], end_ns)
+                                      : end_ns;
+            const uint64_t wait_ns = until_ns > now_ns ? until_ns - now_ns : 0;
+
+            timeout.tv_sec = wait_ns / NS_PER_SEC;
+            timeout.tv_nsec = wait_ns % NS_PER_SEC;
+            got = async_reap(&actx, events, 1, depth, &timeout);
+        }
+        else if (num_free < depth)
+            got = async_reap(&actx, events, 1, depth, NULL);
+        else
+            got = 0;
+
+        now_ns = get_cur_ns();
+
+        for (i=0; i<(unsigned int)got; i++)
+        {
+            struct client_slot *slot =
+                (struct client_slot *)(uintptr_t)events[i].data;
+
+            die_if_with_errno(events[i].res < 0, "read", (int)-events[i].res);
+
+            sample_buf_add(&l->lat, now_ns - slot->submit_ns);
+            l->bytes += l->read_size;
+            free_slots[num_free++] = slot - slots;
+
+            heap_push(&thinking, now_ns + think_time_ns(l->think_ns, &l->seed));
+        }
+    }
+
+    l->elapsed_ns = now_ns - start_ns;
+
+    async_destroy(&actx);
+
+    for (i=0; i<depth; i++)
+        free(slots[i].buffer);
+
+    free(thinking.wake_ns);
+    free(events);
+    free(to_submit);
+    free(free_slots);
+    free(slots);
+
+    return NULL;
+}
+
+
+
+/*
+ * Run a population of clients, spread over up to num_loops event loops,
+ * for duration_ns. Stores the combined results in res.
+ */
+static void run_population(int fd, const struct blkdev_info *info,
+        size_t read_size, unsigned int clients, unsigned int num_loops,
+        uint64_t think_ns, uint64_t duration_ns, struct step_result *res)
+{
+    struct client_loop *loops;
+    struct sample_buf all;
+    uint64_t lag_ns = 0;
+    unsigned int i;
+
+    num_loops = min(num_loops, clients);
+    loops = malloc(num_loops * sizeof(*loops));
+    die_if(loops == NULL, "malloc");
+
+    for (i=0; i<num_loops; i++)
+    {
+        struct client_loop *const l = &loops[i];
+
+        l->fd = fd;
+        l->info = info;
+        l->read_size = read_size;
+        /* spread the remainder over the first loops */
+        l->num_clients = clients / num_loops + (i < clients % num_loops);
+        l->think_ns = think_ns;
+        l->duration_ns = duration_ns;
+        l->seed = random64();
+        sample_buf_init(&l->lat);
+        l->lag_ns = 0;
+        l->bytes = 0;
+        l->elapsed_ns = 0;
+    }
+
+    run_threads(client_loop_main, loops, sizeof(*loops), num_loops);
+
+    res->clients = clients;
+    res->bytes = 0;
+    res->elapsed_ns = 0;
+    sample_buf_init(&all);
+
+    for (i=0; i<num_loops; i++)
+    {
+        sample_buf_append(&all, &loops[i].lat);
+        res->bytes += loops[i].bytes;
+        lag_ns += loops[i].lag_ns;
+        res->elapsed_ns = max(res->elapsed_ns, loops[i].elapsed_ns);
+        sample_buf_free(&loops[i].lat);
+    }
+
+    get_latency_stats(&all, &res->stats);
+    res->iops = all.count / ((double)max(res->elapsed_ns, (uint64_t)1)
+                             / NS_PER_SEC);
+    res->mean_lag_ns = lag_ns / max(all.count, (size_t)1);
+
+    sample_buf_free(&all);
+    free(loops);
+}
+
+
+
+/*
+ * Measure the response time of a growing population of clients that
+ * read from a block device and think in between, and print the results.
+ *
+ * The population grows by POPULATION_FACTOR from 1 up to opts->clients
+ * (DEFAULT_MAX_CLIENTS if zero), and each step runs for
+ * opts->duration_ns. Think times average opts->think_ns (DEFAULT_THINK_NS
+ * if zero). Reads are opts->read_size bytes (DEFAULT_READ_BYTES if zero),
+ * on opts->jobs event loops (DEFAULT_LOOPS if zero). Exits in case of
+ * error.
+ */
+void run_and_print_clients(const char *devname,
+        const struct bench_options *opts)
+{
+    const unsigned int max_clients = opts->clients != 0
+                                     ? opts->clients : DEFAULT_MAX_CLIENTS;
+    const unsigned int num_loops = opts->jobs != 0 ? opts->jobs : DEFAULT_LOOPS;
+    const uint64_t think_ns = opts->think_ns != 0
+                              ? opts->think_ns : DEFAULT_THINK_NS;
+    struct step_result steps[MAX_STEPS];
+    unsigned int populations[MAX_STEPS];
+    unsigned int num_steps = 0, n, i, peak = 0;
+    struct blkdev_info info;
+    size_t read_size;
+    char *duration, *think, *base_mean;
+    char label[32];
+    int fd;
+
+    fd = open_blkdev(devname);
+    get_blkdev_info(fd, &info);
+    init_randomness();
+
+    read_size = align_ceil(opts->read_size != 0
+                           ? opts->read_size : DEFAULT_READ_BYTES,
+                           info.block_size);
+    if (read_size > info.dev_size)
+    {
+        fprintf(stderr, "error: device too small for %zu-byte reads\n",
+                read_size);
+        exit(1);
+    }
+
+    for (n=1; n < max_clients && num_steps < MAX_STEPS - 1;
+         n *= POPULATION_FACTOR)
+        populations[num_steps++] = n;
+    populations[num_steps++] = max_clients;
+
+    duration = humanize_time(opts->duration_ns, 3);
+    think = humanize_time(think_ns, 3);
+
+    for (i=0; i<num_steps; i++)
+    {
+        printf("Running %u client%s, thinking %s on average, for %s, please wait...\n",
+               populations[i], populations[i] != 1 ? "s" : "", think,
+               duration);
+        run_population(fd, &info, read_size, populations[i], num_loops,
+                       think_ns, opts->duration_ns, &steps[i]);
+
+        if (steps[i].iops > steps[peak].iops)
+            peak = i;
+    }
+
+    free(duration);
+    close(fd);
+
+    printf("\n%s, %zu-byte random reads, %s mean think time, %u event loop%s:\n\n",
+           devname, read_size, think, num_loops, num_loops != 1 ? "s" : "");
+    free(think);
+
+    print_stats_header("clients");
+    for (i=0; i<num_steps; i++)
+    {
+        snprintf(label, sizeof(label), "%u", steps[i].clients);
+        print_stats_row(label, &steps[i].stats, steps[i].bytes,
+                        steps[i].elapsed_ns);
+    }
+
+    /* the population past which clients mostly queue: N* = (R + Z) / D,
+     * with R the response time alone and D the service demand, 1 / Xmax */
+    base_mean = humanize_time(steps[0].stats.mean, 3);
+    printf("\n Peak of %.0f IOPS; with %s response time alone, the device\n"
+           " saturates at ~%.0f clients\n",
+           steps[peak].iops, base_mean,
+           ((double)steps[0].stats.mean + think_ns) / NS_PER_SEC
+               * steps[peak].iops);
+    free(base_mean);
+
+    for (i=0; i<num_steps; i++)
+        if (steps[i].mean_lag_ns > MAX_LAG_FRACTION * think_ns)
+        {
+            char *const lag = humanize_time(steps[i].mean_lag_ns, 3);
+
+            printf(" warning: with %u client%s, reads waited %s on average to be\n"
+                   " submitted; the event loops fell behind (try more with -j)\n",
+                   steps[i].clients, steps[i].clients != 1 ? "s" : "", lag);
+            free(lag);
+            break;
+        }
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
@@ -0,0 +1,371 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* clone.c - synthetic workload cloned from a live device's statistics
+ *
+ * Samples the I/O statistics of a device in use (its sysfs stat file,
+ * which costs it nothing), and derives the rate, request sizes, read
+ * share and concurrency of its workload. Then replays the reads, at the
+ * average and at the peak rate, as open-loop random reads on the device
+ * under test, to see whether it keeps up. Writes are reported but not
+ * replayed, as all tests are read-only.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "clone.h"
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "openloop.h"
+#include "sysfs.h"
+
+
+/* Default sampling interval. */
+#define DEFAULT_SAMPLE_INTERVAL_NS NS_PER_SEC
+
+/* Default maximum reads in flight during the replay. */
+#define DEFAULT_MAX_INFLIGHT 256
+
+/* Bytes per sector, in the stat file. */
+#define SECTOR_BYTES 512
+
+/* Replay at the peak rate too, if it's at least this much above the
+ * average. */
+#define PEAK_MIN_RATIO 1.1
+
+/* The device keeps up if it completes at least this fraction of the
+ * offered rate. */
+#define MIN_ACHIEVED_FRACTION 0.95
+
+/* Reads are slower than on the source if their mean latency is more than
+ * this many times the source's. */
+#define MAX_LATENCY_RATIO 2.0
+
+
+/* The workload of the source device, over the sampling period. */
+struct source_profile {
+    uint64_t elapsed_ns;
+    double read_rate;           /* reads per second */
+    double peak_read_rate;      /* in the busiest interval */
+    double read_size;           /* mean bytes per read */
+    double read_await_ns;       /* mean read latency */
+    double read_merged;         /* fraction of reads merged */
+    double write_rate;
+    double write_size;
+    double queue_occupancy;     /* mean requests in flight */
+    double mean_in_flight;      /* as sampled */
+    uint64_t max_in_flight;     /* as sampled */
+    double utilization;         /* fraction of time busy */
+};
+
+struct replay_result {
+    double offered;
+    double achieved;
+    struct latency_stats stats;
+    uint64_t bytes;
+    uint64_t elapsed_ns;
+};
+
+
+
+/*
+ * Sleep until the monotonic clock (as in get_cur_ns) reaches deadline_ns.
+ */
+static void sleep_until(uint64_t deadline_ns)
+{
+    uint64_t now_ns;
+
+    while ((now_ns = get_cur_ns()) < deadline_ns)
+    {
+        const uint64_t wait_ns = deadline_ns - now_ns;
+        struct timespec ts;
+
+        ts.tv_sec = wait_ns / NS_PER_SEC;
+        ts.tv_nsec = wait_ns % NS_PER_SEC;
+        nanosleep(&ts, NULL);
+    }
+}
+
+
+
+/*
+ * Sample the stat file in dir every interval_ns, for duration_ns, and
+ * work out the workload's profile. Exits in case of error.
+ */
+static void sample_source(const char *dir, uint64_t interval_ns,
+        uint64_t duration_ns, struct source_profile *prof)
+{
+    struct diskstat first, prev, cur;
+    uint64_t start_ns, prev_ns, now_ns;
+    uint64_t in_flight_sum = 0, samples = 0, reads, writes;
+    int status;
+
+    status = read_diskstat(dir, &first);
+    die_if_with_errno(status != 0, "reading the source's stat", status);
+
+    prev = first;
+    start_ns = prev_ns = get_cur_ns();
+    prof->peak_read_rate = 0;
+    prof->max_in_flight = 0;
+
+    do
+    {
+        sleep_until(prev_ns + interval_ns);
+
+        status = read_diskstat(dir, &cur);
+        die_if_with_errno(status != 0, "reading the source's stat", status);
+        now_ns = get_cur_ns();
+
+        prof->peak_read_rate = max(prof->peak_read_rate,
+                (double)(cur.reads - prev.reads) * NS_PER_SEC
+                / max(now_ns - prev_ns, (uint64_t)1));
+        prof->max_in_flight = max(prof->max_in_flight, cur.in_flight);
+        in_flight_sum += cur.in_flight;
+        samples++;
+
+        prev = cur;
+        prev_ns = now_ns;
+    } while (now_ns - start_ns < duration_ns);
+
+    prof->elapsed_ns = now_ns - start_ns;
+    reads = cur.reads - first.reads;
+    writes = cur.writes - first.writes;
+
+    prof->read_rate = (double)reads * NS_PER_SEC / prof->elapsed_ns;
+    prof->write_rate = (double)writes * NS_PER_SEC / prof->elapsed_ns;
+    prof->read_size = reads > 0
+                      ? (double)(cur.read_sectors - first.read_sectors)
+                        * SECTOR_BYTES / reads
+                      : 0;
+    prof->write_size = writes > 0
+                       ? (double)(cur.write_sectors - first.write_sectors)
+                         * SECTOR_BYTES / writes
+                       : 0;
+    prof->read_await_ns = reads > 0
+                          ? (double)(cur.read_ticks - first.read_ticks)
+                            * 1000000 / reads
+                          : 0;
+    /* merged reads were counted in read_merges, not in reads */
+    prof->read_merged = reads > 0
+                        ? (double)(cur.read_merges - first.read_merges)
+                          / (reads + cur.read_merges - first.read_merges)
+                        : 0;
+    /* by Little's law, from the time requests spent in flight */
+    prof->queue_occupancy = (double)(cur.time_in_queue - first.time_in_queue)
+                            * 1000000 / prof->elapsed_ns;
+    prof->utilization = min((double)(cur.io_ticks - first.io_ticks)
+                            * 1000000 / prof->elapsed_ns, 1.0);
+    prof->mean_in_flight = (double)in_flight_sum / samples;
+}
+
+
+
+/*
+ * Replay reads at an offered rate, and store the outcome in res.
+ */
+static void replay(struct openloop_params *p, double rate,
+        struct replay_result *res)
+{
+    struct openloop_result ol;
+
+    p->rate = rate;
+    p->seed = random64();
+    run_open_loop(p, &ol);
+
+    get_latency_stats(&ol.lat, &res->stats);
+    res->offered = rate;
+    res->achieved = ol.lat.count / ((double)max(ol.elapsed_ns, (uint64_t)1)
+                                    / NS_PER_SEC);
+    res->bytes = ol.bytes;
+    res->elapsed_ns = ol.elapsed_ns;
+
+    sample_buf_free(&ol.lat);
+}
+
+
+
+/*
+ * Print a replay's verdict, comparing it with the source.
+ */
+static void print_verdict(const char *label, const struct replay_result *res,
+        const struct source_profile *prof)
+{
+    const int keeps_up = res->achieved >= MIN_ACHIEVED_FRACTION * res->offered;
+    const int slower = res->stats.mean > MAX_LATENCY_RATIO * prof->read_await_ns;
+    char *const mean = humanize_time(res->stats.mean, 3);
+    char *const await = humanize_time((uint64_t)prof->read_await_ns, 3);
+
+    printf(" At the %s rate: %.1f of %.1f IOPS; %s\n"
+           "   mean latency %s (source: %s), %.2f reads outstanding\n",
+           label, res->achieved, res->offered,
+           !keeps_up ? "FALLS BEHIND"
+           : slower ? "keeps up, but reads are slower" : "keeps up",
+           mean, await,
+           res->achieved * res->stats.mean / NS_PER_SEC);
+
+    free(mean);
+    free(await);
+}
+
+
+
+/*
+ * Clone the read workload of opts->clone_from onto a block device, and
+ * print the results.
+ *
+ * The source is sampled every opts->interval_ns
+ * (DEFAULT_SAMPLE_INTERVAL_NS if zero) for opts->duration_ns; each replay
+ * also runs for opts->duration_ns, with at most opts->queue_depth reads in
+ * flight (DEFAULT_MAX_INFLIGHT if zero). Exits in case of error.
+ */
+void run_and_print_clone(const char *devname,
+        const struct bench_options *opts)
+{
+    const uint64_t interval_ns = opts->interval_ns != 0
+                                 ? opts->interval_ns
+                                 : DEFAULT_SAMPLE_INTERVAL_NS;
+    struct replay_result avg, peak;
+    struct source_profile prof;
+    struct openloop_params p;
+    struct blkdev_info info;
+    struct human_value rsize, wsize;
+    char dir[PATH_MAX];
+    char *duration, *interval, *await;
+    int do_peak, status;
+
+    if (opts->clone_from == NULL)
+    {
+        fprintf(stderr, "error: clone mode requires a source device (--clone-from)\n");
+        exit(1);
+    }
+
+    status = sysfs_block_dir(opts->clone_from, dir, sizeof(dir));
+    die_if_with_errno(status != 0, opts->clone_from, status);
+
+    p.fd = open_blkdev(devname);
+    get_blkdev_info(p.fd, &info);
+    init_randomness();
+
+    duration = humanize_time(opts->duration_ns, 3);
+    interval = humanize_time(interval_ns, 3);
+
+    printf("Sampling the statistics of %s every %s for %s, please wait...\n",
+           opts->clone_from, interval, duration);
+    sample_source(dir, interval_ns, opts->duration_ns, &prof);
+
+    if (prof.read_rate == 0)
+    {
+        fprintf(stderr, "error: %s did no reads while sampled; nothing to replay\n",
+                opts->clone_from);
+        exit(1);
+    }
+
+    p.info = &info;
+    p.first_block = 0;
+    p.num_blocks = 0;
+    /* the nearest whole number of blocks */
+    p.read_size = max((size_t)((prof.read_size + info.block_size / 2)
+                               / info.block_size) * info.block_size,
+                      (size_t)info.block_size);
+    p.size_dist = NULL;
+    p.read_size = min(p.read_size, (size_t)info.dev_size);
+    p.max_inflight = opts->queue_depth != 0
+                     ? opts->queue_depth : DEFAULT_MAX_INFLIGHT;
+    p.duration_ns = opts->duration_ns;
+
+    printf("Replaying %zu-byte reads at %.1f IOPS for %s, please wait...\n",
+           p.read_size, prof.read_rate, duration);
+    replay(&p, prof.read_rate, &avg);
+
+    do_peak = prof.peak_read_rate >= PEAK_MIN_RATIO * prof.read_rate;
+    if (do_peak)
+    {
+        printf("Replaying %zu-byte reads at %.1f IOPS for %s, please wait...\n",
+               p.read_size, prof.peak_read_rate, duration);
+        replay(&p, prof.peak_read_rate, &peak);
+    }
+
+    close(p.fd);
+
+    rsize = humanize_binary_size((uint64_t)prof.read_size);
+    wsize = humanize_binary_size((uint64_t)prof.write_size);
+    await = humanize_time((uint64_t)prof.read_await_ns, 3);
+
+    printf("\n"
+           "Source %s, over %s:\n"
+           " Reads: %.1f IOPS (peak %.1f in %s), mean size %.2Lf %s\n"
+           "   await %s, %.0f%% merged\n"
+           " Writes: %.1f IOPS, mean size %.2Lf %s\n"
+           "   (not replayed; all tests are read-only)\n"
+           " Read share: %.0f%% of requests\n"
+           " Requests in flight: %.2f on average (sampled: %.2f mean, %" PRIu64 " max)\n"
+           " Utilization: %.0f%%\n",
+           opts->clone_from, duration,
+           prof.read_rate, prof.peak_read_rate, interval,
+           rsize.value, rsize.unit, await, prof.read_merged * 100,
+           prof.write_rate, wsize.value, wsize.unit,
+           prof.read_rate * 100 / (prof.read_rate + prof.write_rate),
+           prof.queue_occupancy, prof.mean_in_flight, prof.max_in_flight,
+           prof.utilization * 100);
+
+    printf("\n"
+           "%s:\n"
+           " %zu-byte open-loop random reads, up to %u in flight\n"
+           "\n",
+           devname, p.read_size, p.max_inflight);
+
+    print_stats_header("rate");
+    print_stats_row("average", &avg.stats, avg.bytes, avg.elapsed_ns);
+    if (do_peak)
+        print_stats_row("peak", &peak.stats, peak.bytes, peak.elapsed_ns);
+
+    printf("\n");
+    print_verdict("average", &avg, &prof);
+    if (do_peak)
+        print_verdict("peak", &peak, &prof);
+
+    if (prof.read_merged > 0.5)
+        printf(" Note: most of the source's reads were merged, so its workload\n"
+               " is largely sequential; random replay is a pessimistic match.\n");
+
+    free(await);
+    free(interval);
+    free(duration);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
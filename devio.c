@@ -0,0 +1,508 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* devio.c - block device I/O and timing helpers */
+
+
+#define _LARGEFILE64_SOURCE
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/fcntl.h>
+#include <linux/fs.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "watchdog.h"
+
+
+/* CLOCK_MONOTONIC_RAW is immune to incremental adjustments performed by
+ * adjtime() or NTP; however, it is Linux-specific */
+#ifndef CLOCK_MONOTONIC_RAW
+#  define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
+#endif
+
+/* Maximum number of restore functions; see register_restore. */
+#define MAX_RESTORES 8
+
+
+/* Functions undoing changes to the system, run at exit or on a signal. */
+static void (*restores[MAX_RESTORES])(void);
+static volatile sig_atomic_t num_restores;
+
+
+
+/*
+ * 64-bit version of random().
+ *
+ * Returns a random unsigned 64-bit number. Uses random() and scales it
+ * proportionally up to 0..2**64-1.
+ */
+uint64_t random64(void)
+{
+    if (RAND_MAX < ~(uint64_t)0)
+        return random() * (~(uint64_t)0 / RAND_MAX);
+    else
+        /* cover system whose RAND_MAX (long int) doesn't fit in 64 bits */
+        return (uint64_t)random();
+}
+
+
+
+/*
+ * Initialize random number generator engine.
+ */
+void init_randomness(void)
+{
+    srandom(time(NULL));
+}
+
+
+
+/*
+ * Return the logarithm of x to base 2, rounded down to zero.
+ *
+ * x must not be zero.
+ */
+static unsigned int log2_floor(unsigned int x)
+{
+    unsigned int exp = 0;
+
+    assert(x != 0);
+
+    while (x > 1)
+    {
+        exp++;
+        x >>= 1;
+    }
+
+    assert(exp <= sizeof(x) * CHAR_BIT);
+
+    return exp;
+}
+
+
+
+/*
+ * Return the smallest power of 2 larger than or equal to x.
+ *
+ * Exits if x is larger than the largest power of 2 that will fit in an
+ * unsigned int.
+ */
+static unsigned int smallest_power_of_2_that_holds(unsigned int x)
+{
+    unsigned int exp;
+
+    if (x == 0)
+        /* can't calculate log(0); just return the correct result (first power
+         * of 2, 2**0 = 1) */
+        return 1;
+
+    /* make sure x fits in the largest power of 2 an unsigned int can hold */
+    if (x > (1U << (sizeof(unsigned int)*CHAR_BIT - 1)))
+    {
+        fprintf(stderr,
+                "error: %u doesn't fit in largest power of 2 an unsigned int can hold\n",
+                x);
+        exit(1);
+    }
+
+    exp = log2_floor(x);
+
+    return 1U << exp == x ? x : 1U << (exp + 1);
+}
+
+
+
+/*
+ * Calculate difference between two struct timespec, in nanoseconds.
+ *
+ * Returns the difference in nanoseconds between time t1 and time t0,
+ * represented as an uint64_t. May have undefined behavior if t0 is greater
+ * than t1, due to integer overflow.
+ */
+uint64_t timespec_diff_ns(const struct timespec *t1, const struct timespec *t0)
+{
+    return timespec_to_ns(t1) - timespec_to_ns(t0);
+}
+
+
+
+/*
+ * Get a device's physical block size. Receives an open file descriptor for the
+ * device. Returns zero on success, or an error number in case of error.
+ */
+static int get_physical_block_size(int fd, unsigned int *p_block_size)
+{
+    return ioctl(fd, BLKPBSZGET, p_block_size) == -1 ? errno : 0;
+}
+
+
+
+/*
+ * Get buffer alignment for reading from fd.
+ *
+ * Uses the POSIX fpathconf interface to query proper alignment from the
+ * system. In case of unspecified alignment, assumes fd is a block device
+ * and falls back to checking its block size. Returns zero on success, or
+ * an error number in case of error, with the failed call named in *p_what.
+ */
+static int get_readbuf_align(int fd, size_t *p_align, const char **p_what)
+{
+    unsigned int block_size;
+    long align_l;
+    int error;
+
+    errno = 0;
+    align_l = fpathconf(fd, _PC_REC_XFER_ALIGN);
+
+    assert(align_l >= -1);
+
+    /* fallback to device's block size in case of error or useless value */
+    switch (align_l)
+    {
+        case -1:    /* no specific align recommendation, or error */
+            if (errno != 0)
+            {
+                *p_what = "fpathconf";
+                return errno;
+            }
+            /* FALL THROUGH */
+        case 0:     /* 0 align makes no sense */
+            error = get_physical_block_size(fd, &block_size);
+            if (error != 0)
+            {
+                *p_what = "ioctl(BLKPBSZGET)";
+                return error;
+            }
+            align_l = (long)block_size;
+    }
+
+    *p_align = (size_t)align_l;
+
+    return 0;
+}
+
+
+
+/*
+ * Get the size of a device. Receives an open file descriptor for the device.
+ * Returns zero on success, or an error number in case of error.
+ */
+static int get_dev_size(int fd, uint64_t *p_size)
+{
+    return ioctl(fd, BLKGETSIZE64, p_size) == -1 ? errno : 0;
+}
+
+
+
+/*
+ * Read count bytes from fd, at the specified offset. Exits in case of
+ * error.
+ *
+ * Uses pread, so the file offset is left untouched; concurrent workers
+ * may safely share the same file descriptor. The read is watched for
+ * hangs, if the watchdog is running.
+ */
+void read_at(int fd, void *buffer, size_t count, uint64_t offset)
+{
+    const int slot = watchdog_begin(fd, offset, count);
+    ssize_t read_ok;
+
+    read_ok = pread64(fd, buffer, count, (off64_t)offset);
+    watchdog_end(slot);
+    die_if(read_ok < 0, "read");
+}
+
+
+
+/*
+ * Get a timestamp in seconds, with very high precision.
+ *
+ * Receives a pointer to a struct timespec, where the timestamp will be stored.
+ * The time value is relative to some unspecified starting point; useful for
+ * relative time calculations (timing measurements).
+ */
+void get_cur_timestamp(struct timespec *now)
+{
+    int retval;
+
+    retval = clock_gettime(CLOCK_MONOTONIC_RAW, now);
+    die_if(retval == -1, "clock_gettime");
+}
+
+
+
+/*
+ * Get a timestamp in nanoseconds. Same as get_cur_timestamp, but returns
+ * the value directly, for use in tight per-I/O measurement loops.
+ */
+uint64_t get_cur_ns(void)
+{
+    struct timespec now;
+
+    get_cur_timestamp(&now);
+
+    return timespec_to_ns(&now);
+}
+
+
+
+/*
+ * Get the CPU time spent by the calling thread, in nanoseconds.
+ */
+uint64_t get_thread_cpu_ns(void)
+{
+    struct timespec ts;
+
+    die_if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0, "clock_gettime");
+
+    return timespec_to_ns(&ts);
+}
+
+
+
+/*
+ * Calculate the tolerance in taking two time measurements and calculating the
+ * time delta. Returns half the maximum error in nanoseconds; the actual
+ * tolerance is +/- the returned value.
+ */
+uint64_t get_timing_tolerance_ns(void)
+{
+    struct timespec res;
+    int retval;
+    struct timespec t0, t1;
+    uint64_t resolution_ns, delta_ns;
+
+    /* get the underlying clock's resolution (lower bound) */
+    retval = clock_getres(CLOCK_MONOTONIC_RAW, &res);
+    die_if(retval == -1, "clock_getres");
+
+    resolution_ns = timespec_to_ns(&res);
+
+    /* measure the actual overhead of measuring time */
+    get_cur_timestamp(&t0);
+    get_cur_timestamp(&t1);
+    delta_ns = timespec_diff_ns(&t1, &t0);
+
+    /* tolerance is +/- half the maximum error */
+    return max(resolution_ns, delta_ns) / 2;
+}
+
+
+
+/*
+ * Allocate a block of memory of the specified size, aligned to the specified
+ * alignment. Stores a pointer to the newly allocated memory in *p_buffer,
+ * which should be released with free() when no longer necessary. Returns
+ * zero on success, or an error number in case of error.
+ */
+int try_allocate_aligned_memory(size_t alignment, size_t size,
+        void **p_buffer)
+{
+    return posix_memalign(p_buffer, smallest_power_of_2_that_holds(alignment),
+                          size);
+}
+
+
+
+/*
+ * Allocate a block of memory of the specified size, aligned to the specified
+ * alignment. Returns a pointer to the newly allocated memory. The memory
+ * should be released with free() when no longer necessary. Exits in case of
+ * error.
+ */
+void *allocate_aligned_memory(size_t alignment, size_t size)
+{
+    void *buffer;
+    int retval;
+
+    retval = try_allocate_aligned_memory(alignment, size, &buffer);
+    die_if_with_errno(retval != 0, "posix_memalign", retval);
+
+    return buffer;
+}
+
+
+
+/*
+ * Open a block device for direct, read-only access. Returns the file
+ * descriptor. Exits in case of error.
+ */
+int open_blkdev(const char *devname)
+{
+    int fd;
+
+    fd = open(devname, O_RDONLY | O_DIRECT | O_SYNC);
+    die_if(fd < 0, "open");
+
+    return fd;
+}
+
+
+
+/*
+ * Get information about a block device.
+ *
+ * Receives the file descriptor of the block device, and a pointer to a struct
+ * blkdev_info where the results will be stored.
+ *
+ * Returns zero on success, or an error number in case of error (EINVAL if
+ * the block size is greater than the device itself). If p_what isn't
+ * NULL, the failed call is named in *p_what.
+ */
+int try_get_blkdev_info(int fd, struct blkdev_info *blkdev_info,
+        const char **p_what)
+{
+    const char *what = "get_blkdev_info";
+    int error;
+
+    memset(blkdev_info, 0, sizeof(*blkdev_info));
+
+    if ((error = get_dev_size(fd, &blkdev_info->dev_size)) != 0)
+        what = "ioctl(BLKGETSIZE64)";
+    else if ((error = get_physical_block_size(fd,
+                                              &blkdev_info->block_size)) != 0)
+        what = "ioctl(BLKPBSZGET)";
+    else if (blkdev_info->dev_size < blkdev_info->block_size)
+        error = EINVAL;
+    else
+    {
+        blkdev_info->num_blocks = blkdev_info->dev_size
+                                  / blkdev_info->block_size;
+        error = get_readbuf_align(fd, &blkdev_info->alignment, &what);
+    }
+
+    if (p_what != NULL)
+        *p_what = what;
+
+    return error;
+}
+
+
+
+/*
+ * Get information about a block device.
+ *
+ * Receives the file descriptor of the block device, and a pointer to a struct
+ * blkdev_info where the results will be stored.
+ *
+ * Exits in case of error.
+ */
+void get_blkdev_info(int fd, struct blkdev_info *blkdev_info)
+{
+    const char *what;
+    const int error = try_get_blkdev_info(fd, blkdev_info, &what);
+
+    /* the sizes are only both set if the ioctls succeeded */
+    if (error != 0 && blkdev_info->dev_size < blkdev_info->block_size)
+    {
+        fprintf(stderr,
+                "error: block size (%u) is greater than device itself (%" PRIu64 ")\n",
+                blkdev_info->block_size,
+                blkdev_info->dev_size);
+        exit(1);
+    }
+
+    die_if_with_errno(error != 0, what, error);
+}
+
+
+
+
+/*
+ * Run every registered restore function.
+ */
+static void run_restores(void)
+{
+    int i;
+
+    for (i=0; i<num_restores; i++)
+        restores[i]();
+}
+
+
+
+/*
+ * Signal handler: run the restore functions, then die of the same signal.
+ */
+static void restore_on_signal(int sig)
+{
+    run_restores();
+    raise(sig);
+}
+
+
+
+/*
+ * Register a function to undo a change hdtime made to the system, e.g. a
+ * device's I/O scheduler. It is run when the program exits, by any path
+ * (including die_if and the watchdog's abort), and on SIGHUP, SIGINT or
+ * SIGTERM; the function itself must check whether there is still
+ * anything to undo, and forget it once undone. It must only make
+ * async-signal-safe calls. Registering a function again has no effect.
+ */
+void register_restore(void (*fn)(void))
+{
+    static const int signals[] = { SIGHUP, SIGINT, SIGTERM };
+    struct sigaction sa;
+    int i;
+
+    for (i=0; i<num_restores; i++)
+        if (restores[i] == fn)
+            return;
+
+    assert(num_restores < MAX_RESTORES);
+
+    if (num_restores == 0)
+    {
+        die_if(atexit(run_restores) != 0, "atexit");
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = restore_on_signal;
+        sa.sa_flags = SA_RESETHAND;
+        sigemptyset(&sa.sa_mask);
+        for (i=0; i < (int)(sizeof(signals) / sizeof(signals[0])); i++)
+            die_if(sigaction(signals[i], &sa, NULL) != 0, "sigaction");
+    }
+
+    restores[num_restores] = fn;
+    num_restores++;
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
@@ -0,0 +1,197 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* devio.h - block device I/O and timing helpers */
+
+
+#ifndef _DEVIO_H
+#define _DEVIO_H
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+
+/* get size_t */
+#include <stddef.h>
+
+/* get uint64_t */
+#include <stdint.h>
+
+
+#define min(x, y) ({  \
+  __typeof__(x) _x = (x); \
+  __typeof__(y) _y = (y); \
+  _x < _y ? _x : _y;  \
+})
+
+#define max(x, y) ({  \
+  __typeof__(x) _x = (x); \
+  __typeof__(y) _y = (y); \
+  _x > _y ? _x : _y;  \
+})
+
+
+#define MIB (1024UL * 1024UL)
+
+#define NS_PER_SEC (1000000000UL)
+
+
+struct blkdev_info {
+    uint64_t dev_size;
+    uint64_t num_blocks;
+    unsigned int block_size;
+    size_t alignment;
+};
+
+
+
+/*
+ * Terminate the program if error is true.
+ *
+ * Prints the message to stderr before terminating, followed by a message
+ * describing the specified error number.
+ */
+static inline void die_if_with_errno(int error, const char *msg, int errnum)
+{
+    if (error) {
+        fprintf(stderr, "%s: %s\n", msg, strerror(errnum));
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+
+/*
+ * Terminate the program if error is true.
+ *
+ * Prints the message to stderr before terminating, followed by a message
+ * describing the current value in errno.
+ */
+static inline void die_if(int error, const char *msg)
+{
+    if (error) {
+        perror(msg);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+
+static inline size_t align_ceil(size_t n, size_t alignment)
+{
+    const size_t remainder = n % alignment;
+
+    return remainder != 0 ? (n - remainder) + alignment : n;
+}
+
+
+
+/*
+ * Convert a struct timespec to nanoseconds.
+ *
+ * May return undefined results due to integer overflow, if the seconds field
+ * contains a value greater than (2**64 - 1) / 10**9 ~= 2**34 s ~= 584 years.
+ */
+static inline uint64_t timespec_to_ns(const struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec*NS_PER_SEC + ts->tv_nsec;
+}
+
+
+
+/*
+ * 64-bit reentrant pseudo-random number generator (splitmix64).
+ *
+ * Receives a pointer to the generator's state, which is advanced. Unlike
+ * random64, this is suitable for use by concurrent worker threads, each
+ * holding its own state; seed the state with random64 or any other value.
+ */
+static inline uint64_t random64_r(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+    return z ^ (z >> 31);
+}
+
+
+/*
+ * Get the n-th point of the base 2 van der Corput sequence, as a fraction
+ * of 2^64.
+ *
+ * This is n with its bits reversed. Any 2^k consecutive points, starting
+ * at a multiple of 2^k, fall one in each 1/2^k of the range; so any prefix
+ * of the sequence covers the range far more evenly than as many
+ * independent random points.
+ */
+static inline uint64_t van_der_corput64(uint64_t n)
+{
+    n = ((n >> 1) & 0x5555555555555555ULL) | ((n & 0x5555555555555555ULL) << 1);
+    n = ((n >> 2) & 0x3333333333333333ULL) | ((n & 0x3333333333333333ULL) << 2);
+    n = ((n >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((n & 0x0f0f0f0f0f0f0f0fULL) << 4);
+    n = ((n >> 8) & 0x00ff00ff00ff00ffULL) | ((n & 0x00ff00ff00ff00ffULL) << 8);
+    n = ((n >> 16) & 0x0000ffff0000ffffULL) | ((n & 0x0000ffff0000ffffULL) << 16);
+
+    return (n >> 32) | (n << 32);
+}
+
+
+uint64_t random64(void);
+
+void init_randomness(void);
+
+uint64_t timespec_diff_ns(const struct timespec *t1, const struct timespec *t0);
+
+void get_cur_timestamp(struct timespec *now);
+
+uint64_t get_cur_ns(void);
+
+uint64_t get_thread_cpu_ns(void);
+
+uint64_t get_timing_tolerance_ns(void);
+
+int try_allocate_aligned_memory(size_t alignment, size_t size,
+        void **p_buffer);
+
+void *allocate_aligned_memory(size_t alignment, size_t size);
+
+void read_at(int fd, void *buffer, size_t count, uint64_t offset);
+
+int open_blkdev(const char *devname);
+
+int try_get_blkdev_info(int fd, struct blkdev_info *blkdev_info,
+        const char **p_what);
+
+void get_blkdev_info(int fd, struct blkdev_info *blkdev_info);
+
+void register_restore(void (*fn)(void));
+
+
+#endif  /* _DEVIO_H */
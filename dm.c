@@ -0,0 +1,110 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* dm.c - device mapper queries */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "dm.h"
+
+
+/* Size of the buffer for device mapper ioctls. */
+#define DM_BUF_SIZE (64 * 1024)
+
+
+
+/*
+ * Initialize a device mapper ioctl buffer of the specified size, for the
+ * device called name.
+ */
+void init_dm_ioctl(struct dm_ioctl *dmi, size_t size, const char *name)
+{
+    memset(dmi, 0, size);
+    dmi->version[0] = DM_VERSION_MAJOR;
+    dmi->data_size = size;
+    dmi->data_start = sizeof(*dmi);
+    snprintf(dmi->name, sizeof(dmi->name), "%s", name);
+}
+
+
+
+/*
+ * Get the table of a device mapper device made of a single target of the
+ * specified type, through the control device ctl.
+ *
+ * Stores the target's start and length in sectors. Returns its
+ * parameters as a newly allocated string, or NULL in case of error, with
+ * errno set (EINVAL if the table isn't a single target of that type).
+ */
+char *get_dm_table(int ctl, const char *name, const char *target_type,
+        uint64_t *p_start, uint64_t *p_length)
+{
+    struct dm_ioctl *dmi = malloc(DM_BUF_SIZE);
+    struct dm_target_spec *spec;
+    char *params = NULL;
+    int err = 0;
+
+    die_if(dmi == NULL, "malloc");
+
+    init_dm_ioctl(dmi, DM_BUF_SIZE, name);
+    dmi->flags = DM_STATUS_TABLE_FLAG;
+
+    if (ioctl(ctl, DM_TABLE_STATUS, dmi) != 0)
+        err = errno;
+    else if ((dmi->flags & DM_BUFFER_FULL_FLAG) || dmi->target_count != 1)
+        err = EINVAL;
+    else
+    {
+        spec = (struct dm_target_spec *)((char *)dmi + dmi->data_start);
+        if (strcmp(spec->target_type, target_type) != 0)
+            err = EINVAL;
+        else
+        {
+            params = strdup((char *)(spec + 1));
+            die_if(params == NULL, "strdup");
+            *p_start = spec->sector_start;
+            *p_length = spec->length;
+        }
+    }
+
+    free(dmi);
+    errno = err;
+
+    return params;
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
@@ -0,0 +1,52 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* dm.h - device mapper queries */
+
+
+#ifndef _DM_H
+#define _DM_H
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+
+/* get size_t */
+#include <stddef.h>
+
+/* get uint64_t */
+#include <stdint.h>
+
+#include <linux/dm-ioctl.h>
+
+
+/* Device mapper control device. */
+#define DM_CONTROL_PATH "/dev/mapper/control"
+
+
+void init_dm_ioctl(struct dm_ioctl *dmi, size_t size, const char *name);
+
+char *get_dm_table(int ctl, const char *name, const char *target_type,
+        uint64_t *p_start, uint64_t *p_length);
+
+
+#endif  /* _DM_H */
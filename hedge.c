@@ -0,0 +1,443 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* hedge.c - hedged reads across mirrors
+ *
+ * Treats several devices as replicas of the same data. Each read goes to
+ * one replica; if it hasn't completed within a hedge delay, the same read
+ * is sent to another replica, and whichever finishes first completes it.
+ * The slower copy can't be cancelled, so it still ties up its replica,
+ * which is the extra I/O cost of hedging. Runs without hedging first, to
+ * get the latency distribution, then with hedge delays at several of its
+ * percentiles, and reports the tail latency against the extra I/O.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "asyncio.h"
+#include "devio.h"
+#include "hedge.h"
+#include "humanize.h"
+#include "latency.h"
+#include "watchdog.h"
+
+
+/* Default size of the reads. */
+#define DEFAULT_READ_BYTES 4096
+
+/* Default reads in flight. */
+#define DEFAULT_QUEUE_DEPTH 4
+
+/* Maximum number of replicas. */
+#define MAX_REPLICAS 64
+
+/* Number of hedge delays tried, when none is given. */
+#define NUM_DELAYS 4
+
+/* Percentiles of the unhedged latency tried as hedge delays. */
+static const double delay_pct[NUM_DELAYS] = { 50, 90, 95, 99 };
+
+
+struct hedge_read;
+
+struct hedge_io {
+    struct iocb cb;
+    struct hedge_read *read;
+    char *buffer;
+    unsigned int replica;
+};
+
+/* A read, and up to two copies of it in flight. */
+struct hedge_read {
+    struct hedge_io io[2];      /* the first copy, and the hedge */
+    unsigned int outstanding;
+    int done;
+    int hedged;
+    uint64_t offset;
+    uint64_t start_ns;
+};
+
+struct step_result {
+    struct latency_stats stats;
+    uint64_t pct[NUM_DELAYS];   /* latency at each of delay_pct */
+    uint64_t bytes;
+    uint64_t elapsed_ns;
+    uint64_t hedges;
+    uint64_t hedges_won;        /* completed before the first copy */
+};
+
+
+
+/*
+ * Run random reads of read_size bytes on the replicas, keeping queue_depth
+ * of them in flight, for duration_ns, hedging each one after delay_ns
+ * (UINT64_MAX never hedges).
+ *
+ * A read's record stays busy until both copies complete; if the records
+ * run out, because of a slow replica, new reads wait for one. Stores the
+ * results in res.
+ */
+static void run_step(const int *fds, unsigned int num_replicas,
+        const struct blkdev_info *info, size_t read_size,
+        unsigned int queue_depth, uint64_t duration_ns, uint64_t delay_ns,
+        struct step_result *res)
+{
+    const unsigned int num_reads = 2 * queue_depth;
+    const uint64_t choices = (info->dev_size - read_size) / info->alignment + 1;
+    struct hedge_read *reads = malloc(num_reads * sizeof(*reads));
+    struct hedge_read **free_reads = malloc(num_reads * sizeof(*free_reads));
+    struct hedge_read **active = malloc(queue_depth * sizeof(*active));
+    struct iocb **to_submit = malloc(num_reads * 2 * sizeof(*to_submit));
+    struct io_event *events = malloc(num_reads * 2 * sizeof(*events));
+    unsigned int num_free = num_reads, num_active = 0, busy = 0;
+    struct sample_buf lat;
+    struct async_ctx actx;
+    uint64_t seed = random64();
+    uint64_t start_ns, now_ns;
+    unsigned int i, j;
+    int old_slack;
+
+    die_if(reads == NULL || free_reads == NULL || active == NULL
+           || to_submit == NULL || events == NULL, "malloc");
+
+    for (i=0; i<num_reads; i++)
+    {
+        for (j=0; j<2; j++)
+        {
+            reads[i].io[j].read = &reads[i];
+            reads[i].io[j].buffer = allocate_aligned_memory(info->alignment,
+                    read_size);
+        }
+        free_reads[i] = &reads[i];
+    }
+
+    async_init(&actx, num_reads * 2);
+    sample_buf_init(&lat);
+    res->bytes = 0;
+    res->hedges = 0;
+    res->hedges_won = 0;
+
+    /* the default timer slack (50 us) would make the waits below overrun
+     * delays of a few microseconds, by more than the reads take */
+    old_slack = prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0);
+    (void)prctl(PR_SET_TIMERSLACK, 1, 0, 0, 0);
+
+    start_ns = now_ns = get_cur_ns();
+
+    for (;;)
+    {
+        const int arriving = now_ns - start_ns < duration_ns
+                             && !watchdog_aborting();
+        uint64_t deadline_ns = UINT64_MAX;
+        struct timespec timeout;
+        int submit = 0;
+        int got;
+
+        /* start new reads, up to the queue depth */
+        while (arriving && num_active < queue_depth && num_free > 0)
+        {
+            struct hedge_read *r = free_reads[--num_free];
+            struct hedge_io *io = &r->io[0];
+
+            r->offset = random64_r(&seed) % choices * info->alignment;
+            r->outstanding = 1;
+            r->done = 0;
+            r->hedged = 0;
+            r->start_ns = now_ns;
+            io->replica = random64_r(&seed) % num_replicas;
+            async_prep_read(&io->cb, fds[io->replica], io->buffer,
+                    read_size, r->offset, io);
+            to_submit[submit++] = &io->cb;
+            active[num_active++] = r;
+            busy++;
+        }
+
+        /* hedge the reads that are past their delay */
+        for (i=0; i<num_active; i++)
+        {
+            struct hedge_read *r = active[i];
+
+            if (r->hedged)
+                continue;
+
+            if (delay_ns != UINT64_MAX && now_ns - r->start_ns >= delay_ns)
+            {
+                struct hedge_io *io = &r->io[1];
+
+                io->replica = (r->io[0].replica + 1
+                               + random64_r(&seed) % (num_replicas - 1))
+                              % num_replicas;
+                async_prep_read(&io->cb, fds[io->replica], io->buffer,
+                        read_size, r->offset, io);
+                to_submit[submit++] = &io->cb;
+                r->outstanding++;
+                r->hedged = 1;
+                res->hedges++;
+            }
+            else if (delay_ns != UINT64_MAX)
+                deadline_ns = min(deadline_ns, r->start_ns + delay_ns);
+        }
+
+        if (submit > 0)
+            async_submit(&actx, to_submit, submit);
+
+        if (busy == 0)
+            break;
+
+        /* wait for completions, but no later than the next hedge */
+        if (deadline_ns != UINT64_MAX)
+        {
+            const uint64_t wait_ns = deadline_ns - now_ns;
+
+            timeout.tv_sec = wait_ns / NS_PER_SEC;
+            timeout.tv_nsec = wait_ns % NS_PER_SEC;
+            got = async_reap(&actx, events, 1, num_reads * 2, &timeout);
+        }
+        else
+            got = async_reap(&actx, events, 1, num_reads * 2, NULL);
+
+        now_ns = get_cur_ns();
+
+        for (i=0; i<(unsigned int)got; i++)
+        {
+            struct hedge_io *io = (struct hedge_io *)(uintptr_t)events[i].data;
+            struct hedge_read *r = io->read;
+
+            die_if_with_errno(events[i].res < 0, "read", (int)-events[i].res);
+
+            if (!r->done)
+            {   /* the first copy to complete completes the read */
+                r->done = 1;
+                sample_buf_add(&lat, now_ns - r->start_ns);
+                res->bytes += read_size;
+                if (io == &r->io[1])
+                    res->hedges_won++;
+
+                for (j=0; active[j] != r; j++)
+                    ;
+                active[j] = active[--num_active];
+            }
+
+            if (--r->outstanding == 0)
+            {
+                free_reads[num_free++] = r;
+                busy--;
+            }
+        }
+    }
+
+    if (old_slack > 0)
+        (void)prctl(PR_SET_TIMERSLACK, old_slack, 0, 0, 0);
+
+    res->elapsed_ns = now_ns - start_ns;
+    get_latency_stats(&lat, &res->stats);
+    for (i=0; i<NUM_DELAYS; i++)
+        res->pct[i] = lat.count > 0
+                      ? percentile_sorted(lat.ns, lat.count, delay_pct[i]) : 0;
+
+    sample_buf_free(&lat);
+    async_destroy(&actx);
+
+    for (i=0; i<num_reads; i++)
+    {
+        free(reads[i].io[0].buffer);
+        free(reads[i].io[1].buffer);
+    }
+
+    free(events);
+    free(to_submit);
+    free(active);
+    free(free_reads);
+    free(reads);
+}
+
+
+
+/*
+ * Get the relative change from old to new, as a percentage.
+ */
+static double pct_change(uint64_t old, uint64_t new)
+{
+    return old > 0 ? ((double)new - (double)old) * 100 / old : 0;
+}
+
+
+
+/*
+ * Run the hedged reads test on the devices in opts->devnames, which must
+ * hold the same data, and print the results.
+ *
+ * Reads of opts->read_size bytes (DEFAULT_READ_BYTES if zero) go to random
+ * offsets, with opts->queue_depth of them in flight (DEFAULT_QUEUE_DEPTH
+ * if zero), for opts->duration_ns per step. The hedge delay is
+ * opts->hedge_delay_ns; if zero, the delay_pct percentiles of the
+ * unhedged latency are tried. Exits in case of error.
+ */
+void run_and_print_hedge(const char *devname,
+        const struct bench_options *opts)
+{
+    const unsigned int num_replicas = opts->num_devnames;
+    const unsigned int queue_depth = opts->queue_depth != 0
+                                     ? opts->queue_depth : DEFAULT_QUEUE_DEPTH;
+    struct step_result base, results[NUM_DELAYS];
+    uint64_t delays[NUM_DELAYS];
+    unsigned int num_delays = 0;
+    int fds[MAX_REPLICAS];
+    struct blkdev_info info, member;
+    size_t read_size;
+    char *duration, *delay;
+    char label[32];
+    unsigned int i;
+
+    (void)devname;
+
+    if (num_replicas < 2 || num_replicas > MAX_REPLICAS)
+    {
+        fprintf(stderr, "error: hedge mode takes 2 to %u devices, holding the same data\n",
+                MAX_REPLICAS);
+        exit(1);
+    }
+
+    for (i=0; i<num_replicas; i++)
+    {
+        fds[i] = open_blkdev(opts->devnames[i]);
+        get_blkdev_info(fds[i], &member);
+
+        if (i == 0)
+            info = member;
+        else
+        {   /* reads must fit in, and suit, every replica */
+            info.dev_size = min(info.dev_size, member.dev_size);
+            info.alignment = max(info.alignment, member.alignment);
+            info.block_size = max(info.block_size, member.block_size);
+        }
+    }
+    info.alignment = max(info.alignment, (size_t)info.block_size);
+
+    init_randomness();
+
+    read_size = align_ceil(opts->read_size != 0 ? opts->read_size
+                                                : DEFAULT_READ_BYTES,
+                           info.alignment);
+    if (read_size > info.dev_size)
+    {
+        fprintf(stderr, "error: devices too small for %zu-byte reads\n",
+                read_size);
+        exit(1);
+    }
+
+    duration = humanize_time(opts->duration_ns, 3);
+
+    printf("Reading %zu-byte blocks at QD%u without hedging for %s, please wait...\n",
+           read_size, queue_depth, duration);
+    run_step(fds, num_replicas, &info, read_size, queue_depth,
+             opts->duration_ns, UINT64_MAX, &base);
+
+    if (opts->hedge_delay_ns != 0)
+        delays[num_delays++] = opts->hedge_delay_ns;
+    else
+    {
+        for (i=0; i<NUM_DELAYS; i++)
+            delays[num_delays++] = max(base.pct[i], (uint64_t)1);
+    }
+
+    for (i=0; i<num_delays; i++)
+    {
+        delay = humanize_time(delays[i], 3);
+        printf("Reading %zu-byte blocks at QD%u, hedged after %s, for %s, please wait...\n",
+               read_size, queue_depth, delay, duration);
+        free(delay);
+
+        run_step(fds, num_replicas, &info, read_size, queue_depth,
+                 opts->duration_ns, delays[i], &results[i]);
+    }
+
+    for (i=0; i<num_replicas; i++)
+        close(fds[i]);
+
+    printf("\n"
+           "Hedged reads over");
+    for (i=0; i<num_replicas; i++)
+        printf(" %s", opts->devnames[i]);
+    printf("\n"
+           " %zu-byte random reads at QD%u\n"
+           "\n",
+           read_size, queue_depth);
+
+    print_stats_header("hedge after");
+    print_stats_row("never", &base.stats, base.bytes, base.elapsed_ns);
+    for (i=0; i<num_delays; i++)
+    {
+        if (opts->hedge_delay_ns != 0)
+            snprintf(label, sizeof(label), "given delay");
+        else
+            snprintf(label, sizeof(label), "p%g", delay_pct[i]);
+        print_stats_row(label, &results[i].stats, results[i].bytes,
+                results[i].elapsed_ns);
+    }
+
+    printf("\n"
+           " %-14s %12s %12s %12s %12s %12s\n",
+           "hedge after", "delay", "extra I/O", "hedges won", "p99", "p99.9");
+    for (i=0; i<num_delays; i++)
+    {
+        const struct step_result *res = &results[i];
+
+        if (opts->hedge_delay_ns != 0)
+            snprintf(label, sizeof(label), "given delay");
+        else
+            snprintf(label, sizeof(label), "p%g", delay_pct[i]);
+
+        delay = humanize_time(delays[i], 3);
+        printf(" %-14s %12s %11.1f%% %11.1f%% %+11.1f%% %+11.1f%%\n",
+               label, delay,
+               res->stats.count > 0
+               ? (double)res->hedges * 100 / res->stats.count : 0,
+               res->hedges > 0
+               ? (double)res->hedges_won * 100 / res->hedges : 0,
+               pct_change(base.stats.p99, res->stats.p99),
+               pct_change(base.stats.p999, res->stats.p999));
+        free(delay);
+    }
+
+    printf("\n"
+           " Extra I/O is hedges per read; hedges won completed before the\n"
+           " first copy. p99 and p99.9 are relative to reads without hedging.\n");
+
+    free(duration);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
@@ -485,4 +485,57 @@ int parse_human_size(const char *arg, size_t *result)
     return 0;
 }
 
+
+
+/*
+ * Parse a human time string, and return a time in nanoseconds.
+ *
+ * Parses an option argument from string arg, in the format
+ * "VALUE [UNIT]". The value may have a fractional part. The unit may be
+ * ns, us, ms or s; if there is no unit, the value is in seconds.
+ *
+ * If the argument is valid, the function stores the time in nanoseconds
+ * in the uint64_t pointed-to by result, and returns zero. If the argument
+ * is invalid, the function returns a nonzero error number: ERANGE for
+ * value too large, EINVAL for invalid format.
+ */
+int parse_human_time(const char *arg, uint64_t *result)
+{
+    char *end;
+    long double value;
+    int unit_exp;
+
+    errno = 0;
+    value = strtold(arg, &end);
+
+    if (end == arg || value < 0 || isnan(value))
+        return EINVAL;
+
+    if (errno == ERANGE)
+        return ERANGE;
+
+    /* skip trailing whitespace */
+    while (isspace(*end))
+        end++;
+
+    if (*end == '\0')
+        unit_exp = NUM_SECOND_FRACTION_UNITS - 1;
+    else
+    {
+        unit_exp = str_in_array(SECOND_FRACTION_UNITS,
+                                NUM_SECOND_FRACTION_UNITS, end);
+        if (unit_exp < 0)
+            return EINVAL;
+    }
+
+    for (; unit_exp > 0; unit_exp--)
+        value *= 1000;
+
+    if (value > (long double)UINT64_MAX)
+        return ERANGE;
+
+    *result = (uint64_t)value;
+    return 0;
+}
+
 /* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
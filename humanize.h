@@ -69,4 +69,6 @@ char *humanize_time(uint64_t nanoseconds, int seconds_precision);
 
 int parse_human_size(const char *arg, uint64_t *result);
 
+int parse_human_time(const char *arg, uint64_t *result);
+
 #endif  /* _HUMANIZE_H */
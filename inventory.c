@@ -0,0 +1,517 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* inventory.c - host-wide inventory with quick probes
+ *
+ * Finds every disk in /sys/block, and runs a quick probe on each one: a
+ * sequential read phase and a random read phase. Disks are grouped by the
+ * controller (or PCI root) they hang off; groups are probed in parallel,
+ * but the disks within a group one at a time, so that probes don't
+ * contend for the same controller.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "sysfs.h"
+#include "watchdog.h"
+#include "workload.h"
+#include "inventory.h"
+
+
+/* Transfer size of the sequential phase. */
+#define SEQ_READ_BYTES MIB
+
+/* Transfer size of the random phase. */
+#define RAND_READ_BYTES 4096
+
+/* Maximum length of a group's name, including terminator. */
+#define GROUP_NAME_LEN 64
+
+/* Group of devices with no controller (loop, zram, ...). */
+#define VIRTUAL_GROUP "virtual"
+
+
+struct inv_device {
+    char name[NAME_MAX + 1];
+    char group[GROUP_NAME_LEN];
+    const char *skipped;        /* reason not to probe; NULL = probe */
+    int error;                  /* errno, if the probe failed */
+    uint64_t size;
+    uint64_t seed;
+
+    /* results */
+    uint64_t seq_bytes;
+    uint64_t seq_ns;
+    struct latency_stats rand_stats;
+    uint64_t rand_bytes;
+    uint64_t rand_ns;
+};
+
+struct inv_group {
+    const char *name;
+    struct inv_device **devices;
+    unsigned int count;
+    uint64_t phase_ns;
+};
+
+
+
+/*
+ * Check whether a /sys/devices path component is a PCI function address,
+ * e.g. "0000:00:1f.2".
+ */
+static int is_pci_address(const char *s)
+{
+    unsigned int domain, bus, dev, fn;
+    int len = 0;
+
+    return sscanf(s, "%4x:%2x:%2x.%1x%n", &domain, &bus, &dev, &fn, &len) == 4
+           && s[len] == '\0';
+}
+
+
+
+/*
+ * Find a disk's group, from its path in /sys/devices. With by_root, the
+ * group is the PCI root complex (e.g. "pci0000:00"); otherwise it's the
+ * PCI function of the controller (e.g. "0000:00:1f.2"). Devices not on
+ * PCI are grouped by their bus, and virtual devices together.
+ */
+static void get_device_group(const char *name, int by_root, char *group)
+{
+    char link[PATH_MAX], resolved[PATH_MAX];
+    const char *found = NULL;
+    char *component, *saveptr = NULL;
+    int depth = 0;
+
+    snprintf(link, sizeof(link), "/sys/block/%s", name);
+
+    if (realpath(link, resolved) == NULL
+        || strncmp(resolved, "/sys/devices/virtual/", 21) == 0)
+    {
+        snprintf(group, GROUP_NAME_LEN, "%s", VIRTUAL_GROUP);
+        return;
+    }
+
+    for (component = strtok_r(resolved + strlen("/sys/devices/"), "/", &saveptr);
+         component != NULL;
+         component = strtok_r(NULL, "/", &saveptr), depth++)
+    {
+        if (depth == 0)
+            found = component;      /* bus or root complex */
+        else if (!by_root && is_pci_address(component))
+            found = component;      /* deepest PCI function so far */
+    }
+
+    snprintf(group, GROUP_NAME_LEN, "%s", found != NULL ? found : VIRTUAL_GROUP);
+}
+
+
+
+/*
+ * Find the disks in /sys/block, and decide which ones to probe.
+ *
+ * Skips disks with no media, and, unless include_busy is true, those in
+ * use (mounted, used as swap, or held by device mapper or md). Partitions
+ * are never listed in /sys/block, so only whole disks are probed.
+ *
+ * Returns a newly allocated array of devices, and stores their count in
+ * *p_count. Exits in case of error.
+ */
+static struct inv_device *find_devices(int include_busy, int by_root,
+        unsigned int *p_count)
+{
+    struct inv_device *devices = NULL;
+    unsigned int count = 0, capacity = 0;
+    struct dirent *entry;
+    DIR *dir;
+
+    dir = opendir("/sys/block");
+    die_if(dir == NULL, "/sys/block");
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        struct inv_device *dev;
+        char sys_dir[PATH_MAX], path[PATH_MAX];
+        char *size, *p;
+        int fd;
+
+        if (entry->d_name[0] == '.')
+            continue;
+
+        if (count == capacity)
+        {
+            capacity = capacity != 0 ? 2 * capacity : 16;
+            devices = realloc(devices, capacity * sizeof(*devices));
+            die_if(devices == NULL, "realloc");
+        }
+
+        dev = &devices[count++];
+        memset(dev, 0, sizeof(*dev));
+        snprintf(dev->name, sizeof(dev->name), "%s", entry->d_name);
+        get_device_group(dev->name, by_root, dev->group);
+
+        snprintf(sys_dir, sizeof(sys_dir), "/sys/block/%s", dev->name);
+        size = sysfs_read_attr(sys_dir, "size");
+        dev->size = size != NULL ? strtoull(size, NULL, 10) * 512 : 0;
+        free(size);
+
+        if (dev->size == 0)
+        {
+            dev->skipped = "no media";
+            continue;
+        }
+
+        /* sysfs names use '!' where /dev has subdirectories */
+        snprintf(path, sizeof(path), "/dev/%s", dev->name);
+        for (p = path; *p != '\0'; p++)
+            if (*p == '!')
+                *p = '/';
+
+        /* exclusive opens fail while the device is mounted or held */
+        fd = open(path, O_RDONLY | O_EXCL);
+        if (fd == -1 && errno == EBUSY)
+        {
+            if (!include_busy)
+                dev->skipped = "in use";
+        }
+        else if (fd == -1)
+        {
+            dev->skipped = "can't open";
+            dev->error = errno;
+        }
+        else
+            close(fd);
+    }
+
+    closedir(dir);
+
+    *p_count = count;
+    return devices;
+}
+
+
+
+/*
+ * Read sequentially from fd for phase_ns, in SEQ_READ_BYTES transfers,
+ * wrapping around at the end of the device. Returns zero on success, or
+ * an error number.
+ */
+static int probe_sequential(int fd, const struct blkdev_info *info,
+        uint64_t phase_ns, struct inv_device *dev)
+{
+    const size_t size = min(align_ceil(SEQ_READ_BYTES, info->alignment),
+                            (size_t)(info->num_blocks * info->block_size));
+    uint64_t start_ns, offset = 0, now_ns;
+    void *buffer;
+    int error;
+
+    error = try_allocate_aligned_memory(info->alignment, size, &buffer);
+    if (error != 0)
+        return error;
+
+    start_ns = now_ns = get_cur_ns();
+    while (now_ns - start_ns < phase_ns && !watchdog_aborting())
+    {
+        const int slot = watchdog_begin(fd, offset, size);
+        const ssize_t retval = pread64(fd, buffer, size, (off64_t)offset);
+
+        watchdog_end(slot);
+
+        if (retval < 0)
+        {
+            error = errno;
+            break;
+        }
+
+        dev->seq_bytes += size;
+        offset += size;
+        if (offset + size > info->dev_size)
+            offset = 0;
+
+        now_ns = get_cur_ns();
+    }
+
+    dev->seq_ns = now_ns - start_ns;
+    free(buffer);
+
+    return error;
+}
+
+
+
+/*
+ * Do random reads from fd, one at a time, for phase_ns. Returns zero on
+ * success, or an error number.
+ */
+static int probe_random(int fd, const struct blkdev_info *info,
+        uint64_t phase_ns, struct inv_device *dev)
+{
+    const size_t size = align_ceil(RAND_READ_BYTES, info->block_size);
+    const uint64_t choices = info->num_blocks > size / info->block_size
+                             ? info->num_blocks - size / info->block_size + 1
+                             : 1;
+    uint64_t start_ns, now_ns;
+    struct sample_buf lat;
+    void *buffer;
+    int error;
+
+    error = try_allocate_aligned_memory(info->alignment, size, &buffer);
+    if (error != 0)
+        return error;
+
+    sample_buf_init(&lat);
+
+    start_ns = now_ns = get_cur_ns();
+    while (now_ns - start_ns < phase_ns && !watchdog_aborting())
+    {
+        const uint64_t offset = (random64_r(&dev->seed) % choices)
+                                * info->block_size;
+        const int slot = watchdog_begin(fd, offset, size);
+        const uint64_t t0 = get_cur_ns();
+        const ssize_t retval = pread64(fd, buffer, size, (off64_t)offset);
+
+        now_ns = get_cur_ns();
+        watchdog_end(slot);
+
+        if (retval < 0)
+        {
+            error = errno;
+            break;
+        }
+
+        sample_buf_add(&lat, now_ns - t0);
+        dev->rand_bytes += size;
+    }
+
+    dev->rand_ns = now_ns - start_ns;
+    get_latency_stats(&lat, &dev->rand_stats);
+    sample_buf_free(&lat);
+    free(buffer);
+
+    return error;
+}
+
+
+
+/*
+ * Probe one device: a sequential phase, then a random phase. Errors are
+ * stored in the device, rather than exiting, so one failing disk doesn't
+ * stop the inventory.
+ */
+static void probe_device(struct inv_device *dev, uint64_t phase_ns)
+{
+    struct blkdev_info info;
+    char path[PATH_MAX];
+    char *p;
+    int fd;
+
+    snprintf(path, sizeof(path), "/dev/%s", dev->name);
+    for (p = path; *p != '\0'; p++)
+        if (*p == '!')
+            *p = '/';
+
+    printf("Probing %s (%s)...\n", dev->name, dev->group);
+
+    fd = open(path, O_RDONLY | O_DIRECT);
+    if (fd == -1)
+    {
+        dev->error = errno;
+        return;
+    }
+
+    dev->error = try_get_blkdev_info(fd, &info, NULL);
+    if (dev->error != 0)
+    {
+        close(fd);
+        return;
+    }
+
+    dev->error = probe_sequential(fd, &info, phase_ns, dev);
+    if (dev->error == 0)
+        dev->error = probe_random(fd, &info, phase_ns, dev);
+
+    close(fd);
+}
+
+
+
+/*
+ * Group thread. Probes each device of its group in turn.
+ */
+static void *group_main(void *arg)
+{
+    const struct thread_arg *const targ = arg;
+    struct inv_group *const group = targ->data;
+    unsigned int i;
+
+    pthread_barrier_wait(targ->start);
+
+    for (i=0; i<group->count; i++)
+        probe_device(group->devices[i], group->phase_ns);
+
+    return NULL;
+}
+
+
+
+/*
+ * Sort devices by group, then by name, so that each group's devices are
+ * contiguous.
+ */
+static int cmp_device(const void *a, const void *b)
+{
+    const struct inv_device *const x = a;
+    const struct inv_device *const y = b;
+    const int by_group = strcmp(x->group, y->group);
+
+    return by_group != 0 ? by_group : strverscmp(x->name, y->name);
+}
+
+
+
+/*
+ * Run the host-wide inventory, and print the results. devname is
+ * ignored; every disk in the system is considered.
+ *
+ * Each device gets a sequential and a random phase, each of half of
+ * opts->duration_ns. Exits in case of error.
+ */
+void run_and_print_inventory(const char *devname,
+        const struct bench_options *opts)
+{
+    struct inv_device *devices;
+    struct inv_group *groups;
+    struct inv_device **probed;
+    unsigned int num_devices, num_groups = 0, num_probed = 0;
+    char *phase;
+    unsigned int i;
+
+    (void)devname;
+
+    devices = find_devices(opts->include_busy, opts->group_by_root,
+                           &num_devices);
+    qsort(devices, num_devices, sizeof(*devices), cmp_device);
+
+    probed = malloc(max(num_devices, 1U) * sizeof(*probed));
+    groups = malloc(max(num_devices, 1U) * sizeof(*groups));
+    die_if(probed == NULL || groups == NULL, "malloc");
+
+    init_randomness();
+
+    /* devices are sorted by group; split the probed ones into groups */
+    for (i=0; i<num_devices; i++)
+    {
+        struct inv_device *const dev = &devices[i];
+
+        if (dev->skipped != NULL)
+            continue;
+
+        dev->seed = random64();
+        probed[num_probed] = dev;
+
+        if (num_groups == 0 || strcmp(groups[num_groups-1].name, dev->group) != 0)
+        {
+            groups[num_groups].name = dev->group;
+            groups[num_groups].devices = &probed[num_probed];
+            groups[num_groups].count = 0;
+            groups[num_groups].phase_ns = opts->duration_ns / 2;
+            num_groups++;
+        }
+
+        groups[num_groups-1].count++;
+        num_probed++;
+    }
+
+    phase = humanize_time(opts->duration_ns / 2, 3);
+
+    if (num_groups > 0)
+    {
+        printf("Probing %u device(s) in %u group(s), %s sequential and %s random each, please wait...\n",
+               num_probed, num_groups, phase, phase);
+        run_threads(group_main, groups, sizeof(groups[0]), num_groups);
+    }
+
+    printf("\n"
+           " %-12s %-14s %10s %13s %10s %11s %11s  %s\n",
+           "device", "group", "size", "sequential", "rand IOPS", "rand p50",
+           "rand p99", "status");
+
+    for (i=0; i<num_devices; i++)
+    {
+        const struct inv_device *const dev = &devices[i];
+        const struct human_value size = humanize_binary_size(dev->size);
+
+        if (dev->skipped != NULL || dev->error != 0)
+        {
+            printf(" %-12s %-14s %6.1Lf %-3s %13s %10s %11s %11s  %s\n",
+                   dev->name, dev->group, size.value, size.unit, "-", "-",
+                   "-", "-",
+                   dev->error != 0 ? strerror(dev->error) : dev->skipped);
+        }
+        else
+        {
+            const struct human_value seq = humanize_binary_speed(
+                    dev->seq_bytes / ((long double)max(dev->seq_ns, (uint64_t)1) / NS_PER_SEC));
+            char *const p50 = humanize_time(dev->rand_stats.p50, 3);
+            char *const p99 = humanize_time(dev->rand_stats.p99, 3);
+
+            printf(" %-12s %-14s %6.1Lf %-3s %7.2Lf %-5s %10.1Lf %11s %11s  %s\n",
+                   dev->name, dev->group, size.value, size.unit,
+                   seq.value, seq.unit,
+                   dev->rand_stats.count
+                       / ((long double)max(dev->rand_ns, (uint64_t)1) / NS_PER_SEC),
+                   p50, p99, "ok");
+
+            free(p50);
+            free(p99);
+        }
+    }
+
+    free(phase);
+    free(groups);
+    free(probed);
+    free(devices);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
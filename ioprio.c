@@ -0,0 +1,331 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* ioprio.c - I/O priority class contention test
+ *
+ * Runs one random read worker per I/O priority, all at the same time, and
+ * reports how each one fared. This shows whether the I/O scheduler (and
+ * the device) actually favour higher priorities under contention.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <linux/ioprio.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "sysfs.h"
+#include "workload.h"
+#include "ioprio.h"
+
+
+/* Maximum number of competing priorities. */
+#define MAX_IOPRIOS 32
+
+/* Default priorities to compete: every class and level. */
+#define DEFAULT_IOPRIO_LIST "rt:4,be:0,be:1,be:2,be:3,be:4,be:5,be:6,be:7,idle"
+
+
+/* The scheduler in use before --all-schedulers, while it's changed. */
+static struct {
+    int changed;
+    char path[PATH_MAX + sizeof("/queue/scheduler")];
+    char name[IO_SCHEDULER_NAME_LEN];
+} orig_sched;
+
+
+
+/*
+ * Parse a list of I/O priorities.
+ *
+ * list is a comma-separated list of CLASS[:LEVEL] entries, where CLASS is
+ * rt, be or idle, and LEVEL is 0 (highest) to 7 (lowest). The level
+ * defaults to 4 and is ignored for the idle class. Stores each priority,
+ * as built by IOPRIO_PRIO_VALUE, in the array ioprios, which holds up to
+ * max_count values.
+ *
+ * Returns the number of priorities parsed, or -1 if the list is invalid.
+ */
+int parse_ioprio_list(const char *list, int *ioprios, int max_count)
+{
+    char *copy = strdup(list);
+    char *saveptr = NULL;
+    char *entry;
+    int count = 0;
+
+    die_if(copy == NULL, "strdup");
+
+    for (entry = strtok_r(copy, ",", &saveptr); entry != NULL;
+         entry = strtok_r(NULL, ",", &saveptr))
+    {
+        char *level_str = strchr(entry, ':');
+        unsigned long level = IOPRIO_NORM;
+        int class;
+
+        if (level_str != NULL)
+        {
+            char *end;
+
+            *level_str++ = '\0';
+            level = strtoul(level_str, &end, 10);
+            if (*level_str == '\0' || *end != '\0' || level >= IOPRIO_NR_LEVELS)
+                goto invalid;
+        }
+
+        if (strcmp(entry, "rt") == 0)
+            class = IOPRIO_CLASS_RT;
+        else if (strcmp(entry, "be") == 0)
+            class = IOPRIO_CLASS_BE;
+        else if (strcmp(entry, "idle") == 0)
+        {
+            class = IOPRIO_CLASS_IDLE;
+            level = 0;
+        }
+        else
+            goto invalid;
+
+        if (count >= max_count)
+            goto invalid;
+
+        ioprios[count++] = IOPRIO_PRIO_VALUE(class, level);
+    }
+
+    free(copy);
+    return count > 0 ? count : -1;
+
+invalid:
+    free(copy);
+    return -1;
+}
+
+
+
+/*
+ * Format an I/O priority as a label, e.g. "BE/4". Stores the label in
+ * buf, which is of the specified size.
+ */
+static void format_ioprio(char *buf, size_t size, int ioprio)
+{
+    const unsigned int level = IOPRIO_PRIO_DATA(ioprio);
+
+    switch (IOPRIO_PRIO_CLASS(ioprio))
+    {
+        case IOPRIO_CLASS_RT:
+            snprintf(buf, size, "RT/%u", level);
+            break;
+        case IOPRIO_CLASS_BE:
+            snprintf(buf, size, "BE/%u", level);
+            break;
+        case IOPRIO_CLASS_IDLE:
+            snprintf(buf, size, "IDLE");
+            break;
+        default:
+            snprintf(buf, size, "none");
+    }
+}
+
+
+
+/*
+ * Run all priorities against each other once, and print the results.
+ */
+static void run_ioprio_phase(int fd, const struct blkdev_info *info,
+        const int *ioprios, int count, const struct bench_options *opts,
+        const char *scheduler)
+{
+    struct rr_worker workers[MAX_IOPRIOS];
+    int i;
+
+    assert(count > 0 && count <= MAX_IOPRIOS);
+
+    printf("Running %d competing random readers under the %s scheduler, please wait...\n",
+           count, scheduler);
+
+    for (i=0; i<count; i++)
+    {
+        init_rr_worker(&workers[i], fd, info, info->block_size,
+                opts->duration_ns);
+        workers[i].ioprio = ioprios[i];
+        workers[i].request_prio = opts->request_prio;
+    }
+
+    run_random_read_workers(workers, count);
+
+    printf("\n"
+           " Scheduler: %s\n",
+           scheduler);
+    print_stats_header("priority");
+
+    for (i=0; i<count; i++)
+    {
+        struct latency_stats stats;
+        char label[16];
+
+        format_ioprio(label, sizeof(label), ioprios[i]);
+        get_latency_stats(&workers[i].lat, &stats);
+        print_stats_row(label, &stats, workers[i].bytes,
+                workers[i].elapsed_ns);
+
+        sample_buf_free(&workers[i].lat);
+    }
+
+    printf("\n");
+}
+
+
+
+/*
+ * Put back the original scheduler, if it's still changed. Registered with
+ * register_restore, so that it also runs if hdtime dies or is killed
+ * halfway through the schedulers; thus the plain system calls.
+ */
+static void restore_scheduler(void)
+{
+    ssize_t written;
+    int fd;
+
+    if (!orig_sched.changed)
+        return;
+    orig_sched.changed = 0;
+
+    fd = open(orig_sched.path, O_WRONLY);
+    if (fd < 0)
+        return;
+
+    written = write(fd, orig_sched.name, strlen(orig_sched.name));
+    (void)written;
+    close(fd);
+}
+
+
+
+/*
+ * Run the I/O priority contention test on a block device, and print the
+ * results.
+ *
+ * One random reader per priority in opts->ioprio_list competes with all
+ * others, for opts->duration_ns. With opts->all_schedulers, the test is
+ * repeated under each available I/O scheduler, and the original one is
+ * restored at the end. Exits in case of error.
+ */
+void run_and_print_ioprio(const char *devname,
+        const struct bench_options *opts)
+{
+    const char *list = opts->ioprio_list != NULL
+                       ? opts->ioprio_list : DEFAULT_IOPRIO_LIST;
+    struct blkdev_info info;
+    struct io_schedulers scheds;
+    char disk_dir[PATH_MAX];
+    int ioprios[MAX_IOPRIOS];
+    char *duration;
+    int count;
+    int retval;
+    int fd;
+
+    count = parse_ioprio_list(list, ioprios, MAX_IOPRIOS);
+    if (count < 0)
+    {
+        fprintf(stderr, "error: invalid I/O priority list '%s'\n", list);
+        exit(1);
+    }
+
+    fd = open_blkdev(devname);
+    get_blkdev_info(fd, &info);
+    init_randomness();
+
+    retval = sysfs_disk_dir(fd, disk_dir, sizeof(disk_dir));
+    if (retval == 0)
+        retval = get_io_schedulers(disk_dir, &scheds);
+
+    if (retval != 0 || scheds.current < 0)
+    {
+        die_if_with_errno(opts->all_schedulers, "queue/scheduler",
+                retval != 0 ? retval : EINVAL);
+        scheds.count = 1;
+        scheds.current = 0;
+        strcpy(scheds.names[0], "unknown");
+    }
+
+    duration = humanize_time(opts->duration_ns, 3);
+    printf("%s: %u-byte random reads for %s, priorities set per %s\n",
+           devname, info.block_size, duration,
+           opts->request_prio ? "request (AIO)" : "thread (ioprio_set)");
+    free(duration);
+
+    if (opts->all_schedulers)
+    {
+        const int orig = scheds.current;
+        int i;
+
+        snprintf(orig_sched.path, sizeof(orig_sched.path),
+                 "%s/queue/scheduler", disk_dir);
+        snprintf(orig_sched.name, sizeof(orig_sched.name), "%s",
+                 scheds.names[orig]);
+        orig_sched.changed = 1;
+        register_restore(restore_scheduler);
+
+        for (i=0; i<scheds.count; i++)
+        {
+            retval = set_io_scheduler(disk_dir, scheds.names[i]);
+            if (retval != 0)
+            {
+                fprintf(stderr, "warning: can't select scheduler %s: %s\n",
+                        scheds.names[i], strerror(retval));
+                continue;
+            }
+
+            run_ioprio_phase(fd, &info, ioprios, count, opts,
+                    scheds.names[i]);
+        }
+
+        orig_sched.changed = 0;
+        retval = set_io_scheduler(disk_dir, scheds.names[orig]);
+        if (retval != 0)
+            fprintf(stderr, "warning: can't restore scheduler %s: %s\n",
+                    scheds.names[orig], strerror(retval));
+    }
+    else
+    {
+        run_ioprio_phase(fd, &info, ioprios, count, opts,
+                scheds.names[scheds.current]);
+    }
+
+    close(fd);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
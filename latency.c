@@ -0,0 +1,481 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* latency.c - latency sample collection and statistics */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+
+
+/* Initial capacity of a struct sample_buf, in samples. */
+#define INITIAL_SAMPLE_CAPACITY 4096
+
+/* Two-sided 95% quantile of the normal distribution. Fits are done over
+ * hundreds of samples, so it's close enough to Student's t. */
+#define Z_95 1.96
+
+
+
+/*
+ * Initialize an empty struct sample_buf. No memory is allocated until the
+ * first sample is added.
+ */
+void sample_buf_init(struct sample_buf *buf)
+{
+    buf->ns = NULL;
+    buf->count = 0;
+    buf->capacity = 0;
+}
+
+
+
+/*
+ * Make sure buf has room for at least needed samples. Exits in case of
+ * error.
+ */
+static void sample_buf_reserve(struct sample_buf *buf, size_t needed)
+{
+    size_t new_capacity;
+
+    if (needed <= buf->capacity)
+        return;
+
+    new_capacity = max(buf->capacity * 2, (size_t)INITIAL_SAMPLE_CAPACITY);
+    new_capacity = max(new_capacity, needed);
+
+    buf->ns = realloc(buf->ns, new_capacity * sizeof(buf->ns[0]));
+    die_if(buf->ns == NULL, "realloc");
+    buf->capacity = new_capacity;
+}
+
+
+
+/*
+ * Add a latency sample, in nanoseconds, to buf. Exits in case of error.
+ */
+void sample_buf_add(struct sample_buf *buf, uint64_t ns)
+{
+    sample_buf_reserve(buf, buf->count + 1);
+
+    buf->ns[buf->count++] = ns;
+}
+
+
+
+/*
+ * Append all samples in src to dst. Exits in case of error.
+ */
+void sample_buf_append(struct sample_buf *dst, const struct sample_buf *src)
+{
+    if (src->count == 0)
+        return;
+
+    sample_buf_reserve(dst, dst->count + src->count);
+
+    memcpy(dst->ns + dst->count, src->ns, src->count * sizeof(src->ns[0]));
+    dst->count += src->count;
+}
+
+
+
+/*
+ * Release the memory held by buf, and leave it empty.
+ */
+void sample_buf_free(struct sample_buf *buf)
+{
+    free(buf->ns);
+    sample_buf_init(buf);
+}
+
+
+
+/*
+ * Compare two uint64_t values, for qsort.
+ */
+int cmp_uint64(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+
+/*
+ * Get a percentile from an array of n sorted values.
+ *
+ * Uses the nearest-rank method. pct is the percentile, from 0 to 100. n
+ * must not be zero.
+ */
+uint64_t percentile_sorted(const uint64_t *sorted, size_t n, double pct)
+{
+    size_t rank;
+
+    assert(n > 0);
+
+    rank = (size_t)ceil(pct / 100.0 * n);
+
+    return sorted[rank > 0 ? min(rank, n) - 1 : 0];
+}
+
+
+
+/*
+ * Calculate latency statistics from a set of samples.
+ *
+ * Sorts the samples in buf, as a side effect. If buf is empty, all
+ * statistics are set to zero.
+ */
+void get_latency_stats(struct sample_buf *buf, struct latency_stats *stats)
+{
+    long double sum = 0;
+    size_t i;
+
+    memset(stats, 0, sizeof(*stats));
+
+    if (buf->count == 0)
+        return;
+
+    qsort(buf->ns, buf->count, sizeof(buf->ns[0]), cmp_uint64);
+
+    for (i=0; i<buf->count; i++)
+        sum += buf->ns[i];
+
+    stats->count = buf->count;
+    stats->min = buf->ns[0];
+    stats->max = buf->ns[buf->count - 1];
+    stats->mean = (uint64_t)(sum / buf->count);
+    stats->p50 = percentile_sorted(buf->ns, buf->count, 50);
+    stats->p90 = percentile_sorted(buf->ns, buf->count, 90);
+    stats->p99 = percentile_sorted(buf->ns, buf->count, 99);
+    stats->p999 = percentile_sorted(buf->ns, buf->count, 99.9);
+}
+
+
+
+/*
+ * Initialize an empty struct latency_hist.
+ */
+void latency_hist_init(struct latency_hist *hist)
+{
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+
+
+/*
+ * Get the histogram bucket of a value. Values below 2^LATENCY_HIST_SUB_BITS
+ * have a bucket each; above that, each power of 2 is split in
+ * 2^LATENCY_HIST_SUB_BITS buckets.
+ */
+static unsigned int latency_hist_bucket(uint64_t ns)
+{
+    const uint64_t sub = 1ULL << LATENCY_HIST_SUB_BITS;
+    unsigned int msb, shift;
+
+    if (ns < sub)
+        return (unsigned int)ns;
+
+    msb = 63 - __builtin_clzll(ns);
+    shift = msb - LATENCY_HIST_SUB_BITS;
+
+    return (unsigned int)(((shift + 1) << LATENCY_HIST_SUB_BITS)
+                          + ((ns >> shift) - sub));
+}
+
+
+
+/*
+ * Get the value in the middle of a histogram bucket.
+ */
+static uint64_t latency_hist_value(unsigned int bucket)
+{
+    const uint64_t sub = 1ULL << LATENCY_HIST_SUB_BITS;
+    unsigned int shift;
+
+    if (bucket < sub)
+        return bucket;
+
+    shift = (bucket >> LATENCY_HIST_SUB_BITS) - 1;
+
+    return ((bucket % sub + sub) << shift) + ((1ULL << shift) - 1) / 2;
+}
+
+
+
+/*
+ * Add a latency sample, in nanoseconds, to hist.
+ */
+void latency_hist_add(struct latency_hist *hist, uint64_t ns)
+{
+    hist->buckets[latency_hist_bucket(ns)]++;
+    hist->count++;
+    hist->sum += ns;
+    hist->min = min(hist->min, ns);
+    hist->max = max(hist->max, ns);
+}
+
+
+
+/*
+ * Add all samples in src to dst.
+ */
+void latency_hist_merge(struct latency_hist *dst,
+        const struct latency_hist *src)
+{
+    unsigned int i;
+
+    for (i=0; i<LATENCY_HIST_BUCKETS; i++)
+        dst->buckets[i] += src->buckets[i];
+
+    dst->count += src->count;
+    dst->sum += src->sum;
+    dst->min = min(dst->min, src->min);
+    dst->max = max(dst->max, src->max);
+}
+
+
+
+/*
+ * Get a percentile from a histogram, using the nearest-rank method like
+ * percentile_sorted. The result is the middle of the bucket, kept within
+ * the histogram's minimum and maximum. hist must not be empty.
+ */
+static uint64_t percentile_hist(const struct latency_hist *hist, double pct)
+{
+    uint64_t rank, seen = 0;
+    unsigned int i;
+
+    assert(hist->count > 0);
+
+    rank = max((uint64_t)ceil(pct / 100.0 * hist->count), (uint64_t)1);
+
+    for (i=0; i<LATENCY_HIST_BUCKETS - 1; i++)
+    {
+        seen += hist->buckets[i];
+        if (seen >= rank)
+            break;
+    }
+
+    return min(max(latency_hist_value(i), hist->min), hist->max);
+}
+
+
+
+/*
+ * Calculate latency statistics from a histogram. Percentiles are
+ * approximate, see LATENCY_HIST_SUB_BITS; the rest are exact. If hist is
+ * empty, all statistics are set to zero.
+ */
+void get_hist_latency_stats(const struct latency_hist *hist,
+        struct latency_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    if (hist->count == 0)
+        return;
+
+    stats->count = hist->count;
+    stats->min = hist->min;
+    stats->max = hist->max;
+    stats->mean = (uint64_t)(hist->sum / hist->count);
+    stats->p50 = percentile_hist(hist, 50);
+    stats->p90 = percentile_hist(hist, 90);
+    stats->p99 = percentile_hist(hist, 99);
+    stats->p999 = percentile_hist(hist, 99.9);
+}
+
+
+
+/*
+ * Get the two-sided 95% quantile of Student's t distribution with df
+ * degrees of freedom, for confidence intervals from few samples. Exact
+ * up to 30 degrees of freedom; approximated above that.
+ */
+double t_quantile_95(size_t df)
+{
+    static const double table[30] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+        2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101,
+        2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052,
+        2.048, 2.045, 2.042,
+    };
+
+    if (df == 0)
+        return INFINITY;
+    if (df <= 30)
+        return table[df - 1];
+
+    /* first terms of the Cornish-Fisher expansion around the normal */
+    return Z_95 + (Z_95 * Z_95 * Z_95 + Z_95) / (4.0 * df);
+}
+
+
+
+/*
+ * Calculate the mean of n values, and the half-width of its 95%
+ * confidence interval (infinite if n < 2).
+ */
+void get_mean_ci(const double *x, size_t n, double *p_mean, double *p_ci)
+{
+    double mean = 0, var = 0;
+    size_t i;
+
+    for (i=0; i<n; i++)
+        mean += x[i];
+    mean = n > 0 ? mean / n : 0;
+
+    for (i=0; i<n; i++)
+        var += (x[i] - mean) * (x[i] - mean);
+
+    *p_mean = mean;
+    *p_ci = n > 1 ? t_quantile_95(n - 1) * sqrt(var / (n - 1) / n) : INFINITY;
+}
+
+
+
+/*
+ * Fit a line to n points (x[i], y[i]) by ordinary least squares.
+ *
+ * Besides the intercept and slope, estimates their 95% confidence
+ * intervals from the residuals, and the fit's R^2. With fewer than 3
+ * points, or if all x are equal, only what can be estimated is set; the
+ * rest is zero.
+ */
+void fit_linear(const double *x, const double *y, size_t n,
+        struct linear_fit *fit)
+{
+    double mean_x = 0, mean_y = 0;
+    double sxx = 0, sxy = 0, syy = 0, ssr = 0, t;
+    size_t i;
+
+    memset(fit, 0, sizeof(*fit));
+    fit->count = n;
+
+    if (n == 0)
+        return;
+
+    for (i=0; i<n; i++)
+    {
+        mean_x += x[i];
+        mean_y += y[i];
+    }
+    mean_x /= n;
+    mean_y /= n;
+
+    for (i=0; i<n; i++)
+    {
+        const double dx = x[i] - mean_x;
+        const double dy = y[i] - mean_y;
+
+        sxx += dx * dx;
+        sxy += dx * dy;
+        syy += dy * dy;
+    }
+
+    fit->slope = sxx > 0 ? sxy / sxx : 0;
+    fit->intercept = mean_y - fit->slope * mean_x;
+
+    if (n < 3 || sxx == 0)
+        return;
+
+    for (i=0; i<n; i++)
+    {
+        const double residual = y[i] - (fit->intercept + fit->slope * x[i]);
+
+        ssr += residual * residual;
+    }
+
+    /* residual variance, with n-2 degrees of freedom */
+    ssr /= n - 2;
+
+    t = t_quantile_95(n - 2);
+    fit->slope_ci = t * sqrt(ssr / sxx);
+    fit->intercept_ci = t * sqrt(ssr * (1.0 / n + mean_x * mean_x / sxx));
+    fit->r2 = syy > 0 ? sxy * sxy / (sxx * syy) : 1;
+}
+
+
+
+/*
+ * Print the header for a table of rows printed by print_stats_row.
+ *
+ * label_title is the title of the first column.
+ */
+void print_stats_header(const char *label_title)
+{
+    printf(" %-14s %10s %13s %11s %11s %11s %11s %11s\n",
+           label_title, "IOPS", "throughput", "mean", "p50", "p99",
+           "p99.9", "max");
+}
+
+
+
+/*
+ * Print a table row with throughput and latency statistics.
+ *
+ * Receives the row's label, the latency statistics, and the total amount
+ * of bytes transferred in elapsed_ns nanoseconds.
+ */
+void print_stats_row(const char *label, const struct latency_stats *stats,
+        uint64_t bytes, uint64_t elapsed_ns)
+{
+    const long double secs = (long double)max(elapsed_ns, (uint64_t)1) / NS_PER_SEC;
+    const struct human_value speed = humanize_binary_speed(bytes / secs);
+    char *const mean = humanize_time(stats->mean, 3);
+    char *const p50 = humanize_time(stats->p50, 3);
+    char *const p99 = humanize_time(stats->p99, 3);
+    char *const p999 = humanize_time(stats->p999, 3);
+    char *const max_ = humanize_time(stats->max, 3);
+
+    printf(" %-14s %10.1Lf %7.2Lf %-5s %11s %11s %11s %11s %11s\n",
+           label, stats->count / secs, speed.value, speed.unit,
+           mean, p50, p99, p999, max_);
+
+    free(mean);
+    free(p50);
+    free(p99);
+    free(p999);
+    free(max_);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
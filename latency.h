@@ -0,0 +1,121 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* latency.h - latency sample collection and statistics */
+
+
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+
+/* get size_t */
+#include <stddef.h>
+
+/* get uint64_t */
+#include <stdint.h>
+
+
+/* Growable array of latency samples, in nanoseconds. */
+struct sample_buf {
+    uint64_t *ns;
+    size_t count;
+    size_t capacity;
+};
+
+struct latency_stats {
+    size_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t mean;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+};
+
+/* Each power of 2 of a latency histogram is split in 2^LATENCY_HIST_SUB_BITS
+ * buckets, so values are kept to within about 3%. */
+#define LATENCY_HIST_SUB_BITS 5
+#define LATENCY_HIST_BUCKETS ((65 - LATENCY_HIST_SUB_BITS) << LATENCY_HIST_SUB_BITS)
+
+/* Fixed-size histogram of latencies, in nanoseconds. Unlike a struct
+ * sample_buf, adding to it never allocates. */
+struct latency_hist {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    long double sum;
+    uint64_t buckets[LATENCY_HIST_BUCKETS];
+};
+
+/* Least-squares fit of y = intercept + slope * x. */
+struct linear_fit {
+    size_t count;
+    double intercept;
+    double slope;
+    double intercept_ci;    /* half-width of the 95% confidence interval */
+    double slope_ci;        /* half-width of the 95% confidence interval */
+    double r2;              /* coefficient of determination */
+};
+
+
+void sample_buf_init(struct sample_buf *buf);
+
+void sample_buf_add(struct sample_buf *buf, uint64_t ns);
+
+void sample_buf_append(struct sample_buf *dst, const struct sample_buf *src);
+
+void sample_buf_free(struct sample_buf *buf);
+
+int cmp_uint64(const void *a, const void *b);
+
+uint64_t percentile_sorted(const uint64_t *sorted, size_t n, double pct);
+
+void get_latency_stats(struct sample_buf *buf, struct latency_stats *stats);
+
+void latency_hist_init(struct latency_hist *hist);
+
+void latency_hist_add(struct latency_hist *hist, uint64_t ns);
+
+void latency_hist_merge(struct latency_hist *dst,
+        const struct latency_hist *src);
+
+void get_hist_latency_stats(const struct latency_hist *hist,
+        struct latency_stats *stats);
+
+double t_quantile_95(size_t df);
+
+void get_mean_ci(const double *x, size_t n, double *p_mean, double *p_ci);
+
+void fit_linear(const double *x, const double *y, size_t n,
+        struct linear_fit *fit);
+
+void print_stats_header(const char *label_title);
+
+void print_stats_row(const char *label, const struct latency_stats *stats,
+        uint64_t bytes, uint64_t elapsed_ns);
+
+
+#endif  /* _LATENCY_H */
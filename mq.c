@@ -0,0 +1,569 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* mq.c - blk-mq hardware queue topology and worker placement
+ *
+ * A blk-mq device has one or more hardware queues (e.g. NVMe submission
+ * queues), each serving a set of CPUs; a request goes to the queue of the
+ * CPU that submits it. This mode lists the queues and their CPUs, then
+ * runs one worker per hardware queue under three placements: each worker
+ * pinned to a CPU of its own queue, workers left to the scheduler, and
+ * workers crowded onto as few queues as possible, so that they share
+ * hardware queues and their tags. Every pinned worker has a CPU of its
+ * own, so only the worker to queue mapping changes, not the CPU time each
+ * worker gets.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sched.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "mq.h"
+#include "openloop.h"
+#include "sysfs.h"
+#include "workload.h"
+
+
+/* Maximum number of hardware queues. */
+#define MAX_HW_QUEUES 256
+
+/* Default size of the reads. */
+#define DEFAULT_READ_BYTES 4096
+
+/* Default reads in flight, per worker. */
+#define DEFAULT_QUEUE_DEPTH 16
+
+/* Number of placements. */
+#define NUM_PLACEMENTS 3
+
+enum placement { PLACE_MATCHED, PLACE_UNPINNED, PLACE_CROWDED };
+
+static const char *const placement_names[NUM_PLACEMENTS] = {
+    "matched", "unpinned", "crowded",
+};
+
+
+struct hw_queue {
+    unsigned int index;
+    unsigned int num_tags;      /* 0 if unknown */
+    cpu_set_t cpus;
+    unsigned int num_usable;
+    cpu_set_t usable;           /* cpus we are allowed to run on */
+};
+
+struct mq_worker {
+    struct openloop_params p;
+    int cpu;                    /* to pin to, or -1 */
+    struct openloop_result res;
+    uint64_t cpu_ns;
+};
+
+struct placement_result {
+    struct latency_stats stats;
+    uint64_t bytes;
+    uint64_t elapsed_ns;
+    uint64_t cpu_ns;
+    double iops;
+};
+
+
+
+/*
+ * Parse a CPU list, as in "0, 1, 4-7", into a CPU set. Returns the number
+ * of CPUs, or -1 if the list is invalid.
+ */
+static int parse_cpu_list(const char *list, cpu_set_t *set)
+{
+    const char *p = list;
+    int count = 0;
+
+    CPU_ZERO(set);
+
+    while (*p != '\0')
+    {
+        unsigned long first, last;
+        char *end;
+
+        while (*p == ' ' || *p == ',')
+            p++;
+        if (*p == '\0')
+            break;
+
+        if (!isdigit((unsigned char)*p))
+            return -1;
+        first = last = strtoul(p, &end, 10);
+        if (*end == '-')
+            last = strtoul(end + 1, &end, 10);
+        if (last < first || last >= CPU_SETSIZE)
+            return -1;
+
+        for (; first <= last; first++)
+            if (!CPU_ISSET(first, set))
+            {
+                CPU_SET(first, set);
+                count++;
+            }
+
+        p = end;
+    }
+
+    return count;
+}
+
+
+
+/*
+ * Compare two hardware queues by index, for qsort.
+ */
+static int cmp_queues(const void *a, const void *b)
+{
+    const struct hw_queue *x = a, *y = b;
+
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+
+
+/*
+ * Read the hardware queues of a disk, from the mq directory of its sysfs
+ * directory. Each queue's usable CPUs are those of its CPUs that are also
+ * in allowed; queues with none are left out, and counted in *p_skipped.
+ * Returns the number of queues, sorted by index, or 0 if the disk isn't a
+ * blk-mq device.
+ */
+static unsigned int get_hw_queues(const char *disk_dir,
+        const cpu_set_t *allowed, struct hw_queue *queues,
+        unsigned int *p_skipped)
+{
+    char mq_dir[PATH_MAX + sizeof("/mq")];
+    char queue_dir[sizeof(mq_dir) + 16];
+    struct dirent *entry;
+    unsigned int count = 0;
+    DIR *d;
+
+    *p_skipped = 0;
+
+    snprintf(mq_dir, sizeof(mq_dir), "%s/mq", disk_dir);
+    if ((d = opendir(mq_dir)) == NULL)
+        return 0;
+
+    while ((entry = readdir(d)) != NULL && count < MAX_HW_QUEUES)
+    {
+        struct hw_queue *const q = &queues[count];
+        char *cpu_list, *tags;
+        int num_cpus;
+
+        if (!isdigit((unsigned char)entry->d_name[0]))
+            continue;
+
+        q->index = (unsigned int)strtoul(entry->d_name, NULL, 10);
+        snprintf(queue_dir, sizeof(queue_dir), "%s/%u", mq_dir, q->index);
+
+        cpu_list = sysfs_read_attr(queue_dir, "cpu_list");
+        num_cpus = cpu_list != NULL ? parse_cpu_list(cpu_list, &q->cpus) : -1;
+        free(cpu_list);
+
+        /* queues with no CPUs mapped get no requests */
+        if (num_cpus <= 0)
+            continue;
+
+        /* pinning to an offline CPU, or one outside our affinity, fails */
+        CPU_AND(&q->usable, &q->cpus, allowed);
+        q->num_usable = (unsigned int)CPU_COUNT(&q->usable);
+        if (q->num_usable == 0)
+        {
+            (*p_skipped)++;
+            continue;
+        }
+
+        tags = sysfs_read_attr(queue_dir, "nr_tags");
+        q->num_tags = tags != NULL ? (unsigned int)strtoul(tags, NULL, 10) : 0;
+        free(tags);
+
+        count++;
+    }
+    closedir(d);
+
+    qsort(queues, count, sizeof(*queues), cmp_queues);
+
+    return count;
+}
+
+
+
+/*
+ * Take the first CPU of a hardware queue that isn't in used yet, and add
+ * it to used. Returns the CPU, or -1 if all of the queue's CPUs are used.
+ */
+static int take_cpu(const struct hw_queue *q, cpu_set_t *used)
+{
+    int cpu;
+
+    for (cpu=0; cpu<CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &q->usable) && !CPU_ISSET(cpu, used))
+        {
+            CPU_SET(cpu, used);
+            return cpu;
+        }
+
+    return -1;
+}
+
+
+
+/*
+ * Compare two hardware queues by number of usable CPUs, most first, then
+ * by index, for qsort.
+ */
+static int cmp_queues_by_cpus(const void *a, const void *b)
+{
+    const struct hw_queue *x = *(const struct hw_queue *const *)a;
+    const struct hw_queue *y = *(const struct hw_queue *const *)b;
+
+    if (x->num_usable != y->num_usable)
+        return (x->num_usable < y->num_usable) - (x->num_usable > y->num_usable);
+
+    return cmp_queues(x, y);
+}
+
+
+
+/*
+ * Choose the CPUs of the workers of a placement, one per hardware queue,
+ * and store them in cpus (-1 for unpinned). Pinned workers never share a
+ * CPU, unless the queues share CPUs and there aren't enough.
+ *
+ * Returns the number of distinct queues the workers submit to.
+ */
+static unsigned int place_workers(const struct hw_queue *queues,
+        unsigned int num_queues, enum placement place, int *cpus)
+{
+    const struct hw_queue **by_cpus;
+    unsigned int i, distinct, j = 0, used_queues = 0;
+    cpu_set_t used, spare;
+
+    CPU_ZERO(&used);
+
+    if (place == PLACE_UNPINNED)
+    {
+        for (i=0; i<num_queues; i++)
+            cpus[i] = -1;
+        return num_queues;
+    }
+
+    if (place == PLACE_MATCHED)
+    {
+        for (i=0; i<num_queues; i++)
+        {
+            cpus[i] = take_cpu(&queues[i], &used);
+            if (cpus[i] < 0)
+            {
+                /* all its CPUs are shared with earlier queues */
+                CPU_ZERO(&spare);
+                cpus[i] = take_cpu(&queues[i], &spare);
+            }
+        }
+        return num_queues;
+    }
+
+    /* crowded: fill the queues with the most CPUs first, so that the
+     * workers land on as few queues as possible */
+    by_cpus = malloc(num_queues * sizeof(*by_cpus));
+    die_if(by_cpus == NULL, "malloc");
+
+    for (i=0; i<num_queues; i++)
+        by_cpus[i] = &queues[i];
+    qsort(by_cpus, num_queues, sizeof(*by_cpus), cmp_queues_by_cpus);
+
+    for (i=0; i<num_queues; i++)
+    {
+        cpus[i] = -1;
+        while (j < num_queues && (cpus[i] = take_cpu(by_cpus[j], &used)) < 0)
+            j++;
+
+        if (cpus[i] < 0)
+            break;
+        used_queues = j + 1;
+    }
+
+    /* the queues share CPUs, and there aren't enough: double up */
+    for (distinct = i; i < num_queues; i++)
+        cpus[i] = cpus[i % distinct];
+
+    free(by_cpus);
+
+    return used_queues;
+}
+
+
+
+static void *mq_worker_main(void *arg)
+{
+    struct thread_arg *t = arg;
+    struct mq_worker *w = t->data;
+    uint64_t cpu0;
+    int retval;
+
+    if (w->cpu >= 0)
+    {
+        retval = set_thread_cpu(w->cpu);
+        die_if_with_errno(retval != 0, "pthread_setaffinity_np", retval);
+    }
+
+    pthread_barrier_wait(t->start);
+
+    cpu0 = get_thread_cpu_ns();
+    run_open_loop(&w->p, &w->res);
+    w->cpu_ns = get_thread_cpu_ns() - cpu0;
+
+    return NULL;
+}
+
+
+
+/*
+ * Run one worker per hardware queue, pinned to cpus (-1 for unpinned),
+ * and store the combined results in res.
+ */
+static void run_placement(const struct openloop_params *base,
+        const int *cpus, unsigned int num_workers,
+        struct placement_result *res)
+{
+    struct mq_worker *workers = malloc(num_workers * sizeof(*workers));
+    struct sample_buf all;
+    unsigned int i;
+
+    die_if(workers == NULL, "malloc");
+
+    for (i=0; i<num_workers; i++)
+    {
+        workers[i].p = *base;
+        workers[i].p.seed = random64();
+        workers[i].cpu = cpus[i];
+    }
+
+    run_threads(mq_worker_main, workers, sizeof(*workers), num_workers);
+
+    res->bytes = 0;
+    res->elapsed_ns = 0;
+    res->cpu_ns = 0;
+    sample_buf_init(&all);
+
+    for (i=0; i<num_workers; i++)
+    {
+        sample_buf_append(&all, &workers[i].res.lat);
+        res->bytes += workers[i].res.bytes;
+        res->elapsed_ns = max(res->elapsed_ns, workers[i].res.elapsed_ns);
+        res->cpu_ns += workers[i].cpu_ns;
+        sample_buf_free(&workers[i].res.lat);
+    }
+
+    get_latency_stats(&all, &res->stats);
+    res->iops = all.count / ((double)max(res->elapsed_ns, (uint64_t)1)
+                             / NS_PER_SEC);
+    sample_buf_free(&all);
+    free(workers);
+}
+
+
+
+/*
+ * Print the hardware queues and their CPUs.
+ */
+static void print_hw_queues(const struct hw_queue *queues,
+        unsigned int num_queues)
+{
+    unsigned int i;
+    int cpu;
+
+    printf(" %5s %6s  %s\n", "queue", "tags", "CPUs");
+
+    for (i=0; i<num_queues; i++)
+    {
+        const char *sep = "";
+
+        printf(" %5u %6u  ", queues[i].index, queues[i].num_tags);
+        for (cpu=0; cpu<CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &queues[i].cpus))
+            {
+                printf("%s%d", sep, cpu);
+                sep = ",";
+            }
+        printf("\n");
+    }
+}
+
+
+
+/*
+ * Show a block device's blk-mq hardware queues, compare worker
+ * placements, and print the results.
+ *
+ * Each worker does random reads of opts->read_size (DEFAULT_READ_BYTES
+ * if zero), with opts->queue_depth in flight (DEFAULT_QUEUE_DEPTH if
+ * zero), for opts->duration_ns per placement. Only the CPUs this process
+ * may run on are used. Exits in case of error.
+ */
+void run_and_print_mq(const char *devname,
+        const struct bench_options *opts)
+{
+    struct hw_queue *queues = malloc(MAX_HW_QUEUES * sizeof(*queues));
+    int *cpus = malloc(MAX_HW_QUEUES * sizeof(*cpus));
+    struct placement_result results[NUM_PLACEMENTS];
+    struct openloop_params p;
+    struct blkdev_info info;
+    char disk_dir[PATH_MAX];
+    unsigned int num_queues, skipped, crowded_queues = 0;
+    cpu_set_t allowed;
+    char *duration;
+    int status, i;
+
+    die_if(queues == NULL || cpus == NULL, "malloc");
+
+    /* the kernel leaves out offline CPUs */
+    die_if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0,
+           "sched_getaffinity");
+
+    p.fd = open_blkdev(devname);
+    get_blkdev_info(p.fd, &info);
+    init_randomness();
+
+    status = sysfs_disk_dir(p.fd, disk_dir, sizeof(disk_dir));
+    die_if_with_errno(status != 0, devname, status);
+
+    num_queues = get_hw_queues(disk_dir, &allowed, queues, &skipped);
+    if (num_queues == 0)
+    {
+        if (skipped != 0)
+            fprintf(stderr, "error: none of the CPUs of %s's hardware queues are available\n",
+                    devname);
+        else
+            fprintf(stderr, "error: %s has no blk-mq hardware queues\n",
+                    devname);
+        exit(1);
+    }
+
+    p.info = &info;
+    p.first_block = 0;
+    p.num_blocks = 0;
+    p.read_size = align_ceil(opts->read_size != 0
+                             ? opts->read_size : DEFAULT_READ_BYTES,
+                             info.block_size);
+    p.size_dist = NULL;
+    p.rate = 0;
+    p.max_inflight = opts->queue_depth != 0
+                     ? opts->queue_depth : DEFAULT_QUEUE_DEPTH;
+    p.duration_ns = opts->duration_ns;
+
+    if (p.read_size > info.dev_size)
+    {
+        fprintf(stderr, "error: device too small for %zu-byte reads\n",
+                p.read_size);
+        exit(1);
+    }
+
+    duration = humanize_time(opts->duration_ns, 3);
+    for (i=0; i<NUM_PLACEMENTS; i++)
+    {
+        const unsigned int used_queues =
+            place_workers(queues, num_queues, (enum placement)i, cpus);
+
+        if (i == PLACE_CROWDED)
+            crowded_queues = used_queues;
+
+        printf("Running %u workers, %s, for %s, please wait...\n",
+               num_queues, placement_names[i], duration);
+        run_placement(&p, cpus, num_queues, &results[i]);
+    }
+    free(duration);
+
+    close(p.fd);
+
+    printf("\n%s: %u hardware queue%s\n\n", devname, num_queues,
+           num_queues != 1 ? "s" : "");
+    print_hw_queues(queues, num_queues);
+    if (skipped != 0)
+        printf(" (%u more queue%s with no CPU available to this process)\n",
+               skipped, skipped != 1 ? "s" : "");
+
+    printf("\n One worker per queue, %zu-byte random reads, %u in flight each:\n\n",
+           p.read_size, p.max_inflight);
+    print_stats_header("placement");
+    for (i=0; i<NUM_PLACEMENTS; i++)
+        print_stats_row(placement_names[i], &results[i].stats,
+                        results[i].bytes, results[i].elapsed_ns);
+
+    printf("\n %-10s %12s %10s %14s\n", "placement", "IOPS", "CPU",
+           "reads/CPU-s");
+    for (i=0; i<NUM_PLACEMENTS; i++)
+    {
+        const double cpu_s = (double)results[i].cpu_ns / NS_PER_SEC;
+        const double cpus_busy = (double)results[i].cpu_ns
+                                 / max(results[i].elapsed_ns, (uint64_t)1);
+
+        printf(" %-10s %12.1f %9.0f%% %14.0f\n", placement_names[i],
+               results[i].iops, 100 * cpus_busy,
+               results[i].stats.count / max(cpu_s, 1e-9));
+    }
+
+    printf("\n"
+           " matched:  each worker on a CPU of its own queue\n"
+           " unpinned: workers placed by the scheduler\n"
+           " crowded:  each worker on a CPU of its own, on %u queue%s\n"
+           " CPU is the time the workers ran, as a percentage of one CPU\n",
+           crowded_queues, crowded_queues != 1 ? "s" : "");
+
+    if (num_queues == 1)
+        printf("\n With a single hardware queue, placement can't change the queue used.\n");
+    else if (crowded_queues == num_queues)
+        printf("\n Each queue has a single CPU available, so workers can't share a queue\n"
+               " without sharing a CPU; crowded is the same as matched.\n");
+    else
+        printf("\n Unpinned workers get %.0f%% and crowded ones %.0f%% of the matched IOPS\n",
+               100 * results[PLACE_UNPINNED].iops
+                   / max(results[PLACE_MATCHED].iops, 1.0),
+               100 * results[PLACE_CROWDED].iops
+                   / max(results[PLACE_MATCHED].iops, 1.0));
+
+    free(cpus);
+    free(queues);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
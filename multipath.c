@@ -0,0 +1,641 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* multipath.c - per-path benchmarking of dm-multipath devices
+ *
+ * Runs the same random reads on each path of a multipath device alone,
+ * then through the multipath device, while sampling the paths' I/O
+ * statistics to see how the load was spread across them. Optionally
+ * repeats the latter under every path selector, by reloading the
+ * device's table with each one, and restores the original table at the
+ * end, or whenever hdtime exits or is killed before that.
+ *
+ * Paths are read directly, so on active/passive arrays the passive ones
+ * may fail reads; such arrays are better tested through the multipath
+ * device alone.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "dm.h"
+#include "humanize.h"
+#include "latency.h"
+#include "multipath.h"
+#include "openloop.h"
+#include "sysfs.h"
+
+
+/* Maximum number of paths. */
+#define MAX_PATHS 32
+
+/* Maximum length of a kernel device name, including terminator. */
+#define DEV_NAME_LEN 32
+
+/* Default size of the reads. */
+#define DEFAULT_READ_BYTES 4096
+
+/* Default reads in flight; enough to keep several paths busy. */
+#define DEFAULT_QUEUE_DEPTH 8
+
+/* Path selectors tried with --all-selectors. */
+static const char *const selectors[] = {
+    "round-robin", "queue-length", "service-time",
+};
+
+#define NUM_SELECTORS (sizeof(selectors) / sizeof(selectors[0]))
+
+
+struct mp_path {
+    char name[DEV_NAME_LEN];
+    char dir[PATH_MAX];                 /* sysfs directory */
+    char node[PATH_MAX];                /* device node */
+};
+
+struct run_result {
+    struct latency_stats stats;
+    uint64_t bytes;
+    uint64_t elapsed_ns;
+};
+
+
+/* The original table, ready to load, while --all-selectors has it
+ * replaced. */
+static struct {
+    int changed;
+    int ctl;
+    struct dm_ioctl *load;      /* DM_TABLE_LOAD request */
+    struct dm_ioctl *scratch;   /* the ioctls write to their buffer */
+    size_t load_size;
+    struct dm_ioctl header;     /* for resuming the device */
+} orig_table;
+
+
+
+/*
+ * Build a request to load a multipath table. Returns it as a newly
+ * allocated buffer, and its size in *p_size.
+ */
+static struct dm_ioctl *build_table_load(const char *name, uint64_t start,
+        uint64_t length, const char *params, size_t *p_size)
+{
+    const size_t size = align_ceil(sizeof(struct dm_ioctl)
+                                   + sizeof(struct dm_target_spec)
+                                   + strlen(params) + 1, 8);
+    struct dm_ioctl *dmi = malloc(size);
+    struct dm_target_spec *spec;
+
+    die_if(dmi == NULL, "malloc");
+
+    init_dm_ioctl(dmi, size, name);
+    dmi->target_count = 1;
+
+    spec = (struct dm_target_spec *)((char *)dmi + dmi->data_start);
+    spec->sector_start = start;
+    spec->length = length;
+    spec->next = size - dmi->data_start;
+    strcpy(spec->target_type, "multipath");
+    strcpy((char *)(spec + 1), params);
+
+    *p_size = size;
+
+    return dmi;
+}
+
+
+
+/*
+ * Load a table into a device and make it live, given a request from
+ * build_table_load and a bare ioctl header for the device. Only makes
+ * system calls, so it may run from a signal handler.
+ *
+ * Returns zero on success, or an error number in case of error.
+ */
+static int issue_table_load(int ctl, struct dm_ioctl *load,
+        const struct dm_ioctl *header)
+{
+    struct dm_ioctl dmi;
+    int err = 0;
+
+    if (ioctl(ctl, DM_TABLE_LOAD, load) != 0)
+        return errno;
+
+    /* resuming swaps in the table just loaded */
+    memcpy(&dmi, header, sizeof(dmi));
+    if (ioctl(ctl, DM_DEV_SUSPEND, &dmi) != 0)
+    {
+        err = errno;
+        memcpy(&dmi, header, sizeof(dmi));
+        (void)ioctl(ctl, DM_TABLE_CLEAR, &dmi);
+    }
+
+    return err;
+}
+
+
+
+/*
+ * Load a new table into a multipath device, and make it live.
+ *
+ * Returns zero on success, or an error number in case of error.
+ */
+static int load_mp_table(int ctl, const char *name, uint64_t start,
+        uint64_t length, const char *params)
+{
+    struct dm_ioctl header;
+    struct dm_ioctl *load;
+    size_t size;
+    int err;
+
+    load = build_table_load(name, start, length, params, &size);
+    init_dm_ioctl(&header, sizeof(header), name);
+
+    err = issue_table_load(ctl, load, &header);
+    free(load);
+
+    return err;
+}
+
+
+
+/*
+ * Put back the original table, if it's still replaced. Registered with
+ * register_restore, so that it also runs if hdtime dies or is killed
+ * while trying the selectors.
+ */
+static void restore_mp_table(void)
+{
+    if (!orig_table.changed)
+        return;
+    orig_table.changed = 0;
+
+    memcpy(orig_table.scratch, orig_table.load, orig_table.load_size);
+    (void)issue_table_load(orig_table.ctl, orig_table.scratch,
+                           &orig_table.header);
+}
+
+
+
+/*
+ * Get the next count from a list of table tokens. Returns zero on
+ * success, or -1 if there are no more tokens or it isn't a number.
+ */
+static int next_count(char *const *tokens, unsigned int num_tokens,
+        unsigned int *i, unsigned long *count)
+{
+    char *end;
+
+    if (*i >= num_tokens)
+        return -1;
+
+    *count = strtoul(tokens[*i], &end, 10);
+    if (*end != '\0' || *count > num_tokens)
+        return -1;
+
+    (*i)++;
+
+    return 0;
+}
+
+
+
+/*
+ * Rewrite a multipath table to use a different path selector.
+ *
+ * Every priority group gets the selector, with no selector arguments and
+ * no per-path arguments, so each selector uses its defaults. If cur isn't
+ * NULL, the name of the first group's current selector is stored there,
+ * in a buffer of the specified size. Returns the new table as a newly
+ * allocated string, or NULL if the table can't be parsed.
+ */
+static char *set_path_selector(const char *params, const char *selector,
+        char *cur, size_t cur_size)
+{
+    char *copy = strdup(params);
+    char **tokens = NULL;
+    char *out = NULL, *tok, *saveptr;
+    unsigned int num_tokens = 0, i = 0, j;
+    unsigned long count, groups, paths, path_args;
+    size_t len = 0;
+    FILE *f;
+
+    die_if(copy == NULL, "strdup");
+
+    for (tok = strtok_r(copy, " ", &saveptr); tok != NULL;
+         tok = strtok_r(NULL, " ", &saveptr))
+    {
+        tokens = realloc(tokens, (num_tokens + 1) * sizeof(*tokens));
+        die_if(tokens == NULL, "realloc");
+        tokens[num_tokens++] = tok;
+    }
+
+    f = open_memstream(&out, &len);
+    die_if(f == NULL, "open_memstream");
+
+    /* features, then hardware handler */
+    if (next_count(tokens, num_tokens, &i, &count) != 0)
+        goto fail;
+    i += count;
+    if (next_count(tokens, num_tokens, &i, &count) != 0)
+        goto fail;
+    i += count;
+
+    /* number of priority groups, and the first one to use */
+    if (next_count(tokens, num_tokens, &i, &groups) != 0
+        || next_count(tokens, num_tokens, &i, &count) != 0)
+        goto fail;
+
+    for (j=0; j<i; j++)
+        fprintf(f, "%s ", tokens[j]);
+
+    for (j=0; j<groups; j++)
+    {
+        unsigned long k;
+
+        if (i >= num_tokens)
+            goto fail;
+        if (j == 0 && cur != NULL)
+            snprintf(cur, cur_size, "%s", tokens[i]);
+        i++;
+
+        /* selector arguments */
+        if (next_count(tokens, num_tokens, &i, &count) != 0)
+            goto fail;
+        i += count;
+
+        if (next_count(tokens, num_tokens, &i, &paths) != 0
+            || next_count(tokens, num_tokens, &i, &path_args) != 0)
+            goto fail;
+
+        fprintf(f, "%s 0 %lu 0", selector, paths);
+        for (k=0; k<paths; k++)
+        {
+            if (i >= num_tokens)
+                goto fail;
+            fprintf(f, " %s", tokens[i]);
+            i += 1 + path_args;
+        }
+        if (j + 1 < groups)
+            fputc(' ', f);
+    }
+
+    if (i != num_tokens)
+        goto fail;
+
+    fclose(f);
+    free(tokens);
+    free(copy);
+
+    return out;
+
+fail:
+    fclose(f);
+    free(out);
+    free(tokens);
+    free(copy);
+
+    return NULL;
+}
+
+
+
+/*
+ * Compare two path names, for qsort.
+ */
+static int cmp_paths(const void *a, const void *b)
+{
+    return strcmp(((const struct mp_path *)a)->name,
+                  ((const struct mp_path *)b)->name);
+}
+
+
+
+/*
+ * Find the paths of a multipath device, from the slaves directory of its
+ * sysfs directory. Returns the number of paths. Exits in case of error.
+ */
+static unsigned int find_paths(const char *dir, struct mp_path *paths)
+{
+    char slaves[PATH_MAX + sizeof("/slaves")];
+    struct dirent *entry;
+    unsigned int count = 0;
+    char *p;
+    DIR *d;
+
+    snprintf(slaves, sizeof(slaves), "%s/slaves", dir);
+    d = opendir(slaves);
+    die_if(d == NULL, slaves);
+
+    while ((entry = readdir(d)) != NULL && count < MAX_PATHS)
+    {
+        struct mp_path *const path = &paths[count];
+
+        if (entry->d_name[0] == '.')
+            continue;
+
+        snprintf(path->name, sizeof(path->name), "%.*s", DEV_NAME_LEN - 1,
+                 entry->d_name);
+        snprintf(path->dir, sizeof(path->dir), "/sys/class/block/%s",
+                 path->name);
+
+        /* sysfs names use '!' where /dev has subdirectories */
+        snprintf(path->node, sizeof(path->node), "/dev/%s", path->name);
+        for (p = path->node; *p != '\0'; p++)
+            if (*p == '!')
+                *p = '/';
+
+        count++;
+    }
+    closedir(d);
+
+    /* readdir's order is arbitrary */
+    qsort(paths, count, sizeof(*paths), cmp_paths);
+
+    return count;
+}
+
+
+
+/*
+ * Run random reads on a device, and store the outcome in res.
+ */
+static void run_reads(const char *node, size_t read_size,
+        unsigned int queue_depth, uint64_t duration_ns,
+        struct run_result *res)
+{
+    struct openloop_params p;
+    struct openloop_result ol;
+    struct blkdev_info info;
+
+    p.fd = open_blkdev(node);
+    get_blkdev_info(p.fd, &info);
+
+    if (read_size % info.block_size != 0 || read_size > info.dev_size)
+    {
+        fprintf(stderr, "error: %s can't do reads of %zu bytes\n", node,
+                read_size);
+        exit(1);
+    }
+
+    p.info = &info;
+    p.first_block = 0;
+    p.num_blocks = 0;
+    p.read_size = read_size;
+    p.size_dist = NULL;
+    p.rate = 0;
+    p.max_inflight = queue_depth;
+    p.duration_ns = duration_ns;
+    p.seed = random64();
+
+    run_open_loop(&p, &ol);
+    close(p.fd);
+
+    get_latency_stats(&ol.lat, &res->stats);
+    res->bytes = ol.bytes;
+    res->elapsed_ns = ol.elapsed_ns;
+
+    sample_buf_free(&ol.lat);
+}
+
+
+
+/*
+ * Read the I/O statistics of every path. Exits in case of error.
+ */
+static void read_path_stats(const struct mp_path *paths,
+        unsigned int num_paths, struct diskstat *st)
+{
+    unsigned int i;
+    int status;
+
+    for (i=0; i<num_paths; i++)
+    {
+        status = read_diskstat(paths[i].dir, &st[i]);
+        die_if_with_errno(status != 0, paths[i].dir, status);
+    }
+}
+
+
+
+/*
+ * Run random reads through the multipath device, and print how they were
+ * spread across its paths.
+ */
+static void run_balance_phase(const char *devname,
+        const struct mp_path *paths, unsigned int num_paths,
+        size_t read_size, unsigned int queue_depth, uint64_t duration_ns,
+        const char *label)
+{
+    struct diskstat before[MAX_PATHS], after[MAX_PATHS];
+    struct run_result res;
+    uint64_t total = 0, busiest = 0;
+    unsigned int i;
+
+    read_path_stats(paths, num_paths, before);
+    run_reads(devname, read_size, queue_depth, duration_ns, &res);
+    read_path_stats(paths, num_paths, after);
+
+    for (i=0; i<num_paths; i++)
+    {
+        const uint64_t reads = after[i].reads - before[i].reads;
+
+        total += reads;
+        busiest = max(busiest, reads);
+    }
+
+    printf("\nThrough %s, %s:\n\n", devname, label);
+    print_stats_header("selector");
+    print_stats_row(label, &res.stats, res.bytes, res.elapsed_ns);
+
+    printf("\n %-14s %10s %8s %11s\n", "path", "reads", "share", "await");
+    for (i=0; i<num_paths; i++)
+    {
+        const uint64_t reads = after[i].reads - before[i].reads;
+        const uint64_t ticks = after[i].read_ticks - before[i].read_ticks;
+        char *const await = humanize_time(reads > 0 ? ticks * 1000000 / reads
+                                                    : 0, 3);
+
+        printf(" %-14s %10" PRIu64 " %7.1f%% %11s\n", paths[i].name, reads,
+               total > 0 ? 100.0 * reads / total : 0.0, await);
+        free(await);
+    }
+
+    if (total > 0)
+        printf(" Balance: the busiest path did %.2f times an even share\n",
+               (double)busiest * num_paths / total);
+}
+
+
+
+/*
+ * Benchmark each path of a dm-multipath device, then the device itself,
+ * and print the results.
+ *
+ * Every run does random reads of opts->read_size (DEFAULT_READ_BYTES if
+ * zero) with opts->queue_depth in flight (DEFAULT_QUEUE_DEPTH if zero),
+ * for opts->duration_ns. With opts->all_selectors, the multipath run is
+ * repeated under each path selector, and the original table is restored
+ * at the end. Exits in case of error.
+ */
+void run_and_print_multipath(const char *devname,
+        const struct bench_options *opts)
+{
+    const size_t read_size = opts->read_size != 0
+                             ? opts->read_size : DEFAULT_READ_BYTES;
+    const unsigned int queue_depth = opts->queue_depth != 0
+                                     ? opts->queue_depth
+                                     : DEFAULT_QUEUE_DEPTH;
+    struct mp_path paths[MAX_PATHS];
+    struct run_result alone[MAX_PATHS];
+    char dir[PATH_MAX], cur[DM_MAX_TYPE_NAME] = "current";
+    char *uuid, *dm_name, *duration, *table = NULL;
+    uint64_t start = 0, length = 0;
+    unsigned int num_paths, i;
+    int status, table_errno = 0, ctl = -1;
+
+    status = sysfs_block_dir(devname, dir, sizeof(dir));
+    die_if_with_errno(status != 0, devname, status);
+
+    uuid = sysfs_read_attr(dir, "dm/uuid");
+    if (uuid == NULL || strncmp(uuid, "mpath-", strlen("mpath-")) != 0)
+    {
+        fprintf(stderr, "error: %s is not a dm-multipath device\n", devname);
+        exit(1);
+    }
+    free(uuid);
+
+    dm_name = sysfs_read_attr(dir, "dm/name");
+    die_if(dm_name == NULL, "dm/name");
+
+    num_paths = find_paths(dir, paths);
+    if (num_paths == 0)
+    {
+        fprintf(stderr, "error: %s has no paths\n", devname);
+        exit(1);
+    }
+
+    /* the table tells the current selector, and is needed to change it */
+    ctl = open(DM_CONTROL_PATH, O_RDWR);
+    if (ctl < 0)
+        table_errno = errno;
+    else if ((table = get_dm_table(ctl, dm_name, "multipath", &start,
+                                   &length)) == NULL)
+        table_errno = errno;
+    if (table != NULL)
+    {
+        char *const parsed = set_path_selector(table, selectors[0], cur,
+                                               sizeof(cur));
+
+        if (parsed == NULL)
+            snprintf(cur, sizeof(cur), "current");
+        free(parsed);
+    }
+    else if (opts->all_selectors)
+        die_if_with_errno(1, ctl < 0 ? DM_CONTROL_PATH : "DM_TABLE_STATUS",
+                          table_errno);
+
+    init_randomness();
+
+    duration = humanize_time(opts->duration_ns, 3);
+    printf("%s (%s): %u paths, %zu-byte random reads, %u in flight, %s per run\n",
+           devname, dm_name, num_paths, read_size, queue_depth, duration);
+    free(duration);
+
+    for (i=0; i<num_paths; i++)
+        run_reads(paths[i].node, read_size, queue_depth, opts->duration_ns,
+                  &alone[i]);
+
+    printf("\nEach path alone:\n\n");
+    print_stats_header("path");
+    for (i=0; i<num_paths; i++)
+        print_stats_row(paths[i].name, &alone[i].stats, alone[i].bytes,
+                        alone[i].elapsed_ns);
+
+    if (opts->all_selectors)
+    {
+        orig_table.ctl = ctl;
+        orig_table.load = build_table_load(dm_name, start, length, table,
+                                           &orig_table.load_size);
+        orig_table.scratch = malloc(orig_table.load_size);
+        die_if(orig_table.scratch == NULL, "malloc");
+        init_dm_ioctl(&orig_table.header, sizeof(orig_table.header), dm_name);
+        orig_table.changed = 1;
+        register_restore(restore_mp_table);
+
+        for (i=0; i<NUM_SELECTORS; i++)
+        {
+            char *const new_table = set_path_selector(table, selectors[i],
+                                                      NULL, 0);
+
+            status = new_table != NULL
+                     ? load_mp_table(ctl, dm_name, start, length, new_table)
+                     : EINVAL;
+            free(new_table);
+            if (status != 0)
+            {
+                fprintf(stderr, "warning: can't select path selector %s: %s\n",
+                        selectors[i], strerror(status));
+                continue;
+            }
+
+            run_balance_phase(devname, paths, num_paths, read_size,
+                              queue_depth, opts->duration_ns, selectors[i]);
+        }
+
+        orig_table.changed = 0;
+        memcpy(orig_table.scratch, orig_table.load, orig_table.load_size);
+        status = issue_table_load(ctl, orig_table.scratch, &orig_table.header);
+        if (status != 0)
+            fprintf(stderr, "warning: can't restore the table of %s: %s\n",
+                    dm_name, strerror(status));
+        free(orig_table.load);
+        free(orig_table.scratch);
+    }
+    else
+        run_balance_phase(devname, paths, num_paths, read_size, queue_depth,
+                          opts->duration_ns, cur);
+
+    if (ctl >= 0)
+        close(ctl);
+    free(table);
+    free(dm_name);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
@@ -0,0 +1,213 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* openloop.c - open-loop, rate-controlled random reads
+ *
+ * Reads arrive at a given rate, as a Poisson process, whether or not the
+ * device keeps up. Latency is measured from each read's scheduled arrival,
+ * not from its submission, so time spent waiting behind a slow device is
+ * counted (avoiding coordinated omission).
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "latency.h"
+#include "asyncio.h"
+#include "openloop.h"
+#include "watchdog.h"
+
+
+struct ol_slot {
+    struct iocb cb;
+    char *buffer;
+    size_t size;
+    uint64_t arrival_ns;
+};
+
+
+
+/*
+ * Get the time until the next arrival of a Poisson process of the
+ * specified rate (per second), in nanoseconds.
+ */
+static uint64_t next_interarrival_ns(double rate, uint64_t *seed)
+{
+    /* uniform in (0, 1], so log() is finite */
+    const double u = ((random64_r(seed) >> 11) + 1) * (1.0 / 9007199254740992.0);
+
+    return (uint64_t)(-log(u) / rate * NS_PER_SEC);
+}
+
+
+
+/*
+ * Run open-loop random reads.
+ *
+ * Reads go to random offsets in the region of p->num_blocks blocks
+ * starting at p->first_block (up to the end of the device, if
+ * num_blocks is zero). They are all of p->read_size bytes, unless
+ * p->size_dist is set; then each read's size is drawn from it, rounded up
+ * to the block size, and p->read_size is the largest allowed.
+ *
+ * Reads arrive at p->rate per second for p->duration_ns; then the reads
+ * still in flight are waited for. At most p->max_inflight reads are
+ * submitted at a time; later arrivals wait, and their wait counts towards
+ * their latency. With a rate of zero, max_inflight reads are kept in
+ * flight at all times instead (a closed loop, to find the device's
+ * saturation point).
+ *
+ * Initializes and fills in res. Exits in case of error.
+ */
+void run_open_loop(const struct openloop_params *p,
+        struct openloop_result *res)
+{
+    const uint64_t region_blocks = p->num_blocks != 0
+                                   ? p->num_blocks
+                                   : p->info->num_blocks - p->first_block;
+    struct ol_slot *slots = malloc(p->max_inflight * sizeof(*slots));
+    unsigned int *free_slots = malloc(p->max_inflight * sizeof(*free_slots));
+    struct iocb **to_submit = malloc(p->max_inflight * sizeof(*to_submit));
+    struct io_event *events = malloc(p->max_inflight * sizeof(*events));
+    unsigned int num_free = p->max_inflight;
+    struct async_ctx actx;
+    uint64_t seed = p->seed;
+    uint64_t start_ns, now_ns, next_arrival_ns;
+    unsigned int i;
+
+    die_if(slots == NULL || free_slots == NULL || to_submit == NULL
+           || events == NULL, "malloc");
+    assert(p->max_inflight > 0);
+
+    for (i=0; i<p->max_inflight; i++)
+    {
+        slots[i].buffer = allocate_aligned_memory(p->info->alignment,
+                p->read_size);
+        free_slots[i] = i;
+    }
+
+    async_init(&actx, p->max_inflight);
+    sample_buf_init(&res->lat);
+    sample_buf_init(&res->sizes);
+    res->bytes = 0;
+
+    start_ns = now_ns = next_arrival_ns = get_cur_ns();
+
+    for (;;)
+    {
+        const int arriving = now_ns - start_ns < p->duration_ns
+                             && !watchdog_aborting();
+        struct timespec timeout;
+        int submit = 0;
+        int got;
+
+        /* submit every read that has arrived, while there are slots */
+        while (arriving && num_free > 0 && next_arrival_ns <= now_ns)
+        {
+            struct ol_slot *slot = &slots[free_slots[--num_free]];
+            uint64_t read_blocks, offset;
+
+            slot->size = p->size_dist != NULL
+                         ? min(align_ceil(size_dist_sample(p->size_dist, &seed),
+                                          p->info->block_size), p->read_size)
+                         : p->read_size;
+            read_blocks = slot->size / p->info->block_size;
+            offset = (p->first_block
+                      + random64_r(&seed) % (region_blocks > read_blocks
+                                             ? region_blocks - read_blocks + 1
+                                             : 1))
+                     * p->info->block_size;
+
+            async_prep_read(&slot->cb, p->fd, slot->buffer, slot->size,
+                    offset, slot);
+            slot->arrival_ns = next_arrival_ns;
+            to_submit[submit++] = &slot->cb;
+
+            if (p->rate > 0)
+                next_arrival_ns += next_interarrival_ns(p->rate, &seed);
+            else
+                next_arrival_ns = now_ns;
+        }
+
+        if (submit > 0)
+            async_submit(&actx, to_submit, submit);
+
+        if (!arriving && num_free == p->max_inflight)
+            break;
+
+        /* wait for completions, but no later than the next arrival */
+        if (arriving && num_free > 0 && next_arrival_ns > now_ns)
+        {
+            const uint64_t wait_ns = next_arrival_ns - now_ns;
+
+            timeout.tv_sec = wait_ns / NS_PER_SEC;
+            timeout.tv_nsec = wait_ns % NS_PER_SEC;
+            got = async_reap(&actx, events, 1, p->max_inflight, &timeout);
+        }
+        else if (num_free < p->max_inflight)
+            got = async_reap(&actx, events, 1, p->max_inflight, NULL);
+        else
+            got = 0;
+
+        now_ns = get_cur_ns();
+
+        for (i=0; i<(unsigned int)got; i++)
+        {
+            struct ol_slot *slot = (struct ol_slot *)(uintptr_t)events[i].data;
+
+            die_if_with_errno(events[i].res < 0, "read", (int)-events[i].res);
+
+            sample_buf_add(&res->lat, now_ns - slot->arrival_ns);
+            if (p->size_dist != NULL)
+                sample_buf_add(&res->sizes, slot->size);
+            res->bytes += slot->size;
+            free_slots[num_free++] = slot - slots;
+        }
+    }
+
+    res->elapsed_ns = now_ns - start_ns;
+
+    async_destroy(&actx);
+
+    for (i=0; i<p->max_inflight; i++)
+        free(slots[i].buffer);
+
+    free(events);
+    free(to_submit);
+    free(free_slots);
+    free(slots);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
@@ -0,0 +1,69 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* openloop.h - open-loop, rate-controlled random reads */
+
+
+#ifndef _OPENLOOP_H
+#define _OPENLOOP_H
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+
+/* get size_t */
+#include <stddef.h>
+
+/* get uint64_t */
+#include <stdint.h>
+
+#include "devio.h"
+#include "latency.h"
+#include "sizedist.h"
+
+
+struct openloop_params {
+    int fd;
+    const struct blkdev_info *info;
+    uint64_t first_block;       /* region to read from */
+    uint64_t num_blocks;        /* 0 = up to the end of the device */
+    size_t read_size;           /* multiple of info->block_size */
+    const struct size_dist *size_dist;  /* NULL = all reads of read_size */
+    double rate;                /* reads per second; 0 = saturate */
+    unsigned int max_inflight;  /* arrivals beyond this wait in line */
+    uint64_t duration_ns;
+    uint64_t seed;
+};
+
+struct openloop_result {
+    struct sample_buf lat;      /* from scheduled arrival to completion */
+    struct sample_buf sizes;    /* of each read, if size_dist was set */
+    uint64_t bytes;
+    uint64_t elapsed_ns;        /* until the last read completed */
+};
+
+
+void run_open_loop(const struct openloop_params *p,
+        struct openloop_result *res);
+
+
+#endif  /* _OPENLOOP_H */
@@ -0,0 +1,80 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* options.h - options shared by all benchmark modes */
+
+
+#ifndef _OPTIONS_H
+#define _OPTIONS_H
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+
+/* get size_t */
+#include <stddef.h>
+
+/* get uint64_t */
+#include <stdint.h>
+
+
+/*
+ * Benchmark options, as given on the command line. Each mode uses only
+ * the fields that are relevant to it.
+ */
+struct bench_options {
+    char *const *devnames;      /* every device named, in order */
+    unsigned int num_devnames;
+    unsigned int num_seeks;     /* random reads in seek test; 0 = auto */
+    size_t read_size;           /* sequential read size; 0 = auto */
+    uint64_t duration_ns;       /* duration of each phase, in timed modes */
+    uint64_t interval_ns;       /* time series interval; 0 = default */
+    uint64_t budget_ns;         /* total time of quick mode; 0 = default */
+    unsigned int jobs;          /* concurrent workers; 0 = mode default */
+    unsigned int chain_depth;   /* dependent reads per lookup */
+    unsigned int queue_depth;   /* reads in flight; 0 = mode default */
+    unsigned int batch_size;    /* offsets per batch in sorted mode */
+    double slo_percentile;      /* latency percentile of the SLO */
+    uint64_t slo_latency_ns;    /* latency target of the SLO; 0 = none */
+    unsigned int segments;      /* iovecs per vectored read */
+    size_t segment_size;        /* bytes per iovec */
+    size_t chunk_size;          /* RAID chunk size; 0 = sweep */
+    unsigned int parity;        /* RAID parity chunks per stripe */
+    unsigned int failed;        /* RAID members to fail */
+    uint64_t hedge_delay_ns;    /* hedge reads after this; 0 = sweep */
+    const char *clone_from;     /* device whose workload to clone */
+    uint64_t slow_ns;           /* verify reads slower than this; 0 = auto */
+    const char *size_dist;      /* request size distribution; NULL = default */
+    unsigned int clients;       /* most clients in clients mode; 0 = default */
+    uint64_t think_ns;          /* mean think time of clients; 0 = default */
+    const char *ioprio_list;    /* priorities to compete; NULL = default */
+    int request_prio;           /* tag requests, instead of threads */
+    int all_schedulers;         /* repeat under every I/O scheduler */
+    int all_selectors;          /* repeat under every path selector */
+    int include_busy;           /* probe disks in use, in inventory */
+    int group_by_root;          /* group by PCI root, not controller */
+    int no_profile_cache;       /* don't load or save device profiles */
+    int recalibrate;            /* ignore saved profiles; replace them */
+};
+
+
+#endif  /* _OPTIONS_H */
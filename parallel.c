@@ -0,0 +1,384 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* parallel.c - internal parallelism estimation
+ *
+ * A flash device serves reads from several independent units (channels,
+ * dies, planes), so its IOPS scale with the number of reads in flight, up
+ * to roughly the number of units. This mode sweeps the queue depth to find
+ * where scaling stops, sweeps the transfer size to see how single reads
+ * are striped across units, and confines reads to ever smaller LBA ranges,
+ * to see whether ranges map to separate units. Each range size is also
+ * read with one reader per range, all at the same time, to see whether
+ * readers in separate ranges interfere.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "openloop.h"
+#include "parallel.h"
+#include "workload.h"
+
+
+/* Default highest queue depth of the sweep. */
+#define DEFAULT_MAX_QUEUE_DEPTH 256
+
+/* Transfer size of the queue depth and region sweeps. */
+#define SWEEP_READ_BYTES 4096
+
+/* IOPS have stopped scaling once within this fraction of the peak. */
+#define SATURATION_FRACTION 0.9
+
+/* Confined reads getting less than this fraction of the whole device's
+ * IOPS mean the range maps to a subset of the units. */
+#define INTERFERENCE_FRACTION 0.8
+
+/* Number of queue depths, transfer sizes and regions, at most. */
+#define MAX_QD_STEPS 16
+#define NUM_SIZES 5
+#define NUM_REGIONS 3
+
+
+/* Transfer sizes of the size sweep, in KiB. */
+static const unsigned int size_kib[NUM_SIZES] = { 4, 16, 64, 256, 1024 };
+
+/* Regions of the region sweep, as a fraction 1/N of the device. */
+static const unsigned int region_divisor[NUM_REGIONS] = { 2, 8, 64 };
+
+
+struct step_result {
+    struct latency_stats stats;
+    uint64_t bytes;
+    uint64_t elapsed_ns;
+    double iops;
+};
+
+/* A reader confined to one range, in its own thread. */
+struct range_reader {
+    struct openloop_params p;
+    struct openloop_result res;
+};
+
+
+
+/*
+ * Run one closed-loop step: random reads of read_size bytes, at queue
+ * depth qd, within the specified region, for p->duration_ns. Stores the
+ * results in res.
+ */
+static void run_step(struct openloop_params *p, unsigned int qd,
+        size_t read_size, uint64_t first_block, uint64_t num_blocks,
+        struct step_result *res)
+{
+    struct openloop_result ol;
+
+    p->max_inflight = qd;
+    p->read_size = read_size;
+    p->size_dist = NULL;
+    p->first_block = first_block;
+    p->num_blocks = num_blocks;
+    p->seed = random64();
+
+    run_open_loop(p, &ol);
+
+    get_latency_stats(&ol.lat, &res->stats);
+    res->bytes = ol.bytes;
+    res->elapsed_ns = ol.elapsed_ns;
+    res->iops = ol.lat.count / ((double)max(ol.elapsed_ns, (uint64_t)1)
+                                / NS_PER_SEC);
+
+    sample_buf_free(&ol.lat);
+}
+
+
+
+/*
+ * Run one range reader, once all of them are ready.
+ */
+static void *range_reader_main(void *arg)
+{
+    struct thread_arg *t = arg;
+    struct range_reader *r = t->data;
+
+    pthread_barrier_wait(t->start);
+    run_open_loop(&r->p, &r->res);
+
+    return NULL;
+}
+
+
+
+/*
+ * Run one split step: num_ranges readers at the same time, each doing
+ * random reads of read_size bytes within its own 1/num_ranges of the
+ * device, with qd reads in flight between them (at least one each), for
+ * p->duration_ns. Stores the combined results in res.
+ */
+static void run_split_step(const struct openloop_params *p, unsigned int qd,
+        size_t read_size, unsigned int num_ranges, struct step_result *res)
+{
+    const uint64_t range_blocks = max(p->info->num_blocks / num_ranges,
+            (uint64_t)(read_size / p->info->block_size));
+    struct range_reader *readers = malloc(num_ranges * sizeof(*readers));
+    struct sample_buf all;
+    unsigned int i;
+
+    die_if(readers == NULL, "malloc");
+
+    for (i=0; i<num_ranges; i++)
+    {
+        struct openloop_params *const rp = &readers[i].p;
+
+        *rp = *p;
+        rp->max_inflight = max(qd / num_ranges, 1U);
+        rp->read_size = read_size;
+        rp->size_dist = NULL;
+        /* the last range may be short of the ones before it */
+        rp->first_block = min((uint64_t)i * range_blocks,
+                              p->info->num_blocks - range_blocks);
+        rp->num_blocks = range_blocks;
+        rp->seed = random64();
+    }
+
+    run_threads(range_reader_main, readers, sizeof(*readers), num_ranges);
+
+    sample_buf_init(&all);
+    res->bytes = 0;
+    res->elapsed_ns = 0;
+    for (i=0; i<num_ranges; i++)
+    {
+        sample_buf_append(&all, &readers[i].res.lat);
+        res->bytes += readers[i].res.bytes;
+        res->elapsed_ns = max(res->elapsed_ns, readers[i].res.elapsed_ns);
+        sample_buf_free(&readers[i].res.lat);
+    }
+
+    get_latency_stats(&all, &res->stats);
+    res->iops = all.count / ((double)max(res->elapsed_ns, (uint64_t)1)
+                             / NS_PER_SEC);
+
+    sample_buf_free(&all);
+    free(readers);
+}
+
+
+
+/*
+ * Run the parallelism estimation on a block device, and print the
+ * results.
+ *
+ * Sweeps the queue depth in powers of 2, up to opts->queue_depth
+ * (DEFAULT_MAX_QUEUE_DEPTH if zero). Each step runs for opts->duration_ns.
+ * Exits in case of error.
+ */
+void run_and_print_parallel(const char *devname,
+        const struct bench_options *opts)
+{
+    const unsigned int max_qd = opts->queue_depth != 0
+                                ? opts->queue_depth : DEFAULT_MAX_QUEUE_DEPTH;
+    struct step_result qd_res[MAX_QD_STEPS];
+    struct step_result size_res[NUM_SIZES][2];
+    struct step_result region_res[NUM_REGIONS];
+    struct step_result split_res[NUM_REGIONS];
+    unsigned int qds[MAX_QD_STEPS];
+    unsigned int num_qds = 0, num_sizes = 0;
+    unsigned int peak = 0, sat = 0;
+    struct openloop_params p;
+    struct blkdev_info info;
+    size_t sweep_size;
+    double ratio, split_ratio;
+    char *duration;
+    char label[32];
+    unsigned int i, j, qd;
+
+    p.fd = open_blkdev(devname);
+    get_blkdev_info(p.fd, &info);
+    init_randomness();
+
+    sweep_size = align_ceil(SWEEP_READ_BYTES, info.block_size);
+    if (sweep_size > info.dev_size)
+    {
+        fprintf(stderr, "error: device too small for %zu-byte reads\n",
+                sweep_size);
+        exit(1);
+    }
+
+    p.info = &info;
+    p.rate = 0;
+    p.duration_ns = opts->duration_ns;
+
+    for (qd=1; qd <= max_qd && num_qds < MAX_QD_STEPS; qd *= 2)
+        qds[num_qds++] = qd;
+
+    while (num_sizes < NUM_SIZES
+           && size_kib[num_sizes] * 1024ULL <= info.dev_size)
+        num_sizes++;
+
+    duration = humanize_time(opts->duration_ns, 3);
+
+    /* queue depth sweep */
+    for (i=0; i<num_qds; i++)
+    {
+        printf("Reading %zu-byte blocks at QD%u for %s, please wait...\n",
+               sweep_size, qds[i], duration);
+        run_step(&p, qds[i], sweep_size, 0, 0, &qd_res[i]);
+
+        if (qd_res[i].iops > qd_res[peak].iops)
+            peak = i;
+    }
+
+    /* the lowest queue depth that gets close enough to the peak */
+    while (qd_res[sat].iops < SATURATION_FRACTION * qd_res[peak].iops)
+        sat++;
+
+    /* transfer size sweep, at QD1 and at the saturation queue depth */
+    for (i=0; i<num_sizes; i++)
+    {
+        const size_t size = align_ceil(size_kib[i] * 1024, info.block_size);
+        const unsigned int size_qds[2] = { 1, qds[sat] };
+
+        for (j=0; j<2; j++)
+        {
+            printf("Reading %u KiB blocks at QD%u for %s, please wait...\n",
+                   size_kib[i], size_qds[j], duration);
+            run_step(&p, size_qds[j], size, 0, 0, &size_res[i][j]);
+        }
+    }
+
+    /* region sweep, at the saturation queue depth */
+    for (i=0; i<NUM_REGIONS; i++)
+    {
+        const uint64_t blocks = info.num_blocks / region_divisor[i];
+
+        printf("Reading %zu-byte blocks within 1/%u of the device at QD%u for %s, please wait...\n",
+               sweep_size, region_divisor[i], qds[sat], duration);
+        run_step(&p, qds[sat], sweep_size, 0,
+                 max(blocks, (uint64_t)(sweep_size / info.block_size)),
+                 &region_res[i]);
+
+        printf("Reading %zu-byte blocks with %u readers, each within its own 1/%u, for %s, please wait...\n",
+               sweep_size, region_divisor[i], region_divisor[i], duration);
+        run_split_step(&p, qds[sat], sweep_size, region_divisor[i],
+                       &split_res[i]);
+    }
+
+    close(p.fd);
+
+    printf("\n"
+           "%s:\n"
+           " Queue depth sweep (%zu-byte random reads):\n"
+           "\n",
+           devname, sweep_size);
+
+    print_stats_header("queue depth");
+    for (i=0; i<num_qds; i++)
+    {
+        snprintf(label, sizeof(label), "QD%u", qds[i]);
+        print_stats_row(label, &qd_res[i].stats, qd_res[i].bytes,
+                qd_res[i].elapsed_ns);
+    }
+
+    printf("\n"
+           " Transfer size sweep (random reads):\n"
+           "\n");
+
+    print_stats_header("size");
+    for (i=0; i<num_sizes; i++)
+    {
+        for (j=0; j<2; j++)
+        {
+            snprintf(label, sizeof(label), "%u KiB QD%u", size_kib[i],
+                     j == 0 ? 1 : qds[sat]);
+            print_stats_row(label, &size_res[i][j].stats,
+                    size_res[i][j].bytes, size_res[i][j].elapsed_ns);
+        }
+    }
+
+    printf("\n"
+           " Region sweep (%zu-byte random reads at QD%u):\n"
+           "\n",
+           sweep_size, qds[sat]);
+
+    print_stats_header("region");
+    print_stats_row("whole device", &qd_res[sat].stats, qd_res[sat].bytes,
+            qd_res[sat].elapsed_ns);
+    for (i=0; i<NUM_REGIONS; i++)
+    {
+        snprintf(label, sizeof(label), "1/%u", region_divisor[i]);
+        print_stats_row(label, &region_res[i].stats, region_res[i].bytes,
+                region_res[i].elapsed_ns);
+        snprintf(label, sizeof(label), "%u x 1/%u", region_divisor[i],
+                 region_divisor[i]);
+        print_stats_row(label, &split_res[i].stats, split_res[i].bytes,
+                split_res[i].elapsed_ns);
+    }
+
+    printf("\n"
+           " IOPS scale %.1fx from QD1 to the peak, at QD%u\n"
+           " Scaling stops at QD%u (%.0f%% of peak IOPS)\n"
+           " Estimated independent units: ~%.0f\n",
+           qd_res[peak].iops / max(qd_res[0].iops, 1.0), qds[peak],
+           qds[sat], SATURATION_FRACTION * 100,
+           min(qd_res[peak].iops / max(qd_res[0].iops, 1.0), (double)qds[sat]));
+
+    /* the smallest region covers the fewest units, if ranges map to
+     * units; compare it with both whole-device runs at the same queue
+     * depth and size, to smooth out noise. Readers spread over all the
+     * ranges then get every unit back, unless the ranges interfere */
+    ratio = region_res[NUM_REGIONS - 1].iops
+            / max((qd_res[sat].iops + size_res[0][1].iops) / 2, 1.0);
+    split_ratio = split_res[NUM_REGIONS - 1].iops
+                  / max((qd_res[sat].iops + size_res[0][1].iops) / 2, 1.0);
+
+    printf(" Reads confined to 1/%u of the device get %.0f%% of the IOPS,\n"
+           " and %u readers each within its own 1/%u get %.0f%%;\n",
+           region_divisor[NUM_REGIONS - 1], ratio * 100,
+           region_divisor[NUM_REGIONS - 1], region_divisor[NUM_REGIONS - 1],
+           split_ratio * 100);
+
+    if (ratio >= INTERFERENCE_FRACTION)
+        printf(" LBA ranges appear to be striped across all units.\n");
+    else if (split_ratio >= INTERFERENCE_FRACTION)
+        printf(" LBA ranges appear to map to separate units.\n");
+    else
+        printf(" readers in separate LBA ranges interfere with each other.\n");
+
+    free(duration);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
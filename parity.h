@@ -0,0 +1,62 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* parity.h - RAID-5/6 parity kernels */
+
+
+#ifndef _PARITY_H
+#define _PARITY_H
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+
+/* get size_t */
+#include <stddef.h>
+
+/* get uint8_t */
+#include <stdint.h>
+
+
+void gf_init(void);
+
+uint8_t gf_pow2(int n);
+
+uint8_t gf_mul(uint8_t a, uint8_t b);
+
+uint8_t gf_inv(uint8_t a);
+
+void gf_mul_table(uint8_t c, uint8_t table[256]);
+
+void xor_into(void *dst, const void *src, size_t len);
+
+void gf_mul_into(uint8_t *dst, const uint8_t *src, const uint8_t table[256],
+        size_t len);
+
+void gf_mul_xor(uint8_t *dst, const uint8_t *src, const uint8_t table[256],
+        size_t len);
+
+void raid6_2data_recov(uint8_t *pxy, uint8_t *qxy, unsigned int x,
+        unsigned int y, size_t len);
+
+
+#endif  /* _PARITY_H */
@@ -0,0 +1,389 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* periodic.c - periodic stall detection
+ *
+ * Runs random reads for a while, turns the per-I/O latencies into a time
+ * series of the worst latency seen in each interval, and looks for
+ * periodicity in it through its autocorrelation. SSD garbage collection,
+ * HDD thermal recalibration and firmware housekeeping tend to show up as
+ * regular stalls, which averages hide.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <complex.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "workload.h"
+#include "periodic.h"
+
+
+/* Default length of each interval of the time series. */
+#define DEFAULT_INTERVAL_NS (100 * 1000000UL)
+
+/* Default number of concurrent readers. */
+#define DEFAULT_READERS 1
+
+/* Minimum autocorrelation to report a period as periodic stalls. */
+#define MIN_PERIODIC_ACF 0.4
+
+/* A smaller lag within this fraction of the best autocorrelation is
+ * preferred, so that we report the fundamental period, not a multiple. */
+#define HARMONIC_TOLERANCE 0.9
+
+/* The series must hold at least this many periods. */
+#define MIN_PERIODS 3
+
+/* Fewest intervals we're willing to analyse. */
+#define MIN_INTERVALS (4 * MIN_PERIODS)
+
+
+
+/*
+ * In-place iterative radix-2 FFT. n must be a power of 2. If inverse is
+ * true, computes the inverse transform (without scaling by 1/n).
+ */
+static void fft(double complex *x, size_t n, int inverse)
+{
+    size_t i, j, len;
+
+    /* bit-reversal permutation */
+    for (i=1, j=0; i<n; i++)
+    {
+        size_t bit = n >> 1;
+
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+
+        if (i < j)
+        {
+            const double complex tmp = x[i];
+            x[i] = x[j];
+            x[j] = tmp;
+        }
+    }
+
+    for (len=2; len<=n; len <<= 1)
+    {
+        const double angle = 2 * M_PI / len * (inverse ? 1 : -1);
+        const double complex wlen = cexp(I * angle);
+
+        for (i=0; i<n; i += len)
+        {
+            double complex w = 1;
+
+            for (j=0; j<len/2; j++)
+            {
+                const double complex u = x[i+j];
+                const double complex v = x[i+j+len/2] * w;
+
+                x[i+j] = u + v;
+                x[i+j+len/2] = u - v;
+                w *= wlen;
+            }
+        }
+    }
+}
+
+
+
+/*
+ * Calculate the autocorrelation of a series of n values, for lags 0 to
+ * n-1, through the FFT (Wiener-Khinchin). Stores the result in acf.
+ *
+ * Uses the unbiased estimator, normalized so that acf[0] is 1. All values
+ * are 0 if the series is constant.
+ */
+static void autocorrelation(const double *series, size_t n, double *acf)
+{
+    double complex *x;
+    double mean = 0;
+    size_t m = 1;
+    size_t i;
+
+    while (m < 2*n)
+        m <<= 1;
+
+    x = calloc(m, sizeof(*x));
+    die_if(x == NULL, "calloc");
+
+    for (i=0; i<n; i++)
+        mean += series[i];
+    mean /= n;
+
+    /* zero-padding to 2n avoids circular correlation */
+    for (i=0; i<n; i++)
+        x[i] = series[i] - mean;
+
+    fft(x, m, 0);
+    for (i=0; i<m; i++)
+        x[i] = creal(x[i])*creal(x[i]) + cimag(x[i])*cimag(x[i]);
+    fft(x, m, 1);
+
+    for (i=0; i<n; i++)
+    {
+        const double r0 = creal(x[0]) / n;
+
+        acf[i] = r0 > 0 ? (creal(x[i]) / (n - i)) / r0 : 0;
+    }
+
+    free(x);
+}
+
+
+
+static int cmp_double(const void *a, const void *b)
+{
+    const double x = *(const double *)a;
+    const double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+
+/*
+ * Find the dominant period of a time series.
+ *
+ * Looks for the local maximum of the series' autocorrelation with the
+ * highest value, at lags of 2 to n / MIN_PERIODS. If a smaller lag has
+ * nearly as high a value, it's preferred, as the best lag may be a
+ * multiple of the real period. Then folds the series at that period to
+ * find the phase where stalls happen, and their height.
+ *
+ * The result's period is zero if the series is too short or has no local
+ * maximum. Whether the periodicity is significant is up to the caller,
+ * based on the result's acf.
+ */
+void find_periodicity(const double *series, size_t n,
+        struct periodicity *result)
+{
+    double *acf, *sorted;
+    double best = -1;
+    size_t lag, max_lag;
+
+    memset(result, 0, sizeof(*result));
+
+    if (n < MIN_INTERVALS)
+        return;
+
+    acf = malloc(n * sizeof(*acf));
+    sorted = malloc(n * sizeof(*sorted));
+    die_if(acf == NULL || sorted == NULL, "malloc");
+
+    memcpy(sorted, series, n * sizeof(*sorted));
+    qsort(sorted, n, sizeof(*sorted), cmp_double);
+    result->median = sorted[n / 2];
+
+    autocorrelation(series, n, acf);
+    max_lag = n / MIN_PERIODS;
+
+    for (lag=2; lag<max_lag; lag++)
+    {
+        if (acf[lag] >= acf[lag-1] && acf[lag] >= acf[lag+1])
+            best = max(best, acf[lag]);
+    }
+
+    for (lag=2; lag<max_lag && best > 0; lag++)
+    {
+        if (acf[lag] >= acf[lag-1] && acf[lag] >= acf[lag+1]
+            && acf[lag] >= HARMONIC_TOLERANCE * best)
+        {
+            size_t phase;
+
+            result->period = lag;
+            result->acf = acf[lag];
+
+            /* fold the series at the period; find the worst phase */
+            for (phase=0; phase<lag; phase++)
+            {
+                double sum = 0;
+                size_t i, count = 0;
+
+                for (i=phase; i<n; i += lag, count++)
+                    sum += series[i];
+
+                if (phase == 0 || sum / count > result->peak_mean)
+                {
+                    result->peak_mean = sum / count;
+                    result->peak_phase = phase;
+                }
+            }
+            break;
+        }
+    }
+
+    free(sorted);
+    free(acf);
+}
+
+
+
+/*
+ * Run the periodic stall detection test on a block device, and print the
+ * results.
+ *
+ * Runs opts->jobs random readers (DEFAULT_READERS if zero) for
+ * opts->duration_ns, and analyses the worst latency in each interval of
+ * opts->interval_ns (DEFAULT_INTERVAL_NS if zero). Exits in case of error.
+ */
+void run_and_print_periodic(const char *devname,
+        const struct bench_options *opts)
+{
+    const unsigned int readers = opts->jobs != 0 ? opts->jobs : DEFAULT_READERS;
+    const uint64_t interval_ns = opts->interval_ns != 0
+                                 ? opts->interval_ns : DEFAULT_INTERVAL_NS;
+    /* room for the reads still in flight when the time is up */
+    const size_t series_len = opts->duration_ns / interval_ns + 2;
+    struct rr_worker *workers = calloc(readers, sizeof(*workers));
+    struct latency_hist *hists = malloc(readers * sizeof(*hists));
+    uint64_t *worker_series = calloc(readers * series_len,
+                                     sizeof(*worker_series));
+    struct latency_stats stats;
+    struct periodicity per;
+    struct blkdev_info info;
+    uint64_t bytes = 0, elapsed_ns = 0;
+    char *duration, *interval;
+    double *series;
+    size_t n, k;
+    unsigned int i;
+    int fd;
+
+    die_if(workers == NULL || hists == NULL || worker_series == NULL,
+           "calloc");
+
+    fd = open_blkdev(devname);
+    get_blkdev_info(fd, &info);
+    init_randomness();
+
+    duration = humanize_time(opts->duration_ns, 3);
+    interval = humanize_time(interval_ns, 3);
+
+    printf("Running %u random reader(s) for %s to find periodic stalls, please wait...\n",
+           readers, duration);
+
+    for (i=0; i<readers; i++)
+    {
+        init_rr_worker(&workers[i], fd, &info, info.block_size,
+                opts->duration_ns);
+        /* both fixed-size, however long the test runs */
+        latency_hist_init(&hists[i]);
+        workers[i].hist = &hists[i];
+        workers[i].series = worker_series + i * series_len;
+        workers[i].series_len = series_len;
+        workers[i].interval_ns = interval_ns;
+    }
+
+    run_random_read_workers(workers, readers);
+
+    close(fd);
+
+    for (i=0; i<readers; i++)
+        elapsed_ns = max(elapsed_ns, workers[i].elapsed_ns);
+
+    n = min((elapsed_ns + interval_ns - 1) / interval_ns, series_len);
+    series = calloc(max(n, (size_t)1), sizeof(*series));
+    die_if(series == NULL, "calloc");
+
+    for (i=0; i<readers; i++)
+    {
+        for (k=0; k<n; k++)
+            series[k] = max(series[k], (double)workers[i].series[k]);
+        if (i > 0)
+            latency_hist_merge(&hists[0], &hists[i]);
+        bytes += workers[i].bytes;
+    }
+
+    find_periodicity(series, n, &per);
+
+    printf("\n"
+           "%s:\n"
+           " %u random reader(s) of %u bytes, %s, in %zu intervals of %s\n"
+           "\n",
+           devname, readers, info.block_size, duration, n, interval);
+
+    print_stats_header("workload");
+    get_hist_latency_stats(&hists[0], &stats);
+    print_stats_row("random read", &stats, bytes, elapsed_ns);
+    printf("\n");
+
+    if (n < MIN_INTERVALS)
+    {
+        printf(" Too few intervals to look for periodic stalls; use a longer --time\n"
+               " or a shorter --interval.\n");
+    }
+    else if (per.period == 0)
+    {
+        printf(" No periodic stalls detected (no recurring pattern).\n");
+    }
+    else
+    {
+        char *const period = humanize_time(per.period * interval_ns, 3);
+        char *const phase = humanize_time(per.peak_phase * interval_ns, 3);
+        char *const median = humanize_time((uint64_t)per.median, 3);
+        char *const peak = humanize_time((uint64_t)per.peak_mean, 3);
+        char *const amplitude = humanize_time(
+                per.peak_mean > per.median ? (uint64_t)(per.peak_mean - per.median) : 0, 3);
+
+        printf(" Strongest periodicity: every %s (autocorrelation %.2f)\n"
+               " Median worst latency per interval: %s\n"
+               " Worst latency at peak phase (%s into each period): %s\n"
+               " Stall amplitude: %s above median\n"
+               " %s\n",
+               period, per.acf, median, phase, peak, amplitude,
+               per.acf >= MIN_PERIODIC_ACF
+               ? "Periodic stalls detected."
+               : "No significant periodic stalls detected.");
+
+        free(period);
+        free(phase);
+        free(median);
+        free(peak);
+        free(amplitude);
+    }
+
+    free(duration);
+    free(interval);
+    free(series);
+    free(worker_series);
+    free(hists);
+    free(workers);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
@@ -0,0 +1,58 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* periodic.h - periodic stall detection */
+
+
+#ifndef _PERIODIC_H
+#define _PERIODIC_H
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+
+/* get size_t */
+#include <stddef.h>
+
+/* get uint64_t */
+#include <stdint.h>
+
+#include "options.h"
+
+
+struct periodicity {
+    size_t period;              /* in intervals; 0 if none found */
+    double acf;                 /* autocorrelation at that period */
+    size_t peak_phase;          /* interval of the period with most stall */
+    double peak_mean;           /* mean value at the peak phase */
+    double median;              /* median value of the whole series */
+};
+
+
+void find_periodicity(const double *series, size_t n,
+        struct periodicity *result);
+
+void run_and_print_periodic(const char *devname,
+        const struct bench_options *opts);
+
+
+#endif  /* _PERIODIC_H */
@@ -0,0 +1,356 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* profile.c - persistent per-device calibration profiles
+ *
+ * Autodetecting the read size and seek count takes several seconds, and
+ * gives the same answer for the same drive every time. Profiles keep the
+ * answer in a state file, keyed by the device's identity (WWID or serial
+ * number), so that later runs can start measuring right away.
+ *
+ * The file has one line per profile, with tab-separated fields: identity,
+ * device size, block size, alignment, read size and seek count. A profile
+ * is only used if the device's geometry still matches.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "sysfs.h"
+#include "profile.h"
+
+
+/* Maximum length of a line in the profiles file. */
+#define MAX_LINE_LEN (DEVICE_ID_LEN + 128)
+
+
+/* Sysfs attributes identifying a device, most specific first. */
+static const struct {
+    const char *attr;
+    const char *kind;
+} id_attrs[] = {
+    { "wwid", "wwid" },
+    { "device/wwid", "wwid" },
+    { "serial", "serial" },
+    { "device/serial", "serial" },
+    { "loop/backing_file", "loop" },
+};
+
+#define NUM_ID_ATTRS (sizeof(id_attrs)/sizeof(id_attrs[0]))
+
+
+
+/*
+ * Get the identity of the disk behind an open block device, e.g.
+ * "wwid:naa.5000c500a1b2c3d4". Whitespace in the identity is replaced by
+ * underscores. Partitions get the identity of their disk.
+ *
+ * Stores the identity in buf, of the specified size. Returns zero on
+ * success, ENOENT if the device has no known identity, or another error
+ * number in case of error.
+ */
+int get_device_id(int fd, char *buf, size_t size)
+{
+    char disk_dir[PATH_MAX];
+    unsigned int i;
+    int error;
+
+    error = sysfs_disk_dir(fd, disk_dir, sizeof(disk_dir));
+    if (error != 0)
+        return error;
+
+    for (i=0; i<NUM_ID_ATTRS; i++)
+    {
+        char *const value = sysfs_read_attr(disk_dir, id_attrs[i].attr);
+        char *start, *p;
+        size_t len;
+
+        if (value == NULL)
+            continue;
+
+        for (start = value; isspace((unsigned char)*start); start++)
+            ;
+        for (len = strlen(start); len > 0 && isspace((unsigned char)start[len-1]); len--)
+            start[len-1] = '\0';
+        for (p = start; *p != '\0'; p++)
+            if (isspace((unsigned char)*p))
+                *p = '_';
+
+        if (len == 0)
+        {
+            free(value);
+            continue;
+        }
+
+        if ((size_t)snprintf(buf, size, "%s:%s", id_attrs[i].kind, start) >= size)
+            error = ENAMETOOLONG;
+
+        free(value);
+        return error;
+    }
+
+    return ENOENT;
+}
+
+
+
+/*
+ * Get the path of the profiles file: $XDG_CACHE_HOME/hdtime/profiles, or
+ * ~/.cache/hdtime/profiles. If create_dirs is true, creates the
+ * directories as needed.
+ *
+ * Stores the path in buf, of the specified size. Returns zero on
+ * success, or an error number in case of error.
+ */
+static int get_profiles_path(char *buf, size_t size, int create_dirs)
+{
+    const char *cache = getenv("XDG_CACHE_HOME");
+    char dir[PATH_MAX];
+
+    if (cache != NULL && cache[0] != '\0')
+    {
+        if ((size_t)snprintf(dir, sizeof(dir), "%s", cache) >= sizeof(dir))
+            return ENAMETOOLONG;
+    }
+    else
+    {
+        const char *home = getenv("HOME");
+
+        if (home == NULL || home[0] == '\0')
+        {
+            const struct passwd *pw = getpwuid(getuid());
+
+            if (pw == NULL)
+                return ENOENT;
+            home = pw->pw_dir;
+        }
+
+        if ((size_t)snprintf(dir, sizeof(dir), "%s/.cache", home) >= sizeof(dir))
+            return ENAMETOOLONG;
+    }
+
+    if (create_dirs && mkdir(dir, 0700) != 0 && errno != EEXIST)
+        return errno;
+
+    if (strlen(dir) + sizeof("/hdtime") > sizeof(dir))
+        return ENAMETOOLONG;
+    strcat(dir, "/hdtime");
+
+    if (create_dirs && mkdir(dir, 0755) != 0 && errno != EEXIST)
+        return errno;
+
+    if ((size_t)snprintf(buf, size, "%s/profiles", dir) >= size)
+        return ENAMETOOLONG;
+
+    return 0;
+}
+
+
+
+/*
+ * Parse a line of the profiles file. Stores the identity in id (of
+ * DEVICE_ID_LEN bytes) and the rest in profile. Returns true if the line
+ * is a valid profile.
+ */
+static int parse_profile_line(char *line, char *id,
+        struct device_profile *profile)
+{
+    char *const tab = strchr(line, '\t');
+    size_t id_len;
+
+    if (line[0] == '#' || tab == NULL)
+        return 0;
+
+    id_len = tab - line;
+    if (id_len == 0 || id_len >= DEVICE_ID_LEN)
+        return 0;
+
+    memcpy(id, line, id_len);
+    id[id_len] = '\0';
+
+    return sscanf(tab + 1, "%" SCNu64 "\t%u\t%zu\t%zu\t%u",
+                  &profile->info.dev_size, &profile->info.block_size,
+                  &profile->info.alignment, &profile->read_size,
+                  &profile->num_seeks) == 5
+           && profile->info.block_size != 0;
+}
+
+
+
+/*
+ * Whether a profile was made for the device with the specified geometry.
+ */
+static int same_geometry(const struct blkdev_info *a,
+        const struct blkdev_info *b)
+{
+    return a->dev_size == b->dev_size
+           && a->block_size == b->block_size
+           && a->alignment == b->alignment;
+}
+
+
+
+/*
+ * Load the profile of the device with the specified identity.
+ *
+ * profile->info must hold the device's current geometry; a profile made
+ * for a different geometry (e.g. another partition of the same disk, or a
+ * resized device) is ignored. Fills in the rest of profile.
+ *
+ * Returns zero on success, ENOENT if there is no such profile, or another
+ * error number in case of error.
+ */
+int load_profile(const char *id, struct device_profile *profile)
+{
+    char path[PATH_MAX];
+    char line[MAX_LINE_LEN];
+    char line_id[DEVICE_ID_LEN];
+    struct device_profile entry;
+    int error;
+    FILE *f;
+
+    error = get_profiles_path(path, sizeof(path), 0);
+    if (error != 0)
+        return error;
+
+    f = fopen(path, "r");
+    if (f == NULL)
+        return errno;
+
+    error = ENOENT;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if (parse_profile_line(line, line_id, &entry)
+            && strcmp(line_id, id) == 0
+            && same_geometry(&entry.info, &profile->info))
+        {
+            profile->read_size = entry.read_size;
+            profile->num_seeks = entry.num_seeks;
+            error = 0;
+            break;
+        }
+    }
+
+    fclose(f);
+
+    return error;
+}
+
+
+
+/*
+ * Save the profile of the device with the specified identity, replacing
+ * any previous profile for the same identity and geometry.
+ *
+ * The profiles file is rewritten to a temporary file and renamed over the
+ * original, so that concurrent readers never see it half written.
+ *
+ * Returns zero on success, or an error number in case of error.
+ */
+int save_profile(const char *id, const struct device_profile *profile)
+{
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX + sizeof(".XXXXXX")];
+    char line[MAX_LINE_LEN];
+    char line_id[DEVICE_ID_LEN];
+    struct device_profile entry;
+    FILE *old, *f;
+    int error, fd;
+
+    assert(strchr(id, '\t') == NULL && strchr(id, '\n') == NULL);
+
+    error = get_profiles_path(path, sizeof(path), 1);
+    if (error != 0)
+        return error;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+    fd = mkstemp(tmp_path);
+    if (fd == -1)
+        return errno;
+
+    f = fdopen(fd, "w");
+    if (f == NULL)
+    {
+        error = errno;
+        close(fd);
+        unlink(tmp_path);
+        return error;
+    }
+
+    fprintf(f, "# hdtime device profiles: identity, device size, block size,\n"
+               "# alignment, read size, seek count\n");
+
+    /* keep every other profile */
+    old = fopen(path, "r");
+    if (old != NULL)
+    {
+        while (fgets(line, sizeof(line), old) != NULL)
+        {
+            char copy[MAX_LINE_LEN];
+
+            strcpy(copy, line);
+            if (parse_profile_line(copy, line_id, &entry)
+                && !(strcmp(line_id, id) == 0
+                     && same_geometry(&entry.info, &profile->info)))
+                fputs(line, f);
+        }
+        fclose(old);
+    }
+
+    fprintf(f, "%s\t%" PRIu64 "\t%u\t%zu\t%zu\t%u\n",
+            id, profile->info.dev_size, profile->info.block_size,
+            profile->info.alignment, profile->read_size, profile->num_seeks);
+
+    if (ferror(f))
+        error = EIO;
+    if (fclose(f) != 0 && error == 0)
+        error = errno;
+
+    if (error == 0 && rename(tmp_path, path) != 0)
+        error = errno;
+
+    if (error != 0)
+        unlink(tmp_path);
+
+    return error;
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
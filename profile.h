@@ -0,0 +1,61 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* profile.h - persistent per-device calibration profiles */
+
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+
+/* get size_t */
+#include <stddef.h>
+
+/* get uint64_t */
+#include <stdint.h>
+
+#include "devio.h"
+
+
+/* Maximum length of a device identity, including terminator. */
+#define DEVICE_ID_LEN 256
+
+
+/* Calibration chosen for a device, and what it was chosen for. */
+struct device_profile {
+    size_t read_size;           /* sequential read size */
+    unsigned int num_seeks;     /* random reads in the seek test */
+    struct blkdev_info info;    /* must match, for the rest to be valid */
+};
+
+
+int get_device_id(int fd, char *buf, size_t size);
+
+int load_profile(const char *id, struct device_profile *profile);
+
+int save_profile(const char *id, const struct device_profile *profile);
+
+
+#endif  /* _PROFILE_H */
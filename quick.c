@@ -0,0 +1,345 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* quick.c - quick triage within a hard time budget
+ *
+ * Estimates the sequential read speed from short reads in a few zones
+ * spread across the device, and the random access time from stratified
+ * random reads, with 95% confidence intervals. The random phase gets its
+ * share of the budget up front, whatever the sequential phase took. A read
+ * is started only if it's expected to end within its phase's share, going
+ * by how long the previous read took. The first read of each phase can't
+ * be predicted, so the test may overrun the budget by about one read per
+ * phase.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "quick.h"
+#include "watchdog.h"
+
+
+/* Default time budget of the whole test. */
+#define DEFAULT_BUDGET_NS (4 * NS_PER_SEC)
+
+/* Fraction of the budget for the sequential phase. */
+#define SEQ_BUDGET_FRACTION 0.5
+
+/* Number of zones of the sequential phase. */
+#define NUM_ZONES 8
+
+/* Transfer size of the sequential phase. */
+#define SEQ_READ_BYTES (4 * MIB)
+
+/* Number of strata of the random phase, i.e. reads per round. */
+#define NUM_STRATA 256
+
+/* Maximum number of random reads. */
+#define MAX_RAND_SAMPLES (16 * NUM_STRATA)
+
+
+struct quick_results {
+    unsigned int zones;
+    unsigned int zone_index[NUM_ZONES];
+    double zone_speed[NUM_ZONES];   /* bytes per second */
+    unsigned int fastest_zone;
+    unsigned int slowest_zone;
+    double seq_mean;                /* bytes per second */
+    double seq_ci;                  /* half-width of the 95% CI */
+    size_t samples;
+    unsigned int block_size;
+    double rand_mean;               /* nanoseconds */
+    double rand_ci;                 /* half-width of the 95% CI */
+    uint64_t elapsed_ns;
+};
+
+
+
+/*
+ * Read sequentially from each zone, for an equal share of phase_ns.
+ *
+ * Stores the speed of each zone that could be read in time, in bytes per
+ * second, in zone_speed, and its index in zone_index. The first read in a
+ * zone is left out of its speed if there are more, as it includes the
+ * time to get there. Returns the number of zones read.
+ */
+static unsigned int sample_zones(int fd, const struct blkdev_info *info,
+        uint64_t phase_ns, unsigned int *zone_index, double *zone_speed)
+{
+    const size_t size = min(align_ceil(SEQ_READ_BYTES, info->alignment),
+                            (size_t)(info->dev_size / NUM_ZONES
+                                     / info->alignment * info->alignment));
+    const uint64_t zone_ns = phase_ns / NUM_ZONES;
+    char *const buffer = allocate_aligned_memory(info->alignment, size);
+    const uint64_t phase_start_ns = get_cur_ns();
+    uint64_t read_ns = 0;       /* how long the last read took */
+    unsigned int zone, done = 0;
+
+    assert(size > 0);
+
+    for (zone=0; zone<NUM_ZONES; zone++)
+    {
+        const uint64_t zone_start = (info->dev_size / NUM_ZONES * zone)
+                                    / info->block_size * info->block_size;
+        const uint64_t zone_end = zone_start + info->dev_size / NUM_ZONES;
+        const uint64_t deadline_ns = phase_start_ns + (zone + 1) * zone_ns;
+        const uint64_t start_ns = get_cur_ns();
+        uint64_t first_ns = 0, now_ns = start_ns;
+        uint64_t offset = zone_start;
+        unsigned int reads = 0;
+
+        while (now_ns + read_ns <= deadline_ns
+               && offset + size <= zone_end && !watchdog_aborting())
+        {
+            const uint64_t t0 = now_ns;
+
+            read_at(fd, buffer, size, offset);
+            now_ns = get_cur_ns();
+            read_ns = now_ns - t0;
+
+            if (reads++ == 0)
+                first_ns = now_ns;
+            offset += size;
+        }
+
+        /* out of time for this zone */
+        if (reads == 0)
+            continue;
+
+        zone_index[done] = zone;
+        zone_speed[done++] = reads > 1
+                             ? (double)(reads - 1) * size * NS_PER_SEC
+                               / max(now_ns - first_ns, (uint64_t)1)
+                             : (double)size * NS_PER_SEC
+                               / max(now_ns - start_ns, (uint64_t)1);
+    }
+
+    free(buffer);
+
+    return done;
+}
+
+
+
+/*
+ * Do stratified random reads for phase_ns, or up to MAX_RAND_SAMPLES.
+ *
+ * Each round splits the device into NUM_STRATA equal strata, and reads
+ * one random block from each, in random order. This spreads the reads
+ * more evenly over the device than plain random sampling, so fewer of
+ * them give a steadier estimate of the access time. Stores each read's
+ * latency, in nanoseconds, in lat. Returns the number of reads.
+ */
+static size_t sample_random(int fd, const struct blkdev_info *info,
+        uint64_t phase_ns, double *lat)
+{
+    const uint64_t stratum_blocks = max(info->num_blocks / NUM_STRATA,
+                                        (uint64_t)1);
+    const unsigned int strata = min((uint64_t)NUM_STRATA, info->num_blocks);
+    char *const buffer = allocate_aligned_memory(info->alignment,
+            info->block_size);
+    unsigned int order[NUM_STRATA];
+    const uint64_t start_ns = get_cur_ns();
+    uint64_t now_ns = start_ns, read_ns = 0;
+    size_t count = 0;
+    unsigned int i;
+
+    for (i=0; i<strata; i++)
+        order[i] = i;
+
+    while (count < MAX_RAND_SAMPLES && now_ns - start_ns + read_ns <= phase_ns
+           && !watchdog_aborting())
+    {
+        /* Fisher-Yates shuffle; visiting the strata in order would make
+         * every seek a short one */
+        for (i=strata-1; i>0; i--)
+        {
+            const unsigned int j = random64() % (i + 1);
+            const unsigned int tmp = order[i];
+
+            order[i] = order[j];
+            order[j] = tmp;
+        }
+
+        for (i=0; i<strata && count < MAX_RAND_SAMPLES
+                  && now_ns - start_ns + read_ns <= phase_ns; i++)
+        {
+            const uint64_t block = order[i] * stratum_blocks
+                                   + random64() % stratum_blocks;
+            const uint64_t t0 = get_cur_ns();
+
+            read_at(fd, buffer, info->block_size,
+                    min(block, info->num_blocks - 1) * info->block_size);
+            now_ns = get_cur_ns();
+            read_ns = now_ns - t0;
+
+            lat[count++] = (double)read_ns;
+        }
+    }
+
+    free(buffer);
+
+    return count;
+}
+
+
+
+/*
+ * Print the quick triage results. A confidence interval needs at least
+ * two samples; with fewer, the speed or access time isn't reported.
+ */
+static void print_quick(const char *devname, const struct quick_results *res)
+{
+    char *const elapsed = humanize_time(res->elapsed_ns, 3);
+
+    printf("\n%s (quick triage, %s):\n", devname, elapsed);
+
+    if (res->zones < 2)
+        printf(" Sequential read speed: not measured (%u zone%s read in time)\n",
+               res->zones, res->zones != 1 ? "s" : "");
+    else
+    {
+        const struct human_value speed = humanize_binary_speed(res->seq_mean);
+        const struct human_value speed_low = humanize_binary_speed(
+                max(res->seq_mean - res->seq_ci, 0.0));
+        const struct human_value speed_high = humanize_binary_speed(
+                res->seq_mean + res->seq_ci);
+        const struct human_value fast = humanize_binary_speed(
+                res->zone_speed[res->fastest_zone]);
+        const struct human_value slow = humanize_binary_speed(
+                res->zone_speed[res->slowest_zone]);
+
+        printf(" Sequential read speed: %.2Lf %s (95%% CI: %.2Lf %s .. %.2Lf %s)\n"
+               "   from %u zones; fastest %.2Lf %s at %u%%, slowest %.2Lf %s at %u%%\n",
+               speed.value, speed.unit, speed_low.value, speed_low.unit,
+               speed_high.value, speed_high.unit,
+               res->zones, fast.value, fast.unit,
+               100 * res->zone_index[res->fastest_zone] / NUM_ZONES,
+               slow.value, slow.unit,
+               100 * res->zone_index[res->slowest_zone] / NUM_ZONES);
+    }
+
+    if (res->samples < 2)
+        printf(" Random access time: not measured (%zu read%s in time)\n",
+               res->samples, res->samples != 1 ? "s" : "");
+    else
+    {
+        char *const access = humanize_time((uint64_t)res->rand_mean, 3);
+        char *const access_low = humanize_time(
+                (uint64_t)max(res->rand_mean - res->rand_ci, 0.0), 3);
+        char *const access_high = humanize_time(
+                (uint64_t)(res->rand_mean + res->rand_ci), 3);
+
+        printf(" Random access time: %s (95%% CI: %s .. %s)\n"
+               "   from %zu stratified random reads of %u bytes\n"
+               " Seeks/second: %.3f\n",
+               access, access_low, access_high,
+               res->samples, res->block_size,
+               NS_PER_SEC / max(res->rand_mean, 1.0));
+
+        free(access);
+        free(access_low);
+        free(access_high);
+    }
+
+    free(elapsed);
+}
+
+
+
+/*
+ * Run the quick triage test on a block device, and print the results.
+ *
+ * The whole test takes about opts->budget_ns (DEFAULT_BUDGET_NS if zero).
+ * Exits in case of error.
+ */
+void run_and_print_quick(const char *devname,
+        const struct bench_options *opts)
+{
+    const uint64_t budget_ns = opts->budget_ns != 0
+                               ? opts->budget_ns : DEFAULT_BUDGET_NS;
+    const uint64_t seq_ns = (uint64_t)(budget_ns * SEQ_BUDGET_FRACTION);
+    const uint64_t rand_ns = budget_ns - seq_ns;
+    double *lat = malloc(MAX_RAND_SAMPLES * sizeof(*lat));
+    struct quick_results res;
+    struct blkdev_info info;
+    uint64_t start_ns;
+    char *budget;
+    unsigned int i;
+    int fd;
+
+    die_if(lat == NULL, "malloc");
+
+    fd = open_blkdev(devname);
+    get_blkdev_info(fd, &info);
+    init_randomness();
+
+    budget = humanize_time(budget_ns, 3);
+    printf("Quick triage within %s, please wait...\n", budget);
+    free(budget);
+
+    start_ns = get_cur_ns();
+    res.zones = sample_zones(fd, &info, seq_ns, res.zone_index,
+                             res.zone_speed);
+    /* whatever is left, but never less than the random phase's share */
+    res.samples = sample_random(fd, &info,
+            max(budget_ns - min(get_cur_ns() - start_ns, budget_ns), rand_ns),
+            lat);
+    res.elapsed_ns = get_cur_ns() - start_ns;
+    res.block_size = info.block_size;
+
+    close(fd);
+
+    get_mean_ci(res.zone_speed, res.zones, &res.seq_mean, &res.seq_ci);
+    get_mean_ci(lat, res.samples, &res.rand_mean, &res.rand_ci);
+
+    res.slowest_zone = res.fastest_zone = 0;
+    for (i=1; i<res.zones; i++)
+    {
+        if (res.zone_speed[i] < res.zone_speed[res.slowest_zone])
+            res.slowest_zone = i;
+        if (res.zone_speed[i] > res.zone_speed[res.fastest_zone])
+            res.fastest_zone = i;
+    }
+
+    print_quick(devname, &res);
+
+    free(lat);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
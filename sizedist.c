@@ -0,0 +1,319 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* sizedist.c - request size distributions
+ *
+ * Distributions are given as text:
+ *
+ *   lognormal:MEDIAN,SIGMA     e.g. lognormal:16K,1.0
+ *   bimodal:SMALL,LARGE,P      e.g. bimodal:4K,1M,0.1 (P is the share
+ *                              of large requests)
+ *   file:PATH                  an empirical histogram, one "SIZE WEIGHT"
+ *                              pair per line; '#' starts a comment
+ *
+ * Samples are in bytes; callers round them to their block size.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include <stdint.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "humanize.h"
+#include "sizedist.h"
+
+
+/* Lognormal samples are clamped to this many standard deviations above
+ * the median, and to MAX_SIZE_BYTES. */
+#define LOGNORMAL_MAX_SIGMAS 4
+
+/* Largest size of any distribution. */
+#define MAX_SIZE_BYTES (64 * 1024 * 1024)
+
+/* Longest line of a histogram file. */
+#define MAX_LINE_LEN 256
+
+
+
+/*
+ * Get a uniform random number in (0, 1].
+ */
+static double uniform(uint64_t *seed)
+{
+    return ((random64_r(seed) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+
+
+/*
+ * Parse a size, which must be nonzero and at most MAX_SIZE_BYTES.
+ */
+static int parse_size(const char *arg, size_t *size)
+{
+    uint64_t value;
+
+    if (parse_human_size(arg, &value) != 0 || value == 0
+        || value > MAX_SIZE_BYTES)
+        return EINVAL;
+
+    *size = (size_t)value;
+
+    return 0;
+}
+
+
+
+/*
+ * Parse a number in [min_value, max_value].
+ */
+static int parse_double(const char *arg, double min_value, double max_value,
+        double *result)
+{
+    char *end;
+
+    errno = 0;
+    *result = strtod(arg, &end);
+    if (errno != 0 || end == arg || *end != '\0'
+        || *result < min_value || *result > max_value)
+        return EINVAL;
+
+    return 0;
+}
+
+
+
+/*
+ * Load an empirical histogram from a file. Returns zero on success, or an
+ * error number in case of error.
+ */
+static int load_histogram(const char *path, struct size_dist *dist)
+{
+    char line[MAX_LINE_LEN];
+    unsigned int capacity = 0, i;
+    double total = 0;
+    FILE *f;
+
+    f = fopen(path, "r");
+    if (f == NULL)
+        return errno;
+
+    dist->count = 0;
+    dist->max_size = 0;
+
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        char size_str[MAX_LINE_LEN], extra[MAX_LINE_LEN];
+        char *const comment = strchr(line, '#');
+        double weight;
+        size_t size;
+        int fields;
+
+        if (comment != NULL)
+            *comment = '\0';
+
+        fields = sscanf(line, "%s %lf %s", size_str, &weight, extra);
+        if (fields <= 0)
+            continue;
+
+        if (fields != 2 || parse_size(size_str, &size) != 0 || weight < 0)
+        {
+            fclose(f);
+            return EINVAL;
+        }
+
+        if (dist->count == capacity)
+        {
+            capacity = capacity != 0 ? 2 * capacity : 16;
+            dist->sizes = realloc(dist->sizes, capacity * sizeof(*dist->sizes));
+            dist->cdf = realloc(dist->cdf, capacity * sizeof(*dist->cdf));
+            die_if(dist->sizes == NULL || dist->cdf == NULL, "realloc");
+        }
+
+        total += weight;
+        dist->sizes[dist->count] = size;
+        dist->cdf[dist->count] = total;
+        dist->max_size = max(dist->max_size, size);
+        dist->count++;
+    }
+
+    fclose(f);
+
+    if (total <= 0)
+        return EINVAL;
+
+    for (i=0; i<dist->count; i++)
+        dist->cdf[i] /= total;
+
+    return 0;
+}
+
+
+
+/*
+ * Parse a request size distribution.
+ *
+ * Fills in dist, which should be freed with free_size_dist when no longer
+ * needed. Returns zero on success, or an error number in case of error
+ * (EINVAL if spec is invalid).
+ */
+int parse_size_dist(const char *spec, struct size_dist *dist)
+{
+    const char *const colon = strchr(spec, ':');
+    char *args, *tok, *saveptr;
+    char *fields[3];
+    unsigned int num_fields = 0;
+    int retval = EINVAL;
+
+    memset(dist, 0, sizeof(*dist));
+
+    if (colon == NULL)
+        return EINVAL;
+
+    if (strncmp(spec, "file:", strlen("file:")) == 0)
+    {
+        dist->kind = SIZE_DIST_EMPIRICAL;
+        retval = load_histogram(colon + 1, dist);
+        if (retval != 0)
+            free_size_dist(dist);
+        return retval;
+    }
+
+    args = strdup(colon + 1);
+    die_if(args == NULL, "strdup");
+
+    /* more than 3 fields is an error, and counts as 4 */
+    for (tok = strtok_r(args, ",", &saveptr); tok != NULL;
+         tok = strtok_r(NULL, ",", &saveptr))
+    {
+        if (num_fields == 3)
+        {
+            num_fields++;
+            break;
+        }
+        fields[num_fields++] = tok;
+    }
+
+    if (strncmp(spec, "lognormal:", strlen("lognormal:")) == 0
+        && num_fields == 2)
+    {
+        size_t median;
+
+        dist->kind = SIZE_DIST_LOGNORMAL;
+        if (parse_size(fields[0], &median) == 0
+            && parse_double(fields[1], 0, 10, &dist->sigma) == 0)
+        {
+            dist->mu = log((double)median);
+            dist->max_size = (size_t)min(exp(dist->mu + LOGNORMAL_MAX_SIGMAS
+                                                        * dist->sigma),
+                                         (double)MAX_SIZE_BYTES);
+            retval = 0;
+        }
+    }
+    else if (strncmp(spec, "bimodal:", strlen("bimodal:")) == 0
+             && num_fields == 3)
+    {
+        dist->kind = SIZE_DIST_BIMODAL;
+        if (parse_size(fields[0], &dist->small) == 0
+            && parse_size(fields[1], &dist->large) == 0
+            && parse_double(fields[2], 0, 1, &dist->large_fraction) == 0)
+        {
+            dist->max_size = max(dist->small, dist->large);
+            retval = 0;
+        }
+    }
+
+    free(args);
+
+    return retval;
+}
+
+
+
+/*
+ * Draw a request size from a distribution, using and updating seed.
+ * The result is between 1 and dist->max_size bytes.
+ */
+size_t size_dist_sample(const struct size_dist *dist, uint64_t *seed)
+{
+    double u, z, size;
+    unsigned int lo, hi;
+
+    switch (dist->kind)
+    {
+        case SIZE_DIST_LOGNORMAL:
+            /* Box-Muller */
+            u = uniform(seed);
+            z = sqrt(-2 * log(u)) * cos(2 * M_PI * uniform(seed));
+            size = exp(dist->mu + dist->sigma * z);
+            return (size_t)max(min(size, (double)dist->max_size), 1.0);
+
+        case SIZE_DIST_BIMODAL:
+            return uniform(seed) <= dist->large_fraction
+                   ? dist->large : dist->small;
+
+        case SIZE_DIST_EMPIRICAL:
+            /* the first size whose cumulative probability reaches u */
+            u = uniform(seed);
+            lo = 0;
+            hi = dist->count - 1;
+            while (lo < hi)
+            {
+                const unsigned int mid = (lo + hi) / 2;
+
+                if (dist->cdf[mid] < u)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            return dist->sizes[lo];
+    }
+
+    assert(0);
+    return 1;
+}
+
+
+
+/*
+ * Free the memory held by a size distribution.
+ */
+void free_size_dist(struct size_dist *dist)
+{
+    free(dist->sizes);
+    free(dist->cdf);
+    dist->sizes = NULL;
+    dist->cdf = NULL;
+    dist->count = 0;
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
@@ -0,0 +1,74 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+
+/* sizedist.h - request size distributions */
+
+
+#ifndef _SIZEDIST_H
+#define _SIZEDIST_H
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+
+/* get size_t */
+#include <stddef.h>
+
+/* get uint64_t */
+#include <stdint.h>
+
+
+enum size_dist_kind {
+    SIZE_DIST_LOGNORMAL,
+    SIZE_DIST_BIMODAL,
+    SIZE_DIST_EMPIRICAL,
+};
+
+struct size_dist {
+    enum size_dist_kind kind;
+    size_t max_size;            /* larger samples are clamped to this */
+
+    /* lognormal: parameters of the size's natural logarithm */
+    double mu;
+    double sigma;
+
+    /* bimodal */
+    size_t small;
+    size_t large;
+    double large_fraction;
+
+    /* empirical: sizes and their cumulative probabilities */
+    size_t *sizes;
+    double *cdf;
+    unsigned int count;
+};
+
+
+int parse_size_dist(const char *spec, struct size_dist *dist);
+
+size_t size_dist_sample(const struct size_dist *dist, uint64_t *seed);
+
+void free_size_dist(struct size_dist *dist);
+
+
+#endif  /* _SIZEDIST_H */
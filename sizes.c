@@ -0,0 +1,349 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* sizes.c - latency under a mix of request sizes
+ *
+ * Real workloads rarely use a single request size, and a fixed-size
+ * benchmark can't show how sizes interact: a small read queued behind a
+ * large one waits for its transfer. This mode runs random reads with
+ * sizes drawn from a distribution, groups the results by size, and then
+ * runs each common size alone at the same queue depth. The difference is
+ * the latency a size pays for sharing the device with the others.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "openloop.h"
+#include "sizedist.h"
+#include "sizes.h"
+#include "watchdog.h"
+
+
+/* Distribution used if none is given: mostly small reads, with some
+ * large ones mixed in. */
+#define DEFAULT_SIZE_DIST "bimodal:4K,1M,0.1"
+
+/* Default reads in flight. */
+#define DEFAULT_QUEUE_DEPTH 8
+
+/* Sizes are grouped by power of 2; one bucket per bit of size_t. */
+#define NUM_BUCKETS 64
+
+/* Buckets with less than this share of the reads aren't run alone. */
+#define MIN_ALONE_SHARE 0.01
+
+/* Flag head-of-line blocking if a size's p99 grows this much when mixed. */
+#define HOL_P99_RATIO 2.0
+
+
+/* Reads whose size is in [2^k, 2^(k+1)). */
+struct size_bucket {
+    struct sample_buf lat;
+    struct sample_buf sizes;
+    uint64_t bytes;
+    size_t median_size;
+    struct latency_stats stats;         /* mixed with the other sizes */
+    struct latency_stats alone_stats;   /* median_size alone */
+    uint64_t alone_bytes;
+    uint64_t alone_elapsed_ns;
+    int ran_alone;
+};
+
+
+
+/*
+ * Get the bucket of a size: the position of its most significant bit.
+ */
+static unsigned int size_bucket_of(uint64_t size)
+{
+    unsigned int k = 0;
+
+    assert(size != 0);
+
+    while (size >>= 1)
+        k++;
+
+    return k;
+}
+
+
+
+/*
+ * Format a size in a few characters, e.g. "512", "4K" or "1M".
+ */
+static void format_size(char *buf, size_t len, size_t size)
+{
+    if (size >= 1024 * 1024 && size % (1024 * 1024) == 0)
+        snprintf(buf, len, "%zuM", size / (1024 * 1024));
+    else if (size >= 1024 && size % 1024 == 0)
+        snprintf(buf, len, "%zuK", size / 1024);
+    else
+        snprintf(buf, len, "%zu", size);
+}
+
+
+
+/*
+ * Split the results of a mixed run into buckets, and compute each one's
+ * statistics. Returns the number of reads.
+ */
+static uint64_t fill_buckets(const struct openloop_result *res,
+        struct size_bucket *buckets)
+{
+    uint64_t i;
+    unsigned int k;
+
+    assert(res->lat.count == res->sizes.count);
+
+    for (k=0; k<NUM_BUCKETS; k++)
+    {
+        memset(&buckets[k], 0, sizeof(buckets[k]));
+        sample_buf_init(&buckets[k].lat);
+        sample_buf_init(&buckets[k].sizes);
+    }
+
+    for (i=0; i<res->lat.count; i++)
+    {
+        struct size_bucket *const b = &buckets[size_bucket_of(res->sizes.ns[i])];
+
+        sample_buf_add(&b->lat, res->lat.ns[i]);
+        sample_buf_add(&b->sizes, res->sizes.ns[i]);
+        b->bytes += res->sizes.ns[i];
+    }
+
+    for (k=0; k<NUM_BUCKETS; k++)
+    {
+        struct size_bucket *const b = &buckets[k];
+
+        if (b->lat.count == 0)
+            continue;
+
+        get_latency_stats(&b->lat, &b->stats);
+        qsort(b->sizes.ns, b->sizes.count, sizeof(*b->sizes.ns), cmp_uint64);
+        b->median_size = (size_t)b->sizes.ns[b->sizes.count / 2];
+    }
+
+    return res->lat.count;
+}
+
+
+
+/*
+ * Print the per-size results of the mixed run, and of each size alone.
+ */
+static void print_buckets(const struct size_bucket *buckets,
+        uint64_t total_reads, const struct latency_stats *all_stats,
+        uint64_t all_bytes, uint64_t elapsed_ns)
+{
+    char label[48], size_str[24];
+    unsigned int k;
+
+    print_stats_header("size (share)");
+
+    for (k=0; k<NUM_BUCKETS; k++)
+    {
+        const struct size_bucket *const b = &buckets[k];
+
+        if (b->lat.count == 0)
+            continue;
+
+        format_size(size_str, sizeof(size_str), b->median_size);
+        snprintf(label, sizeof(label), "%s (%.1f%%)", size_str,
+                 100.0 * b->lat.count / total_reads);
+        print_stats_row(label, &b->stats, b->bytes, elapsed_ns);
+    }
+    print_stats_row("all", all_stats, all_bytes, elapsed_ns);
+
+    printf("\n Each size alone, at the same queue depth:\n\n");
+    print_stats_header("size");
+
+    for (k=0; k<NUM_BUCKETS; k++)
+    {
+        const struct size_bucket *const b = &buckets[k];
+
+        if (!b->ran_alone)
+            continue;
+
+        format_size(size_str, sizeof(size_str), b->median_size);
+        print_stats_row(size_str, &b->alone_stats, b->alone_bytes,
+                        b->alone_elapsed_ns);
+    }
+}
+
+
+
+/*
+ * Measure random read latency under a mix of request sizes, and print
+ * the results.
+ *
+ * Sizes are drawn from opts->size_dist (DEFAULT_SIZE_DIST if NULL), see
+ * parse_size_dist. Reads are issued in a closed loop with
+ * opts->queue_depth in flight (DEFAULT_QUEUE_DEPTH if zero), for
+ * opts->duration_ns; then each size with at least MIN_ALONE_SHARE of
+ * the reads runs alone for as long. Exits in case of error.
+ */
+void run_and_print_sizes(const char *devname,
+        const struct bench_options *opts)
+{
+    const char *const spec = opts->size_dist != NULL
+                             ? opts->size_dist : DEFAULT_SIZE_DIST;
+    struct size_bucket *buckets = malloc(NUM_BUCKETS * sizeof(*buckets));
+    struct latency_stats all_stats;
+    struct openloop_params p;
+    struct openloop_result res;
+    struct blkdev_info info;
+    struct size_dist dist;
+    uint64_t total_reads;
+    char size_str[24];
+    char *duration;
+    int status, blocked = 0;
+    unsigned int k;
+
+    die_if(buckets == NULL, "malloc");
+
+    status = parse_size_dist(spec, &dist);
+    if (status != 0)
+    {
+        fprintf(stderr, "error: invalid size distribution '%s'\n", spec);
+        exit(1);
+    }
+
+    p.fd = open_blkdev(devname);
+    get_blkdev_info(p.fd, &info);
+    init_randomness();
+
+    p.info = &info;
+    p.first_block = 0;
+    p.num_blocks = 0;
+    p.read_size = align_ceil(dist.max_size, info.block_size);
+    p.size_dist = &dist;
+    p.rate = 0;
+    p.max_inflight = opts->queue_depth != 0
+                     ? opts->queue_depth : DEFAULT_QUEUE_DEPTH;
+    p.duration_ns = opts->duration_ns;
+    p.seed = random64();
+
+    if (p.read_size > info.dev_size)
+    {
+        fprintf(stderr, "error: device too small for %zu-byte reads\n",
+                p.read_size);
+        exit(1);
+    }
+
+    duration = humanize_time(opts->duration_ns, 3);
+
+    printf("Reading with sizes from %s, %u in flight, for %s, please wait...\n",
+           spec, p.max_inflight, duration);
+    run_open_loop(&p, &res);
+
+    total_reads = fill_buckets(&res, buckets);
+    if (total_reads == 0)
+    {
+        fprintf(stderr, "error: no reads completed in %s\n", duration);
+        exit(1);
+    }
+    get_latency_stats(&res.lat, &all_stats);
+
+    p.size_dist = NULL;
+    for (k=0; k<NUM_BUCKETS; k++)
+    {
+        struct size_bucket *const b = &buckets[k];
+        struct openloop_result alone;
+
+        if (b->lat.count < MIN_ALONE_SHARE * total_reads
+            || watchdog_aborting())
+            continue;
+
+        p.read_size = b->median_size;
+        p.seed = random64();
+
+        format_size(size_str, sizeof(size_str), b->median_size);
+        printf("Reading only %s blocks for %s, please wait...\n",
+               size_str, duration);
+        run_open_loop(&p, &alone);
+
+        get_latency_stats(&alone.lat, &b->alone_stats);
+        b->alone_bytes = alone.bytes;
+        b->alone_elapsed_ns = alone.elapsed_ns;
+        b->ran_alone = 1;
+        sample_buf_free(&alone.lat);
+    }
+
+    free(duration);
+    close(p.fd);
+
+    printf("\n%s, random reads of mixed sizes (%s), %u in flight:\n\n",
+           devname, spec, p.max_inflight);
+    print_buckets(buckets, total_reads, &all_stats, res.bytes,
+                  res.elapsed_ns);
+
+    printf("\n");
+    for (k=0; k<NUM_BUCKETS; k++)
+    {
+        const struct size_bucket *const b = &buckets[k];
+        double p50_ratio, p99_ratio;
+
+        if (!b->ran_alone)
+            continue;
+
+        p50_ratio = (double)b->stats.p50 / max(b->alone_stats.p50, (uint64_t)1);
+        p99_ratio = (double)b->stats.p99 / max(b->alone_stats.p99, (uint64_t)1);
+        format_size(size_str, sizeof(size_str), b->median_size);
+        printf(" %s reads: p50 %.2fx, p99 %.2fx their latency alone\n",
+               size_str, p50_ratio, p99_ratio);
+
+        if (p99_ratio >= HOL_P99_RATIO)
+            blocked = 1;
+    }
+
+    if (blocked)
+        printf(" Some sizes wait behind others: consider serving small and large\n"
+               " requests from separate queues or devices.\n");
+
+    for (k=0; k<NUM_BUCKETS; k++)
+    {
+        sample_buf_free(&buckets[k].lat);
+        sample_buf_free(&buckets[k].sizes);
+    }
+    sample_buf_free(&res.lat);
+    sample_buf_free(&res.sizes);
+    free_size_dist(&dist);
+    free(buckets);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
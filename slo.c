@@ -0,0 +1,216 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* slo.c - maximum IOPS under a latency SLO
+ *
+ * Finds the highest rate of random reads a device sustains while a given
+ * latency percentile stays within a target, e.g. p99 < 2 ms. The device
+ * is first saturated, to bound the search; then the offered rate of
+ * open-loop reads is bisected.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "openloop.h"
+#include "slo.h"
+
+
+/* Default maximum reads in flight. */
+#define DEFAULT_MAX_INFLIGHT 256
+
+/* Maximum number of bisection steps. */
+#define MAX_BISECT_STEPS 10
+
+/* Stop bisecting once the search range is within this fraction. */
+#define BISECT_PRECISION 0.02
+
+/* A rate only passes if the device completes at least this fraction of
+ * it; otherwise the device is falling behind, and latency is unbounded. */
+#define MIN_ACHIEVED_FRACTION 0.95
+
+
+
+/*
+ * Run open-loop reads at a rate, and print a line with the outcome.
+ *
+ * Stores the results in res, and the measured percentile in *p_pct_ns.
+ * Returns whether the SLO was met.
+ */
+static int try_rate(struct openloop_params *p, double rate, double pct,
+        uint64_t target_ns, struct openloop_result *res, uint64_t *p_pct_ns)
+{
+    struct latency_stats stats;
+    long double achieved;
+    char *pct_time;
+    int pass;
+
+    p->rate = rate;
+    run_open_loop(p, res);
+
+    get_latency_stats(&res->lat, &stats);
+    *p_pct_ns = stats.count > 0
+                ? percentile_sorted(res->lat.ns, res->lat.count, pct) : 0;
+    achieved = stats.count / ((long double)max(res->elapsed_ns, (uint64_t)1)
+                              / NS_PER_SEC);
+
+    pass = stats.count > 0 && *p_pct_ns <= target_ns
+           && achieved >= MIN_ACHIEVED_FRACTION * rate;
+
+    pct_time = humanize_time(*p_pct_ns, 3);
+    printf(" %14.1f %14.1Lf %14s   %s\n",
+           rate, achieved, pct_time, pass ? "pass" : "FAIL");
+    free(pct_time);
+
+    return pass;
+}
+
+
+
+/*
+ * Run the IOPS at SLO search on a block device, and print the results.
+ *
+ * The SLO is given by opts->slo_latency_ns, at the opts->slo_percentile
+ * percentile. Each step runs for opts->duration_ns, with at most
+ * opts->queue_depth reads in flight. Exits in case of error.
+ */
+void run_and_print_slo(const char *devname,
+        const struct bench_options *opts)
+{
+    const double pct = opts->slo_percentile;
+    const uint64_t target_ns = opts->slo_latency_ns;
+    struct openloop_params p;
+    struct openloop_result res, best;
+    struct latency_stats stats;
+    struct blkdev_info info;
+    double lo, hi, saturation;
+    uint64_t pct_ns;
+    char *target, *duration;
+    int step;
+
+    if (target_ns == 0)
+    {
+        fprintf(stderr, "error: slo mode requires a latency target (--slo)\n");
+        exit(1);
+    }
+
+    p.fd = open_blkdev(devname);
+    get_blkdev_info(p.fd, &info);
+    init_randomness();
+
+    p.info = &info;
+    p.first_block = 0;
+    p.num_blocks = 0;
+    p.read_size = info.block_size;
+    p.size_dist = NULL;
+    p.max_inflight = opts->queue_depth != 0
+                     ? opts->queue_depth : DEFAULT_MAX_INFLIGHT;
+    p.duration_ns = opts->duration_ns;
+    p.seed = random64();
+
+    target = humanize_time(target_ns, 3);
+    duration = humanize_time(opts->duration_ns, 3);
+
+    printf("Saturating device with %u reads in flight for %s, please wait...\n",
+           p.max_inflight, duration);
+
+    p.rate = 0;
+    run_open_loop(&p, &res);
+    saturation = res.lat.count / ((double)max(res.elapsed_ns, (uint64_t)1)
+                                  / NS_PER_SEC);
+    sample_buf_free(&res.lat);
+
+    printf("Searching for the highest rate with p%g <= %s, %s per step, please wait...\n"
+           "\n"
+           " %14s %14s %14s   %s\n",
+           pct, target, duration, "offered IOPS", "achieved IOPS", "percentile",
+           "SLO");
+
+    sample_buf_init(&best.lat);
+    lo = 0;
+    hi = saturation;
+
+    for (step=0; step < MAX_BISECT_STEPS && hi - lo > BISECT_PRECISION * hi; step++)
+    {
+        /* try the saturation rate itself first; it may well pass */
+        const double rate = step == 0 ? hi : (lo + hi) / 2;
+
+        if (try_rate(&p, rate, pct, target_ns, &res, &pct_ns))
+        {
+            sample_buf_free(&best.lat);
+            best = res;
+            lo = rate;
+            if (step == 0)
+                break;
+        }
+        else
+        {
+            sample_buf_free(&res.lat);
+            hi = rate;
+        }
+    }
+
+    close(p.fd);
+
+    printf("\n"
+           "%s:\n"
+           " %u-byte open-loop random reads, up to %u in flight\n"
+           " Saturation IOPS (closed loop): %.1f\n",
+           devname, info.block_size, p.max_inflight, saturation);
+
+    if (lo > 0)
+    {
+        get_latency_stats(&best.lat, &stats);
+
+        printf(" IOPS at SLO (p%g <= %s): %.1f\n"
+               "\n",
+               pct, target, lo);
+        print_stats_header("rate");
+        print_stats_row("at SLO", &stats, best.bytes, best.elapsed_ns);
+    }
+    else
+    {
+        printf(" SLO (p%g <= %s) not met at any rate tested, down to %.1f IOPS\n",
+               pct, target, hi);
+    }
+
+    free(target);
+    free(duration);
+    sample_buf_free(&best.lat);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
@@ -0,0 +1,331 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* sortread.c - offset-sorted batch reads versus random order
+ *
+ * Reads batches of random offsets, either in the order they were generated
+ * or sorted by offset (elevator order), at queue depth 1 and at a higher
+ * queue depth. This shows how much sorting I/O in the application helps,
+ * compared with leaving it to NCQ and the kernel's I/O scheduler.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "asyncio.h"
+#include "sortread.h"
+#include "watchdog.h"
+
+
+/* Default number of offsets per batch. */
+#define DEFAULT_BATCH_SIZE 64
+
+/* Default queue depth of the high queue depth phases. */
+#define DEFAULT_QUEUE_DEPTH 32
+
+
+/* A read request slot; up to queue depth slots are in flight. */
+struct read_slot {
+    struct iocb cb;
+    char *buffer;
+    uint64_t submit_ns;
+};
+
+struct batch_runner {
+    int fd;
+    size_t read_size;
+    unsigned int queue_depth;
+    struct async_ctx actx;
+    struct read_slot *slots;
+    unsigned int *free_slots;   /* stack of free slot indexes */
+    struct iocb **to_submit;
+    struct io_event *events;
+};
+
+struct phase_result {
+    struct sample_buf reads;    /* individual read latencies */
+    struct sample_buf batches;  /* whole batch latencies */
+    uint64_t elapsed_ns;
+};
+
+
+
+/*
+ * Prepare a batch runner, with up to queue_depth reads in flight. Exits
+ * in case of error.
+ */
+static void init_batch_runner(struct batch_runner *r, int fd,
+        const struct blkdev_info *info, unsigned int queue_depth)
+{
+    unsigned int i;
+
+    r->fd = fd;
+    r->read_size = info->block_size;
+    r->queue_depth = queue_depth;
+
+    r->slots = malloc(queue_depth * sizeof(*r->slots));
+    r->free_slots = malloc(queue_depth * sizeof(*r->free_slots));
+    r->to_submit = malloc(queue_depth * sizeof(*r->to_submit));
+    r->events = malloc(queue_depth * sizeof(*r->events));
+    die_if(r->slots == NULL || r->free_slots == NULL
+           || r->to_submit == NULL || r->events == NULL, "malloc");
+
+    for (i=0; i<queue_depth; i++)
+    {
+        r->slots[i].buffer = allocate_aligned_memory(info->alignment,
+                r->read_size);
+        r->free_slots[i] = i;
+    }
+
+    async_init(&r->actx, queue_depth);
+}
+
+
+
+static void destroy_batch_runner(struct batch_runner *r)
+{
+    unsigned int i;
+
+    async_destroy(&r->actx);
+
+    for (i=0; i<r->queue_depth; i++)
+        free(r->slots[i].buffer);
+
+    free(r->events);
+    free(r->to_submit);
+    free(r->free_slots);
+    free(r->slots);
+}
+
+
+
+/*
+ * Read a batch of offsets, in the given order.
+ *
+ * Keeps up to the runner's queue depth reads in flight, submitting them
+ * in array order. Adds each read's latency to lat. Exits in case of
+ * error.
+ */
+static void read_batch(struct batch_runner *r, const uint64_t *offsets,
+        unsigned int count, struct sample_buf *lat)
+{
+    unsigned int next = 0;
+    unsigned int num_free = r->queue_depth;
+
+    while (next < count || num_free < r->queue_depth)
+    {
+        int submit = 0;
+        int got, i;
+        uint64_t now_ns;
+
+        /* fill the queue */
+        now_ns = get_cur_ns();
+        while (num_free > 0 && next < count)
+        {
+            struct read_slot *slot = &r->slots[r->free_slots[--num_free]];
+
+            async_prep_read(&slot->cb, r->fd, slot->buffer, r->read_size,
+                    offsets[next++], slot);
+            slot->submit_ns = now_ns;
+            r->to_submit[submit++] = &slot->cb;
+        }
+
+        if (submit > 0)
+            async_submit(&r->actx, r->to_submit, submit);
+
+        got = async_reap(&r->actx, r->events, 1,
+                         r->queue_depth - num_free, NULL);
+        now_ns = get_cur_ns();
+
+        for (i=0; i<got; i++)
+        {
+            struct read_slot *slot = (struct read_slot *)(uintptr_t)r->events[i].data;
+
+            die_if_with_errno(r->events[i].res < 0, "read",
+                    (int)-r->events[i].res);
+
+            sample_buf_add(lat, now_ns - slot->submit_ns);
+            r->free_slots[num_free++] = slot - r->slots;
+        }
+    }
+}
+
+
+
+/*
+ * Read batches of random offsets for duration_ns, optionally sorting
+ * each batch first. Every phase starts from the same seed, so they read
+ * the same sequence of batches. Exits in case of error.
+ */
+static void run_phase(int fd, const struct blkdev_info *info,
+        unsigned int batch_size, unsigned int queue_depth, int sorted,
+        uint64_t seed, uint64_t duration_ns, struct phase_result *res)
+{
+    uint64_t *offsets = malloc(batch_size * sizeof(*offsets));
+    struct batch_runner r;
+    uint64_t start_ns, now_ns;
+
+    die_if(offsets == NULL, "malloc");
+
+    init_batch_runner(&r, fd, info, queue_depth);
+    sample_buf_init(&res->reads);
+    sample_buf_init(&res->batches);
+
+    start_ns = now_ns = get_cur_ns();
+
+    while (now_ns - start_ns < duration_ns && !watchdog_aborting())
+    {
+        const uint64_t batch_start_ns = now_ns;
+        unsigned int i;
+
+        for (i=0; i<batch_size; i++)
+            offsets[i] = (random64_r(&seed) % info->num_blocks)
+                         * info->block_size;
+
+        /* sorting is part of the application's cost, so it's timed */
+        if (sorted)
+            qsort(offsets, batch_size, sizeof(offsets[0]), cmp_uint64);
+
+        read_batch(&r, offsets, batch_size, &res->reads);
+        now_ns = get_cur_ns();
+
+        sample_buf_add(&res->batches, now_ns - batch_start_ns);
+    }
+
+    res->elapsed_ns = now_ns - start_ns;
+
+    destroy_batch_runner(&r);
+    free(offsets);
+}
+
+
+
+/*
+ * Run the sorted versus random order batch read test on a block device,
+ * and print the results.
+ *
+ * Reads batches of opts->batch_size random offsets, in random and in
+ * sorted order, at queue depth 1 and at opts->queue_depth, for
+ * opts->duration_ns each. Exits in case of error.
+ */
+void run_and_print_sortread(const char *devname,
+        const struct bench_options *opts)
+{
+    const unsigned int batch_size = opts->batch_size != 0
+                                    ? opts->batch_size : DEFAULT_BATCH_SIZE;
+    const unsigned int high_qd = opts->queue_depth != 0
+                                 ? opts->queue_depth : DEFAULT_QUEUE_DEPTH;
+    const unsigned int depths[2] = { 1, min(high_qd, batch_size) };
+    struct phase_result res[2][2];      /* [depth][sorted] */
+    struct latency_stats read_stats[2][2], batch_stats[2][2];
+    struct blkdev_info info;
+    uint64_t seed;
+    char *duration;
+    int d, sorted;
+    int fd;
+
+    fd = open_blkdev(devname);
+    get_blkdev_info(fd, &info);
+    init_randomness();
+    seed = random64();
+
+    duration = humanize_time(opts->duration_ns, 3);
+
+    for (d=0; d<2; d++)
+    {
+        for (sorted=0; sorted<2; sorted++)
+        {
+            printf("Reading batches of %u offsets in %s order at QD%u for %s, please wait...\n",
+                   batch_size, sorted ? "sorted" : "random", depths[d],
+                   duration);
+
+            run_phase(fd, &info, batch_size, depths[d], sorted, seed,
+                    opts->duration_ns, &res[d][sorted]);
+        }
+    }
+
+    close(fd);
+
+    printf("\n"
+           "%s:\n"
+           " Batches of %u random %u-byte reads, %s per phase\n"
+           "\n",
+           devname, batch_size, info.block_size, duration);
+
+    print_stats_header("order");
+    for (d=0; d<2; d++)
+    {
+        for (sorted=0; sorted<2; sorted++)
+        {
+            struct phase_result *r = &res[d][sorted];
+            char label[32];
+
+            snprintf(label, sizeof(label), "%s QD%u",
+                     sorted ? "sorted" : "random", depths[d]);
+
+            get_latency_stats(&r->reads, &read_stats[d][sorted]);
+            get_latency_stats(&r->batches, &batch_stats[d][sorted]);
+            print_stats_row(label, &read_stats[d][sorted],
+                    (uint64_t)r->reads.count * info.block_size,
+                    r->elapsed_ns);
+        }
+    }
+
+    printf("\n");
+    for (d=0; d<2; d++)
+    {
+        char *const random_time = humanize_time(batch_stats[d][0].mean, 3);
+        char *const sorted_time = humanize_time(batch_stats[d][1].mean, 3);
+
+        printf(" QD%u mean batch time: %s random, %s sorted (speedup from sorting: %.2Lfx)\n",
+               depths[d], random_time, sorted_time,
+               (long double)batch_stats[d][0].mean
+               / max(batch_stats[d][1].mean, (uint64_t)1));
+
+        free(random_time);
+        free(sorted_time);
+
+        sample_buf_free(&res[d][0].reads);
+        sample_buf_free(&res[d][0].batches);
+        sample_buf_free(&res[d][1].reads);
+        sample_buf_free(&res[d][1].batches);
+    }
+
+    free(duration);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
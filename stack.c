@@ -0,0 +1,561 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* stack.c - per-layer overhead of a device stack
+ *
+ * Walks a stacked device (e.g. dm-crypt over LVM over md over disks) down
+ * to its underlying disks, through the slaves directories in sysfs, and
+ * through the parent disk of partitions. Runs the same workloads on every
+ * layer in turn, and reports the latency and throughput each layer adds
+ * over the layers right below it. Where a layer spans several devices
+ * (e.g. md), it is compared with their average.
+ *
+ * All layers read the same blocks: the region read on the top device is
+ * mapped down through the start of partitions and through linear device
+ * mapper targets (e.g. most LVM volumes). Below other layers (e.g. md or
+ * dm-crypt), where the mapping isn't known, the region is read at the
+ * same offset instead, and the results are marked as such.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "dm.h"
+#include "humanize.h"
+#include "latency.h"
+#include "openloop.h"
+#include "stack.h"
+#include "sysfs.h"
+
+
+/* Maximum number of devices in a stack. */
+#define MAX_LAYERS 64
+
+/* Maximum length of a kernel device name, including terminator. */
+#define DEV_NAME_LEN 32
+
+/* Size of a sector, the unit of partition and device mapper offsets. */
+#define SECTOR_BYTES 512
+
+/* Default size of the small random reads. */
+#define DEFAULT_READ_BYTES 4096
+
+/* Default reads in flight, for the small random reads. */
+#define DEFAULT_QUEUE_DEPTH 1
+
+/* Size and reads in flight of the large reads. */
+#define LARGE_READ_BYTES (1024 * 1024)
+#define LARGE_QUEUE_DEPTH 4
+
+#define NUM_WORKLOADS 2
+
+
+struct workload_result {
+    struct latency_stats stats;
+    uint64_t bytes;
+    uint64_t elapsed_ns;
+};
+
+struct layer {
+    char name[DEV_NAME_LEN];
+    char kind[DEV_NAME_LEN];
+    char path[PATH_MAX];        /* device node */
+    int parent;                 /* index of the layer above; -1 for the top */
+    unsigned int depth;
+    uint64_t offset;            /* where the top's region starts, in bytes */
+    int mapped;                 /* whether offset is known */
+    struct blkdev_info info;
+    struct workload_result res[NUM_WORKLOADS];
+};
+
+struct stack {
+    struct layer layers[MAX_LAYERS];
+    unsigned int count;
+};
+
+struct workload {
+    size_t read_size;
+    unsigned int queue_depth;
+};
+
+
+
+/*
+ * Describe the kind of a layer, from its sysfs directory: a partition,
+ * a device mapper target (with the subsystem from its UUID, e.g. CRYPT or
+ * LVM), an md array (with its level), a loop device, or a disk.
+ */
+static void get_layer_kind(const char *dir, char *kind, size_t size)
+{
+    char path[PATH_MAX + sizeof("/partition")];
+    char *value;
+
+    snprintf(path, sizeof(path), "%s/partition", dir);
+    if (access(path, F_OK) == 0)
+    {
+        snprintf(kind, size, "partition");
+        return;
+    }
+
+    if ((value = sysfs_read_attr(dir, "dm/uuid")) != NULL)
+    {
+        char *const dash = strchr(value, '-');
+        char *p;
+
+        if (dash != NULL && dash != value)
+        {
+            *dash = '\0';
+            for (p = value; *p != '\0'; p++)
+                *p = tolower((unsigned char)*p);
+            snprintf(kind, size, "dm (%s)", value);
+        }
+        else
+            snprintf(kind, size, "dm");
+        free(value);
+        return;
+    }
+
+    if ((value = sysfs_read_attr(dir, "md/level")) != NULL)
+    {
+        snprintf(kind, size, "md (%s)", value);
+        free(value);
+        return;
+    }
+
+    snprintf(path, sizeof(path), "%s/loop", dir);
+    snprintf(kind, size, access(path, F_OK) == 0 ? "loop" : "disk");
+}
+
+
+
+/*
+ * Get where a device mapper device made of a single linear target starts
+ * on the device below it, in bytes. Returns 0 on success, or -1 if dir
+ * isn't such a device or its table can't be read.
+ */
+static int get_linear_offset(const char *dir, uint64_t *p_offset)
+{
+    unsigned int major, minor;
+    uint64_t start, length, dev_start;
+    char *name, *table = NULL;
+    int ctl, status = -1;
+
+    if ((name = sysfs_read_attr(dir, "dm/name")) == NULL)
+        return -1;
+
+    if ((ctl = open(DM_CONTROL_PATH, O_RDONLY)) >= 0)
+    {
+        table = get_dm_table(ctl, name, "linear", &start, &length);
+        close(ctl);
+    }
+
+    /* the table is "<major>:<minor> <start sector>" */
+    if (table != NULL && start == 0
+        && sscanf(table, "%u:%u %" SCNu64, &major, &minor, &dev_start) == 3)
+    {
+        *p_offset = dev_start * SECTOR_BYTES;
+        status = 0;
+    }
+
+    free(table);
+    free(name);
+
+    return status;
+}
+
+
+
+/*
+ * Compare two device names, for qsort.
+ */
+static int cmp_names(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+
+
+/*
+ * Add a device to the stack, then the devices below it, depth first.
+ *
+ * dir is the device's sysfs directory, and path its device node (NULL to
+ * derive it from its name). offset is where the top's region starts on
+ * the device, in bytes, if mapped is true. Exits in case of error.
+ */
+static void add_layer(struct stack *st, const char *dir, const char *path,
+        int parent, unsigned int depth, uint64_t offset, int mapped)
+{
+    char below[MAX_LAYERS][DEV_NAME_LEN];
+    char resolved[PATH_MAX], subdir[PATH_MAX + sizeof("/slaves")];
+    unsigned int num_below = 0, i;
+    uint64_t below_offset = 0;
+    int below_mapped = 0;
+    struct layer *layer;
+    struct dirent *entry;
+    char *p;
+    DIR *d;
+    int index;
+
+    if (st->count == MAX_LAYERS)
+    {
+        fprintf(stderr, "error: too many devices in the stack (at most %d)\n",
+                MAX_LAYERS);
+        exit(1);
+    }
+
+    die_if(realpath(dir, resolved) == NULL, dir);
+
+    index = st->count++;
+    layer = &st->layers[index];
+    layer->parent = parent;
+    layer->depth = depth;
+    layer->offset = mapped ? offset : 0;
+    layer->mapped = mapped;
+    snprintf(layer->name, sizeof(layer->name), "%.*s", DEV_NAME_LEN - 1,
+             strrchr(resolved, '/') + 1);
+    get_layer_kind(resolved, layer->kind, sizeof(layer->kind));
+
+    if (path != NULL)
+        snprintf(layer->path, sizeof(layer->path), "%s", path);
+    else
+    {
+        /* sysfs names use '!' where /dev has subdirectories */
+        snprintf(layer->path, sizeof(layer->path), "/dev/%s",
+                 strrchr(resolved, '/') + 1);
+        for (p = layer->path; *p != '\0'; p++)
+            if (*p == '!')
+                *p = '/';
+    }
+
+    if (strcmp(layer->kind, "partition") == 0)
+    {
+        char *const start = sysfs_read_attr(resolved, "start");
+
+        if (start != NULL)
+        {
+            below_offset = offset + strtoull(start, NULL, 10) * SECTOR_BYTES;
+            below_mapped = mapped;
+            free(start);
+        }
+
+        /* partitions are subdirectories of their disk */
+        *strrchr(resolved, '/') = '\0';
+        snprintf(below[num_below++], DEV_NAME_LEN, "%.*s",
+                 DEV_NAME_LEN - 1, strrchr(resolved, '/') + 1);
+    }
+    else
+    {
+        snprintf(subdir, sizeof(subdir), "%s/slaves", resolved);
+        /* disks have no slaves directory, or an empty one */
+        if ((d = opendir(subdir)) != NULL)
+        {
+            while ((entry = readdir(d)) != NULL && num_below < MAX_LAYERS)
+                if (entry->d_name[0] != '.')
+                    snprintf(below[num_below++], DEV_NAME_LEN, "%.*s",
+                             DEV_NAME_LEN - 1, entry->d_name);
+            closedir(d);
+        }
+    }
+
+    /* readdir's order is arbitrary */
+    qsort(below, num_below, DEV_NAME_LEN, cmp_names);
+
+    if (num_below == 1 && strncmp(layer->kind, "dm", 2) == 0
+        && get_linear_offset(resolved, &below_offset) == 0)
+    {
+        below_offset += offset;
+        below_mapped = mapped;
+    }
+
+    for (i=0; i<num_below; i++)
+    {
+        snprintf(subdir, sizeof(subdir), "/sys/class/block/%s", below[i]);
+        add_layer(st, subdir, NULL, index, depth + 1, below_offset,
+                  below_mapped);
+    }
+}
+
+
+
+/*
+ * Run a workload on one layer, reading region_bytes from the layer's
+ * offset, and store the outcome in res.
+ */
+static void run_workload(const struct layer *layer,
+        const struct workload *w, uint64_t region_bytes,
+        uint64_t duration_ns, struct workload_result *res)
+{
+    struct openloop_params p;
+    struct openloop_result ol;
+
+    p.fd = open_blkdev(layer->path);
+    p.info = &layer->info;
+    p.first_block = layer->offset / layer->info.block_size;
+    p.num_blocks = region_bytes / layer->info.block_size;
+    p.read_size = w->read_size;
+    p.size_dist = NULL;
+    p.rate = 0;
+    p.max_inflight = w->queue_depth;
+    p.duration_ns = duration_ns;
+    /* a fresh seed per layer, so lower layers don't hit the blocks the
+     * upper ones just brought into the disk's cache */
+    p.seed = random64();
+
+    run_open_loop(&p, &ol);
+    close(p.fd);
+
+    get_latency_stats(&ol.lat, &res->stats);
+    res->bytes = ol.bytes;
+    res->elapsed_ns = ol.elapsed_ns;
+
+    sample_buf_free(&ol.lat);
+}
+
+
+
+/*
+ * Get the throughput of a workload result, in bytes per second.
+ */
+static double throughput(const struct workload_result *res)
+{
+    return res->bytes / ((double)max(res->elapsed_ns, (uint64_t)1) / NS_PER_SEC);
+}
+
+
+
+/*
+ * Format a signed latency difference, in buf of the specified size.
+ */
+static void format_delta(double ns, char *buf, size_t size)
+{
+    char *const value = humanize_time((uint64_t)(ns < 0 ? -ns : ns), 3);
+
+    snprintf(buf, size, "%c%s", ns < 0 ? '-' : '+', value);
+    free(value);
+}
+
+
+
+/*
+ * Print the overhead of each layer that has others below it, for one
+ * workload, against the average of the layers right below it.
+ */
+static void print_overhead(const struct stack *st, int w)
+{
+    unsigned int i, j;
+
+    printf("\n %-14s %-14s %12s %12s %11s\n",
+           "added by", "over", "mean", "p99", "throughput");
+
+    for (i=0; i<st->count; i++)
+    {
+        const struct layer *const layer = &st->layers[i];
+        double mean = 0, p99 = 0, tput = 0;
+        char mean_str[32], p99_str[32], over[32];
+        unsigned int num_below = 0;
+
+        for (j=i+1; j<st->count; j++)
+        {
+            const struct workload_result *const below = &st->layers[j].res[w];
+
+            if (st->layers[j].parent != (int)i)
+                continue;
+
+            if (num_below++ == 0)
+                snprintf(over, sizeof(over), "%s", st->layers[j].name);
+            mean += below->stats.mean;
+            p99 += below->stats.p99;
+            tput += throughput(below);
+        }
+
+        if (num_below == 0)
+            continue;
+
+        if (num_below > 1)
+            snprintf(over, sizeof(over), "%u devices", num_below);
+
+        mean /= num_below;
+        p99 /= num_below;
+        tput /= num_below;
+
+        format_delta(layer->res[w].stats.mean - mean, mean_str,
+                     sizeof(mean_str));
+        format_delta(layer->res[w].stats.p99 - p99, p99_str, sizeof(p99_str));
+
+        printf(" %-14s %-14s %12s %12s %+10.1f%%\n",
+               layer->name, over, mean_str, p99_str,
+               tput > 0 ? (throughput(&layer->res[w]) / tput - 1) * 100 : 0.0);
+    }
+}
+
+
+
+/*
+ * Measure the overhead of each layer of a device stack, and print the
+ * results.
+ *
+ * Runs small random reads (opts->read_size, or DEFAULT_READ_BYTES, with
+ * opts->queue_depth in flight, or DEFAULT_QUEUE_DEPTH) and large reads on
+ * every layer, for opts->duration_ns each. All layers read the same
+ * region, where it can be mapped to them, or else one of the same size
+ * at the same offset. Exits in case of error.
+ */
+void run_and_print_stack(const char *devname,
+        const struct bench_options *opts)
+{
+    struct workload workloads[NUM_WORKLOADS];
+    struct stack *st;
+    uint32_t block_size = 0;
+    uint64_t region_bytes = UINT64_MAX;
+    char dir[PATH_MAX];
+    char *duration;
+    unsigned int i;
+    int status, w, unmapped = 0;
+
+    status = sysfs_block_dir(devname, dir, sizeof(dir));
+    die_if_with_errno(status != 0, devname, status);
+
+    st = calloc(1, sizeof(*st));
+    die_if(st == NULL, "calloc");
+
+    add_layer(st, dir, devname, -1, 0, 0, 1);
+
+    if (st->count == 1)
+    {
+        fprintf(stderr, "error: %s is not stacked on other devices\n", devname);
+        exit(1);
+    }
+
+    for (i=0; i<st->count; i++)
+    {
+        struct layer *const layer = &st->layers[i];
+        const int fd = open_blkdev(layer->path);
+
+        get_blkdev_info(fd, &layer->info);
+        close(fd);
+
+        /* misaligned partitions can't read the same requests */
+        if (layer->offset % layer->info.block_size != 0
+            || layer->offset >= layer->info.dev_size)
+        {
+            layer->offset = 0;
+            layer->mapped = 0;
+        }
+        unmapped |= !layer->mapped;
+
+        block_size = max(block_size, layer->info.block_size);
+        region_bytes = min(region_bytes,
+                           layer->info.dev_size - layer->offset);
+    }
+
+    workloads[0].read_size = opts->read_size != 0
+                             ? opts->read_size : DEFAULT_READ_BYTES;
+    workloads[0].queue_depth = opts->queue_depth != 0
+                               ? opts->queue_depth : DEFAULT_QUEUE_DEPTH;
+    workloads[1].read_size = LARGE_READ_BYTES;
+    workloads[1].queue_depth = LARGE_QUEUE_DEPTH;
+
+    /* every layer must be able to read the same requests */
+    region_bytes -= region_bytes % block_size;
+    for (w=0; w<NUM_WORKLOADS; w++)
+    {
+        workloads[w].read_size = align_ceil(workloads[w].read_size, block_size);
+        if (workloads[w].read_size > region_bytes)
+        {
+            fprintf(stderr, "error: read size (%zu) is greater than the smallest device (%" PRIu64 ")\n",
+                    workloads[w].read_size, region_bytes);
+            exit(1);
+        }
+    }
+
+    init_randomness();
+
+    duration = humanize_time(opts->duration_ns, 3);
+    printf("Testing %u devices, %d workloads of %s each, please wait...\n",
+           st->count, NUM_WORKLOADS, duration);
+    free(duration);
+
+    for (i=0; i<st->count; i++)
+        for (w=0; w<NUM_WORKLOADS; w++)
+            run_workload(&st->layers[i], &workloads[w], region_bytes,
+                         opts->duration_ns, &st->layers[i].res[w]);
+
+    printf("\nStack of %s:\n", devname);
+    for (i=0; i<st->count; i++)
+    {
+        const struct layer *const layer = &st->layers[i];
+        const struct human_value size = humanize_binary_size(layer->info.dev_size);
+        char label[DEV_NAME_LEN + 2 * MAX_LAYERS];
+
+        snprintf(label, sizeof(label), "%*s%s%s", 2 * layer->depth, "",
+                 layer->name, layer->mapped ? "" : "*");
+        printf(" %-20s %-14s %8.2Lf %s\n", label, layer->kind,
+               size.value, size.unit);
+    }
+    if (unmapped)
+        printf("\n * not mapped to the blocks read on %s: reads the same offsets\n"
+               "   instead, so the overhead above it includes their position.\n",
+               devname);
+
+    for (w=0; w<NUM_WORKLOADS; w++)
+    {
+        const struct human_value size = humanize_binary_size(workloads[w].read_size);
+
+        printf("\n%.2Lf %s random reads, %u in flight:\n\n",
+               size.value, size.unit, workloads[w].queue_depth);
+
+        print_stats_header("device");
+        for (i=0; i<st->count; i++)
+        {
+            const struct layer *const layer = &st->layers[i];
+            char label[DEV_NAME_LEN + 2 * MAX_LAYERS];
+
+            snprintf(label, sizeof(label), "%*s%s", 2 * layer->depth, "",
+                     layer->name);
+            print_stats_row(label, &layer->res[w].stats, layer->res[w].bytes,
+                            layer->res[w].elapsed_ns);
+        }
+
+        print_overhead(st, w);
+    }
+
+    free(st);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
@@ -0,0 +1,851 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* stripe.c - RAID-0/5/6 striping simulator
+ *
+ * Treats several devices as the members of a virtual RAID volume, with a
+ * given chunk size, and runs random reads on the volume: each read is
+ * split at chunk boundaries and mapped onto the members, the way md or
+ * LVM would, and completes when all of its member reads do. Sweeping the
+ * chunk size shows which stripe geometry suits a read size, before
+ * building the array.
+ *
+ * With parity (RAID-5 or 6, left-symmetric layout), some members can be
+ * marked as failed. Reads of their data then fetch the rest of the stripe
+ * from the surviving members, and rebuild the missing data with the
+ * parity kernels, as a degraded array does while rebuilding; the CPU time
+ * this takes is measured. The devices hold no real parity, so the rebuilt
+ * data is garbage; only its cost is of interest.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "asyncio.h"
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "parity.h"
+#include "stripe.h"
+#include "watchdog.h"
+
+
+/* Default size of the reads on the volume. */
+#define DEFAULT_READ_BYTES (64 * 1024)
+
+/* Default reads in flight on the volume. */
+#define DEFAULT_QUEUE_DEPTH 32
+
+/* Chunk sizes of the sweep, when none is given. */
+#define MIN_SWEEP_CHUNK_BYTES (4 * 1024)
+#define MAX_SWEEP_CHUNK_BYTES (1 * MIB)
+
+/* Maximum number of chunk sizes in the sweep. */
+#define MAX_CHUNK_STEPS 16
+
+/* Maximum number of member devices. */
+#define MAX_MEMBERS 64
+
+/* Roles of a rebuild source other than data, whose role is its index. */
+#define ROLE_P (-1)
+#define ROLE_Q (-2)
+
+
+struct stripe_member {
+    const char *devname;
+    int fd;
+    struct blkdev_info info;
+    int failed;
+    uint64_t bytes;             /* read in the current step */
+};
+
+struct stripe_volume {
+    struct stripe_member *members;
+    unsigned int num_members;
+    unsigned int num_parity;    /* 0, 1 or 2: RAID-0, 5 or 6 */
+    unsigned int num_data;      /* data chunks per stripe */
+    size_t chunk_size;
+    size_t alignment;           /* of offsets, sizes and buffers */
+    uint64_t num_stripes;
+    uint64_t size;
+    uint8_t (*q_tables)[256];   /* products by g^i, per data index i */
+    uint8_t (*inv_tables)[256]; /* products by g^-i, per data index i */
+};
+
+enum rebuild_kind {
+    REBUILD_P,                  /* one data chunk, from P */
+    REBUILD_Q,                  /* one data chunk, from Q */
+    REBUILD_PQ,                 /* two data chunks, from P and Q */
+};
+
+/* The rebuild of missing data in one stripe, within a range of offsets
+ * in the chunk. Sources, then outputs, are laid out len bytes apart. */
+struct rebuild {
+    enum rebuild_kind kind;
+    uint64_t stripe;
+    uint64_t lo, hi;            /* range within the chunk */
+    char *base;
+    unsigned int num_src;
+    int role[MAX_MEMBERS];      /* data index, ROLE_P or ROLE_Q */
+    unsigned int missing[2];    /* data indices */
+};
+
+struct stripe_req;
+
+struct stripe_piece {
+    struct iocb cb;
+    struct stripe_req *req;
+    unsigned int member;
+};
+
+/* A read on the volume, and the member reads it maps to. */
+struct stripe_req {
+    char *buffer;
+    char *scratch;              /* rebuild sources and outputs */
+    size_t scratch_size;
+    struct stripe_piece *pieces;
+    struct rebuild *rebuilds;   /* one per stripe, at most */
+    unsigned int num_rebuilds;
+    unsigned int pending;
+    uint64_t start_ns;
+};
+
+struct step_result {
+    struct latency_stats stats;
+    uint64_t bytes;
+    uint64_t elapsed_ns;
+    double pieces_per_read;
+    double imbalance;           /* busiest member's bytes, over the mean */
+    double cpu_util;            /* CPU time over elapsed time */
+    uint64_t rebuild_bytes;
+    uint64_t rebuild_cpu_ns;
+};
+
+
+
+/*
+ * Get the member holding a stripe's P parity. Parity rotates backwards
+ * from the last member, one member per stripe.
+ */
+static inline unsigned int p_member(const struct stripe_volume *vol,
+        uint64_t stripe)
+{
+    return vol->num_members - 1 - stripe % vol->num_members;
+}
+
+
+
+/*
+ * Get the member holding a stripe's Q parity, right after P.
+ */
+static inline unsigned int q_member(const struct stripe_volume *vol,
+        uint64_t stripe)
+{
+    return (p_member(vol, stripe) + 1) % vol->num_members;
+}
+
+
+
+/*
+ * Get the member holding a stripe's data chunk d. Data starts right after
+ * the parity, and wraps around.
+ */
+static inline unsigned int data_member(const struct stripe_volume *vol,
+        uint64_t stripe, unsigned int d)
+{
+    if (vol->num_parity == 0)
+        return d;
+
+    return (p_member(vol, stripe) + vol->num_parity + d) % vol->num_members;
+}
+
+
+
+/*
+ * Add a piece reading len bytes at offset of a member, or extend the
+ * member's last piece if contiguous with it. The buffer is assigned
+ * later, except for rebuild sources (buffer non-NULL).
+ */
+static void add_piece(struct stripe_req *req, unsigned int *p_count,
+        int *last, unsigned int member, uint64_t offset, uint64_t len,
+        char *buffer)
+{
+    struct stripe_piece *piece;
+
+    if (buffer == NULL && last[member] >= 0)
+    {
+        piece = &req->pieces[last[member]];
+        if (piece->cb.aio_offset + piece->cb.aio_nbytes == offset)
+        {
+            piece->cb.aio_nbytes += len;
+            return;
+        }
+    }
+
+    piece = &req->pieces[*p_count];
+    piece->req = req;
+    piece->member = member;
+    piece->cb.aio_offset = offset;
+    piece->cb.aio_nbytes = len;
+    piece->cb.aio_buf = (uintptr_t)buffer;
+
+    if (buffer == NULL)
+        last[member] = *p_count;
+    (*p_count)++;
+}
+
+
+
+/*
+ * Plan the rebuild of the failed data of a stripe, i.e. choose the parity
+ * to use and list the sources. Returns the number of buffers the rebuild
+ * needs (sources and outputs).
+ */
+static unsigned int plan_rebuild(const struct stripe_volume *vol,
+        struct rebuild *rb)
+{
+    const unsigned int p = p_member(vol, rb->stripe);
+    const int p_ok = !vol->members[p].failed;
+    unsigned int d, num_missing = 0;
+
+    rb->num_src = 0;
+    for (d=0; d<vol->num_data; d++)
+    {
+        if (vol->members[data_member(vol, rb->stripe, d)].failed)
+            rb->missing[num_missing++] = d;
+        else
+            rb->role[rb->num_src++] = d;
+    }
+
+    assert(num_missing >= 1 && num_missing <= vol->num_parity);
+
+    if (num_missing == 1 && p_ok)
+    {
+        rb->kind = REBUILD_P;
+        rb->role[rb->num_src++] = ROLE_P;
+    }
+    else if (num_missing == 1)
+    {
+        rb->kind = REBUILD_Q;
+        rb->role[rb->num_src++] = ROLE_Q;
+    }
+    else
+    {
+        rb->kind = REBUILD_PQ;
+        rb->role[rb->num_src++] = ROLE_P;
+        rb->role[rb->num_src++] = ROLE_Q;
+    }
+
+    return rb->num_src + num_missing;
+}
+
+
+
+/*
+ * Map a read of size bytes, at offset of the volume, onto the members.
+ *
+ * Each chunk on a surviving member is read from it directly, in a single
+ * member read where the member's part is contiguous. Chunks on failed
+ * members are rebuilt from the same range of the other members in their
+ * stripe. Prepares the pieces and rebuilds of req, splitting its buffer
+ * and scratch space among them, and queues their iocbs in to_submit.
+ * Returns the number of pieces.
+ */
+static unsigned int map_read(struct stripe_volume *vol, uint64_t offset,
+        size_t size, struct stripe_req *req, struct iocb **to_submit)
+{
+    const uint64_t chunk = vol->chunk_size;
+    const uint64_t end = offset + size;
+    int last[MAX_MEMBERS];
+    uint64_t pos = offset;
+    size_t buf_pos = 0, scratch_size = 0;
+    unsigned int i, j, m, count = 0;
+
+    for (m=0; m<vol->num_members; m++)
+        last[m] = -1;
+    req->num_rebuilds = 0;
+
+    while (pos < end)
+    {
+        const uint64_t chunk_idx = pos / chunk;
+        const uint64_t stripe = chunk_idx / vol->num_data;
+        const uint64_t within = pos % chunk;
+        const uint64_t len = min(chunk - within, end - pos);
+
+        m = data_member(vol, stripe, chunk_idx % vol->num_data);
+        if (!vol->members[m].failed)
+            add_piece(req, &count, last, m, stripe * chunk + within, len, NULL);
+        else
+        {   /* the stripe needs a rebuild; cover this range too */
+            struct rebuild *rb = &req->rebuilds[req->num_rebuilds];
+
+            if (req->num_rebuilds > 0 && rb[-1].stripe == stripe)
+            {
+                rb[-1].lo = min(rb[-1].lo, within);
+                rb[-1].hi = max(rb[-1].hi, within + len);
+            }
+            else
+            {
+                rb->stripe = stripe;
+                rb->lo = within;
+                rb->hi = within + len;
+                req->num_rebuilds++;
+            }
+        }
+        pos += len;
+    }
+
+    for (i=0; i<req->num_rebuilds; i++)
+    {
+        struct rebuild *rb = &req->rebuilds[i];
+
+        scratch_size += plan_rebuild(vol, rb) * (rb->hi - rb->lo);
+    }
+
+    if (scratch_size > req->scratch_size)
+    {   /* rare; only grows up to the largest rebuild */
+        free(req->scratch);
+        req->scratch = allocate_aligned_memory(vol->alignment, scratch_size);
+        req->scratch_size = scratch_size;
+    }
+
+    /* the data pieces read into the buffer, in order */
+    for (i=0; i<count; i++)
+    {
+        req->pieces[i].cb.aio_buf = (uintptr_t)(req->buffer + buf_pos);
+        buf_pos += req->pieces[i].cb.aio_nbytes;
+    }
+
+    scratch_size = 0;
+    for (i=0; i<req->num_rebuilds; i++)
+    {
+        struct rebuild *rb = &req->rebuilds[i];
+        const uint64_t len = rb->hi - rb->lo;
+        const uint64_t member_offset = rb->stripe * chunk + rb->lo;
+
+        rb->base = req->scratch + scratch_size;
+        for (j=0; j<rb->num_src; j++)
+        {
+            m = rb->role[j] == ROLE_P ? p_member(vol, rb->stripe)
+                : rb->role[j] == ROLE_Q ? q_member(vol, rb->stripe)
+                : data_member(vol, rb->stripe, rb->role[j]);
+            add_piece(req, &count, last, m, member_offset, len,
+                    rb->base + j * len);
+        }
+        scratch_size += (rb->num_src + (rb->kind == REBUILD_PQ ? 2 : 1))
+                        * len;
+    }
+
+    for (i=0; i<count; i++)
+    {
+        struct stripe_piece *piece = &req->pieces[i];
+
+        async_prep_read(&piece->cb, vol->members[piece->member].fd,
+                (void *)(uintptr_t)piece->cb.aio_buf, piece->cb.aio_nbytes,
+                piece->cb.aio_offset, piece);
+        to_submit[i] = &piece->cb;
+    }
+
+    return count;
+}
+
+
+
+/*
+ * Rebuild the missing data of a stripe, from its sources. Returns the
+ * number of bytes rebuilt.
+ */
+static uint64_t rebuild(const struct stripe_volume *vol,
+        const struct rebuild *rb)
+{
+    const size_t len = rb->hi - rb->lo;
+    uint8_t *const out0 = (uint8_t *)rb->base + rb->num_src * len;
+    uint8_t *const out1 = out0 + len;
+    unsigned int i;
+
+    switch (rb->kind)
+    {
+        case REBUILD_P:     /* D_x = P + sum of D_i */
+            memset(out0, 0, len);
+            for (i=0; i<rb->num_src; i++)
+                xor_into(out0, rb->base + i * len, len);
+            return len;
+
+        case REBUILD_Q:     /* D_x = (Q + sum of g^i D_i) / g^x */
+            memcpy(out0, rb->base + (rb->num_src - 1) * len, len);
+            for (i=0; i<rb->num_src - 1; i++)
+                gf_mul_xor(out0, (uint8_t *)rb->base + i * len,
+                        vol->q_tables[rb->role[i]], len);
+            gf_mul_into(out0, out0, vol->inv_tables[rb->missing[0]], len);
+            return len;
+
+        case REBUILD_PQ:    /* see raid6_2data_recov */
+            memcpy(out0, rb->base + (rb->num_src - 2) * len, len);
+            memcpy(out1, rb->base + (rb->num_src - 1) * len, len);
+            for (i=0; i<rb->num_src - 2; i++)
+            {
+                xor_into(out0, rb->base + i * len, len);
+                gf_mul_xor(out1, (uint8_t *)rb->base + i * len,
+                        vol->q_tables[rb->role[i]], len);
+            }
+            raid6_2data_recov(out0, out1, rb->missing[0], rb->missing[1],
+                    len);
+            return 2 * len;
+    }
+
+    return 0;
+}
+
+
+
+/*
+ * Get the CPU time spent by the process, user and system, in nanoseconds.
+ */
+static uint64_t get_process_cpu_ns(void)
+{
+    struct rusage ru;
+
+    die_if(getrusage(RUSAGE_SELF, &ru) != 0, "getrusage");
+
+    return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * NS_PER_SEC
+           + (uint64_t)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000;
+}
+
+
+
+/*
+ * Run random reads of read_size bytes on the volume, keeping queue_depth
+ * of them in flight, for duration_ns. Stores the results in res.
+ */
+static void run_step(struct stripe_volume *vol, size_t read_size,
+        unsigned int queue_depth, uint64_t duration_ns,
+        struct step_result *res)
+{
+    const unsigned int n = vol->num_members;
+    const uint64_t choices = (vol->size - read_size) / vol->alignment + 1;
+    /* stripes a read can touch, and member reads per stripe */
+    const unsigned int max_stripes = read_size
+                                     / (vol->num_data * vol->chunk_size) + 2;
+    const unsigned int max_pieces = max_stripes * (vol->num_data + n);
+    struct stripe_req *reqs = malloc(queue_depth * sizeof(*reqs));
+    struct iocb **to_submit = malloc(queue_depth * max_pieces
+                                     * sizeof(*to_submit));
+    struct io_event *events = malloc(queue_depth * max_pieces
+                                     * sizeof(*events));
+    struct sample_buf lat;
+    struct async_ctx actx;
+    uint64_t seed = random64();
+    uint64_t start_ns, now_ns, start_cpu_ns, pieces = 0, max_bytes = 0;
+    unsigned int inflight = 0, alive = 0;
+    unsigned int i;
+
+    die_if(reqs == NULL || to_submit == NULL || events == NULL, "malloc");
+    assert(read_size <= vol->size);
+
+    for (i=0; i<queue_depth; i++)
+    {
+        reqs[i].buffer = allocate_aligned_memory(vol->alignment, read_size);
+        reqs[i].scratch = NULL;
+        reqs[i].scratch_size = 0;
+        reqs[i].pieces = malloc(max_pieces * sizeof(*reqs[i].pieces));
+        reqs[i].rebuilds = malloc(max_stripes * sizeof(*reqs[i].rebuilds));
+        die_if(reqs[i].pieces == NULL || reqs[i].rebuilds == NULL, "malloc");
+    }
+    for (i=0; i<n; i++)
+        vol->members[i].bytes = 0;
+
+    async_init(&actx, queue_depth * max_pieces);
+    sample_buf_init(&lat);
+    res->bytes = 0;
+    res->rebuild_bytes = 0;
+    res->rebuild_cpu_ns = 0;
+
+    start_cpu_ns = get_process_cpu_ns();
+    start_ns = now_ns = get_cur_ns();
+
+    /* start every read; each one is restarted as soon as it completes */
+    for (i=0; i<queue_depth; i++)
+    {
+        const uint64_t offset = random64_r(&seed) % choices * vol->alignment;
+        const unsigned int count = map_read(vol, offset, read_size, &reqs[i],
+                                            to_submit);
+
+        reqs[i].pending = count;
+        reqs[i].start_ns = now_ns;
+        async_submit(&actx, to_submit, count);
+        pieces += count;
+        inflight++;
+    }
+
+    while (inflight > 0)
+    {
+        const int got = async_reap(&actx, events, 1, queue_depth * max_pieces,
+                                   NULL);
+        int submit = 0;
+
+        now_ns = get_cur_ns();
+
+        for (i=0; i<(unsigned int)got; i++)
+        {
+            struct stripe_piece *piece =
+                (struct stripe_piece *)(uintptr_t)events[i].data;
+            struct stripe_req *req = piece->req;
+            uint64_t done_ns = now_ns;
+            unsigned int j;
+
+            die_if_with_errno(events[i].res < 0, "read", (int)-events[i].res);
+            vol->members[piece->member].bytes += piece->cb.aio_nbytes;
+
+            if (--req->pending > 0)
+                continue;
+
+            if (req->num_rebuilds > 0)
+            {   /* the read is only done once its data is rebuilt */
+                const uint64_t cpu0 = get_thread_cpu_ns();
+
+                for (j=0; j<req->num_rebuilds; j++)
+                    res->rebuild_bytes += rebuild(vol, &req->rebuilds[j]);
+                res->rebuild_cpu_ns += get_thread_cpu_ns() - cpu0;
+                done_ns = get_cur_ns();
+            }
+
+            sample_buf_add(&lat, done_ns - req->start_ns);
+            res->bytes += read_size;
+
+            if (done_ns - start_ns < duration_ns && !watchdog_aborting())
+            {
+                const uint64_t offset = random64_r(&seed) % choices
+                                        * vol->alignment;
+                const unsigned int count = map_read(vol, offset, read_size,
+                                                    req, to_submit + submit);
+
+                req->pending = count;
+                req->start_ns = done_ns;
+                submit += count;
+                pieces += count;
+            }
+            else
+                inflight--;
+        }
+
+        if (submit > 0)
+            async_submit(&actx, to_submit, submit);
+    }
+
+    now_ns = get_cur_ns();
+    res->elapsed_ns = now_ns - start_ns;
+    res->cpu_util = (double)(get_process_cpu_ns() - start_cpu_ns)
+                    / max(res->elapsed_ns, (uint64_t)1);
+    get_latency_stats(&lat, &res->stats);
+    /* every read started has completed */
+    res->pieces_per_read = lat.count > 0 ? (double)pieces / lat.count : 0;
+
+    for (i=0; i<n; i++)
+    {
+        if (!vol->members[i].failed)
+        {
+            max_bytes = max(max_bytes, vol->members[i].bytes);
+            alive++;
+        }
+    }
+    res->imbalance = res->bytes > 0
+                     ? (double)max_bytes * alive / res->bytes : 0;
+
+    sample_buf_free(&lat);
+    async_destroy(&actx);
+
+    for (i=0; i<queue_depth; i++)
+    {
+        free(reqs[i].rebuilds);
+        free(reqs[i].pieces);
+        free(reqs[i].scratch);
+        free(reqs[i].buffer);
+    }
+
+    free(events);
+    free(to_submit);
+    free(reqs);
+}
+
+
+
+/*
+ * Set the volume's chunk size, and work out its size: as many whole
+ * stripes as fit in the smallest member.
+ */
+static void set_chunk_size(struct stripe_volume *vol, size_t chunk_size)
+{
+    uint64_t min_size = UINT64_MAX;
+    unsigned int i;
+
+    for (i=0; i<vol->num_members; i++)
+        min_size = min(min_size, vol->members[i].info.dev_size);
+
+    vol->chunk_size = chunk_size;
+    vol->num_stripes = min_size / chunk_size;
+    vol->size = vol->num_stripes * chunk_size * vol->num_data;
+}
+
+
+
+/*
+ * Make a label for a results row, with the chunk size, and whether the
+ * volume was degraded.
+ */
+static void make_label(char *label, size_t size, size_t chunk_size,
+        int degraded)
+{
+    const struct human_value chunk_h = humanize_binary_size(chunk_size);
+
+    snprintf(label, size, "%.0Lf %s%s", chunk_h.value, chunk_h.unit,
+             degraded ? " degr" : "");
+}
+
+
+
+/*
+ * Run the striping simulation on the devices in opts->devnames, and print
+ * the results.
+ *
+ * The volume has opts->parity parity chunks per stripe (RAID-0, 5 or 6).
+ * Reads of opts->read_size bytes (DEFAULT_READ_BYTES if zero) go to random
+ * offsets of the volume, with opts->queue_depth of them in flight
+ * (DEFAULT_QUEUE_DEPTH if zero), for opts->duration_ns per chunk size. The
+ * chunk size is opts->chunk_size; if zero, powers of 2 from
+ * MIN_SWEEP_CHUNK_BYTES to MAX_SWEEP_CHUNK_BYTES are swept. If
+ * opts->failed is nonzero, each chunk size is run again with that many
+ * members (the first ones given) failed. Exits in case of error.
+ */
+void run_and_print_stripe(const char *devname,
+        const struct bench_options *opts)
+{
+    const unsigned int queue_depth = opts->queue_depth != 0
+                                     ? opts->queue_depth : DEFAULT_QUEUE_DEPTH;
+    const unsigned int num_states = opts->failed > 0 ? 2 : 1;
+    struct step_result results[MAX_CHUNK_STEPS][2];
+    size_t chunks[MAX_CHUNK_STEPS];
+    unsigned int num_chunks = 0, best = 0;
+    struct stripe_volume vol;
+    struct human_value chunk_h;
+    size_t read_size, chunk;
+    char *duration;
+    char label[32];
+    unsigned int i, j, state;
+
+    (void)devname;
+
+    if (opts->num_devnames > MAX_MEMBERS)
+    {
+        fprintf(stderr, "error: stripe mode takes at most %u devices\n",
+                MAX_MEMBERS);
+        exit(1);
+    }
+    if (opts->num_devnames <= opts->parity)
+    {
+        fprintf(stderr, "error: RAID with %u parity chunks needs more than %u devices\n",
+                opts->parity, opts->parity);
+        exit(1);
+    }
+    if (opts->failed > opts->parity)
+    {
+        fprintf(stderr, "error: RAID with %u parity chunks can't have %u failed devices\n",
+                opts->parity, opts->failed);
+        exit(1);
+    }
+
+    vol.num_members = opts->num_devnames;
+    vol.num_parity = opts->parity;
+    vol.num_data = vol.num_members - vol.num_parity;
+    vol.members = malloc(vol.num_members * sizeof(*vol.members));
+    vol.q_tables = malloc(vol.num_data * sizeof(*vol.q_tables));
+    vol.inv_tables = malloc(vol.num_data * sizeof(*vol.inv_tables));
+    die_if(vol.members == NULL || vol.q_tables == NULL
+           || vol.inv_tables == NULL, "malloc");
+
+    vol.alignment = 1;
+    for (i=0; i<vol.num_members; i++)
+    {
+        struct stripe_member *member = &vol.members[i];
+
+        member->devname = opts->devnames[i];
+        member->fd = open_blkdev(member->devname);
+        member->failed = 0;
+        get_blkdev_info(member->fd, &member->info);
+        vol.alignment = max(vol.alignment, member->info.alignment);
+        vol.alignment = max(vol.alignment, (size_t)member->info.block_size);
+    }
+
+    gf_init();
+    for (i=0; i<vol.num_data; i++)
+    {
+        gf_mul_table(gf_pow2(i), vol.q_tables[i]);
+        gf_mul_table(gf_pow2(-(int)i), vol.inv_tables[i]);
+    }
+
+    init_randomness();
+
+    read_size = align_ceil(opts->read_size != 0 ? opts->read_size
+                                                : DEFAULT_READ_BYTES,
+                           vol.alignment);
+
+    if (opts->chunk_size != 0)
+        chunks[num_chunks++] = align_ceil(opts->chunk_size, vol.alignment);
+    else
+    {
+        for (chunk = align_ceil(MIN_SWEEP_CHUNK_BYTES, vol.alignment);
+             chunk <= MAX_SWEEP_CHUNK_BYTES && num_chunks < MAX_CHUNK_STEPS;
+             chunk *= 2)
+            chunks[num_chunks++] = chunk;
+    }
+
+    duration = humanize_time(opts->duration_ns, 3);
+
+    for (i=0; i<num_chunks; i++)
+    {
+        set_chunk_size(&vol, chunks[i]);
+        if (vol.size < read_size)
+        {
+            fprintf(stderr, "error: devices too small for %zu-byte chunks\n",
+                    chunks[i]);
+            exit(1);
+        }
+
+        chunk_h = humanize_binary_size(chunks[i]);
+        for (state=0; state<num_states; state++)
+        {
+            for (j=0; j<opts->failed; j++)
+                vol.members[j].failed = state;
+
+            printf("Reading %zu-byte blocks with %.0Lf %s chunks at QD%u%s for %s, please wait...\n",
+                   read_size, chunk_h.value, chunk_h.unit, queue_depth,
+                   state ? ", degraded," : "", duration);
+            run_step(&vol, read_size, queue_depth, opts->duration_ns,
+                     &results[i][state]);
+        }
+
+        if (results[i][0].bytes * results[best][0].elapsed_ns
+            > results[best][0].bytes * results[i][0].elapsed_ns)
+            best = i;
+    }
+
+    if (vol.num_parity == 0)
+        printf("\n"
+               "RAID-0 volume over");
+    else
+        printf("\n"
+               "RAID-%u volume over", vol.num_parity == 1 ? 5 : 6);
+    for (i=0; i<vol.num_members; i++)
+        printf(" %s", vol.members[i].devname);
+    printf("\n"
+           " %zu-byte random reads at QD%u\n",
+           read_size, queue_depth);
+    if (opts->failed > 0)
+    {
+        printf(" Degraded (\"degr\") runs with failed:");
+        for (i=0; i<opts->failed; i++)
+            printf(" %s", vol.members[i].devname);
+        printf("\n");
+    }
+    printf("\n");
+
+    print_stats_header("chunk size");
+    for (i=0; i<num_chunks; i++)
+    {
+        for (state=0; state<num_states; state++)
+        {
+            make_label(label, sizeof(label), chunks[i], state);
+            print_stats_row(label, &results[i][state].stats,
+                    results[i][state].bytes, results[i][state].elapsed_ns);
+        }
+    }
+
+    printf("\n"
+           " %-14s %13s %10s %8s %14s %14s\n",
+           "chunk size", "member I/Os", "imbalance", "CPU", "rebuild/read",
+           "rebuild speed");
+    for (i=0; i<num_chunks; i++)
+    {
+        for (state=0; state<num_states; state++)
+        {
+            const struct step_result *res = &results[i][state];
+            const struct human_value speed = humanize_binary_speed(
+                    res->rebuild_cpu_ns > 0
+                    ? res->rebuild_bytes * (long double)NS_PER_SEC
+                      / res->rebuild_cpu_ns
+                    : 0);
+            char *per_read = humanize_time(res->stats.count > 0
+                                           ? res->rebuild_cpu_ns
+                                             / res->stats.count
+                                           : 0, 3);
+            char speed_str[32];
+
+            if (res->rebuild_cpu_ns > 0)
+                snprintf(speed_str, sizeof(speed_str), "%.2Lf %s",
+                         speed.value, speed.unit);
+            else
+                snprintf(speed_str, sizeof(speed_str), "-");
+
+            make_label(label, sizeof(label), chunks[i], state);
+            printf(" %-14s %13.2f %10.2f %7.1f%% %14s %14s\n", label,
+                   res->pieces_per_read, res->imbalance,
+                   res->cpu_util * 100, state ? per_read : "-", speed_str);
+            free(per_read);
+        }
+    }
+
+    printf("\n"
+           " Member I/Os are per read on the volume. Imbalance is the busiest\n"
+           " member's bytes over the mean; 1.00 is an even spread. CPU is the\n"
+           " process's CPU time over the elapsed time. Rebuild figures count\n"
+           " only the CPU time spent rebuilding.\n");
+
+    if (num_chunks > 1)
+    {
+        chunk_h = humanize_binary_size(chunks[best]);
+        printf(" Highest throughput with %.0Lf %s chunks\n",
+               chunk_h.value, chunk_h.unit);
+    }
+
+    for (i=0; i<vol.num_members; i++)
+        close(vol.members[i].fd);
+
+    free(duration);
+    free(vol.inv_tables);
+    free(vol.q_tables);
+    free(vol.members);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
@@ -0,0 +1,298 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* sysfs.c - block device sysfs queries */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "sysfs.h"
+
+
+/* Maximum size of a sysfs attribute we're willing to read. */
+#define MAX_ATTR_SIZE 4096
+
+
+
+/*
+ * Get the sysfs directory of the whole disk that fd refers to.
+ *
+ * Receives an open file descriptor of a block device, and stores the path
+ * of its /sys/block/<disk> directory in buf, which is of the specified
+ * size. If fd refers to a partition, the directory of the parent disk is
+ * returned, as that is where the request queue lives.
+ *
+ * Returns zero on success, or an error number in case of error.
+ */
+int sysfs_disk_dir(int fd, char *buf, size_t size)
+{
+    char link[64];
+    char resolved[PATH_MAX];
+    char partition[PATH_MAX + sizeof("/partition")];
+    struct stat st;
+
+    if (fstat(fd, &st) != 0)
+        return errno;
+
+    if (!S_ISBLK(st.st_mode))
+        return ENOTBLK;
+
+    snprintf(link, sizeof(link), "/sys/dev/block/%u:%u",
+             major(st.st_rdev), minor(st.st_rdev));
+
+    if (realpath(link, resolved) == NULL)
+        return errno;
+
+    /* partitions are subdirectories of their disk */
+    snprintf(partition, sizeof(partition), "%s/partition", resolved);
+    if (access(partition, F_OK) == 0)
+        dirname(resolved);
+
+    if (strlen(resolved) >= size)
+        return ENAMETOOLONG;
+
+    strcpy(buf, resolved);
+
+    return 0;
+}
+
+
+
+/*
+ * Read a sysfs attribute.
+ *
+ * Reads the file attr, relative to directory dir. Returns a newly
+ * allocated string with the attribute's contents, minus any trailing
+ * newline. The string should be freed when no longer necessary. Returns
+ * NULL in case of error, with errno set.
+ */
+char *sysfs_read_attr(const char *dir, const char *attr)
+{
+    char path[PATH_MAX];
+    char *value;
+    size_t len;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, attr);
+
+    f = fopen(path, "r");
+    if (f == NULL)
+        return NULL;
+
+    value = malloc(MAX_ATTR_SIZE);
+    if (value == NULL)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    len = fread(value, 1, MAX_ATTR_SIZE - 1, f);
+    if (ferror(f))
+    {
+        const int saved_errno = errno;
+
+        fclose(f);
+        free(value);
+        errno = saved_errno;
+        return NULL;
+    }
+    fclose(f);
+
+    value[len] = '\0';
+    while (len > 0 && value[len-1] == '\n')
+        value[--len] = '\0';
+
+    return value;
+}
+
+
+
+/*
+ * Write a sysfs attribute.
+ *
+ * Writes value to the file attr, relative to directory dir. Returns zero
+ * on success, or an error number in case of error.
+ */
+int sysfs_write_attr(const char *dir, const char *attr, const char *value)
+{
+    char path[PATH_MAX];
+    FILE *f;
+    int error = 0;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, attr);
+
+    f = fopen(path, "w");
+    if (f == NULL)
+        return errno;
+
+    if (fputs(value, f) == EOF)
+        error = errno;
+
+    /* sysfs reports most errors on flush */
+    if (fclose(f) != 0 && error == 0)
+        error = errno;
+
+    return error;
+}
+
+
+
+/*
+ * Get the I/O schedulers available for a disk.
+ *
+ * Parses queue/scheduler in the disk's sysfs directory, e.g.
+ * "[none] mq-deadline kyber bfq", into scheds. The currently active
+ * scheduler is the one in brackets.
+ *
+ * Returns zero on success, or an error number in case of error.
+ */
+int get_io_schedulers(const char *disk_dir, struct io_schedulers *scheds)
+{
+    char *value = sysfs_read_attr(disk_dir, "queue/scheduler");
+    char *saveptr = NULL;
+    char *token;
+
+    if (value == NULL)
+        return errno;
+
+    scheds->count = 0;
+    scheds->current = -1;
+
+    for (token = strtok_r(value, " ", &saveptr);
+         token != NULL && scheds->count < MAX_IO_SCHEDULERS;
+         token = strtok_r(NULL, " ", &saveptr))
+    {
+        const size_t len = strlen(token);
+
+        if (token[0] == '[' && len >= 2 && token[len-1] == ']')
+        {
+            token[len-1] = '\0';
+            token++;
+            scheds->current = scheds->count;
+        }
+
+        snprintf(scheds->names[scheds->count], IO_SCHEDULER_NAME_LEN,
+                 "%s", token);
+        scheds->count++;
+    }
+
+    free(value);
+
+    return 0;
+}
+
+
+
+/*
+ * Select a disk's I/O scheduler. Returns zero on success, or an error
+ * number in case of error.
+ */
+int set_io_scheduler(const char *disk_dir, const char *name)
+{
+    return sysfs_write_attr(disk_dir, "queue/scheduler", name);
+}
+
+
+
+
+/*
+ * Get the sysfs directory of a block device (disk or partition), given
+ * its kernel name (e.g. "sda1") or the path of its device node. Unlike
+ * sysfs_disk_dir, the device isn't opened, so it may be in use.
+ *
+ * Stores the path in buf, which is of the specified size. Returns zero on
+ * success, or an error number in case of error.
+ */
+int sysfs_block_dir(const char *name, char *buf, size_t size)
+{
+    struct stat st;
+    int len;
+
+    if (strchr(name, '/') != NULL)
+    {
+        if (stat(name, &st) != 0)
+            return errno;
+
+        if (!S_ISBLK(st.st_mode))
+            return ENOTBLK;
+
+        len = snprintf(buf, size, "/sys/dev/block/%u:%u",
+                       major(st.st_rdev), minor(st.st_rdev));
+    }
+    else
+        len = snprintf(buf, size, "/sys/class/block/%s", name);
+
+    if (len < 0 || (size_t)len >= size)
+        return ENAMETOOLONG;
+
+    if (access(buf, F_OK) != 0)
+        return errno;
+
+    return 0;
+}
+
+
+
+/*
+ * Read a block device's I/O statistics, from the stat file in its sysfs
+ * directory. Returns zero on success, or an error number in case of
+ * error.
+ */
+int read_diskstat(const char *dir, struct diskstat *st)
+{
+    char *value = sysfs_read_attr(dir, "stat");
+    int count;
+
+    if (value == NULL)
+        return errno;
+
+    count = sscanf(value, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+                   " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+                   " %" SCNu64 " %" SCNu64 " %" SCNu64,
+                   &st->reads, &st->read_merges, &st->read_sectors,
+                   &st->read_ticks, &st->writes, &st->write_merges,
+                   &st->write_sectors, &st->write_ticks, &st->in_flight,
+                   &st->io_ticks, &st->time_in_queue);
+    free(value);
+
+    return count == 11 ? 0 : EINVAL;
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
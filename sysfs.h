@@ -0,0 +1,85 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* sysfs.h - block device sysfs queries */
+
+
+#ifndef _SYSFS_H
+#define _SYSFS_H
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+
+/* get size_t */
+#include <stddef.h>
+
+/* get uint64_t */
+#include <stdint.h>
+
+
+/* Maximum number of I/O schedulers listed for a device. */
+#define MAX_IO_SCHEDULERS 16
+
+/* Maximum length of an I/O scheduler name, including terminator. */
+#define IO_SCHEDULER_NAME_LEN 32
+
+
+/* I/O statistics of a block device, from its stat file. Times are in
+ * milliseconds; sectors are of 512 bytes. */
+struct diskstat {
+    uint64_t reads;
+    uint64_t read_merges;
+    uint64_t read_sectors;
+    uint64_t read_ticks;
+    uint64_t writes;
+    uint64_t write_merges;
+    uint64_t write_sectors;
+    uint64_t write_ticks;
+    uint64_t in_flight;         /* at the time of reading */
+    uint64_t io_ticks;          /* time with requests in flight */
+    uint64_t time_in_queue;     /* weighted by requests in flight */
+};
+
+struct io_schedulers {
+    char names[MAX_IO_SCHEDULERS][IO_SCHEDULER_NAME_LEN];
+    int count;
+    int current;        /* index into names, or -1 if unknown */
+};
+
+
+int sysfs_disk_dir(int fd, char *buf, size_t size);
+
+char *sysfs_read_attr(const char *dir, const char *attr);
+
+int sysfs_write_attr(const char *dir, const char *attr, const char *value);
+
+int get_io_schedulers(const char *disk_dir, struct io_schedulers *scheds);
+
+int set_io_scheduler(const char *disk_dir, const char *name);
+
+int sysfs_block_dir(const char *name, char *buf, size_t size);
+
+int read_diskstat(const char *dir, struct diskstat *st);
+
+
+#endif  /* _SYSFS_H */
@@ -0,0 +1,305 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* vecread.c - scatter-gather vectored read benchmark
+ *
+ * Compares a single contiguous read with a vectored read of the same size,
+ * scattered into many non-contiguous buffers, as a storage engine does
+ * when reading pages straight into a buffer pool.
+ */
+
+
+#define _LARGEFILE64_SOURCE
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "asyncio.h"
+#include "vecread.h"
+#include "watchdog.h"
+
+
+/* Default number of segments per vectored read. */
+#define DEFAULT_SEGMENTS 64
+
+/* Default size of each segment. */
+#define DEFAULT_SEGMENT_SIZE 4096
+
+
+enum read_method {
+    READ_CONTIGUOUS,
+    READ_PREADV,
+    READ_AIO_READV,
+    NUM_READ_METHODS
+};
+
+static const char *const READ_METHOD_NAMES[NUM_READ_METHODS] = {
+    "contiguous", "preadv", "AIO readv"
+};
+
+
+struct vecread_setup {
+    int fd;
+    const struct blkdev_info *info;
+    char *contiguous;           /* buffer for the contiguous read */
+    struct iovec *iov;          /* non-contiguous segments */
+    unsigned int segments;
+    size_t total_size;
+    uint64_t duration_ns;
+};
+
+
+
+/*
+ * Allocate the segments of a vectored read.
+ *
+ * Carves twice as many segments as needed from a single pool, and uses
+ * every other one, in shuffled order, so that no two consecutive iovecs
+ * are adjacent in memory. Returns the pool, to be freed when no longer
+ * necessary.
+ */
+static char *allocate_segments(struct iovec *iov, unsigned int segments,
+        size_t segment_size, size_t alignment, uint64_t *seed)
+{
+    char *pool = allocate_aligned_memory(alignment, 2 * segments * segment_size);
+    unsigned int i;
+
+    for (i=0; i<segments; i++)
+    {
+        iov[i].iov_base = pool + 2*i*segment_size;
+        iov[i].iov_len = segment_size;
+    }
+
+    /* Fisher-Yates shuffle */
+    for (i=segments-1; i>0; i--)
+    {
+        const unsigned int j = random64_r(seed) % (i + 1);
+        const struct iovec tmp = iov[i];
+
+        iov[i] = iov[j];
+        iov[j] = tmp;
+    }
+
+    return pool;
+}
+
+
+
+/*
+ * Do random reads with the specified method, for the setup's duration.
+ * Stores each read's latency in lat, and the time elapsed in
+ * *p_elapsed_ns. Exits in case of error.
+ */
+static void run_method(const struct vecread_setup *s, enum read_method method,
+        uint64_t *seed, struct sample_buf *lat, uint64_t *p_elapsed_ns)
+{
+    const unsigned int block_size = s->info->block_size;
+    const uint64_t choices = (s->info->dev_size - s->total_size) / block_size + 1;
+    struct async_ctx actx;
+    uint64_t start_ns, now_ns;
+
+    if (method == READ_AIO_READV)
+        async_init(&actx, 1);
+
+    start_ns = now_ns = get_cur_ns();
+
+    while (now_ns - start_ns < s->duration_ns && !watchdog_aborting())
+    {
+        const uint64_t offset = (random64_r(seed) % choices) * block_size;
+        const uint64_t t0 = get_cur_ns();
+        ssize_t retval;
+
+        switch (method)
+        {
+            case READ_CONTIGUOUS:
+                read_at(s->fd, s->contiguous, s->total_size, offset);
+                break;
+            case READ_PREADV:
+            {
+                const int slot = watchdog_begin(s->fd, offset, s->total_size);
+
+                retval = preadv64(s->fd, s->iov, s->segments, (off64_t)offset);
+                watchdog_end(slot);
+                die_if(retval < 0, "preadv");
+                break;
+            }
+            case READ_AIO_READV:
+            {
+                struct iocb cb;
+                struct iocb *cbs[1] = { &cb };
+                struct io_event event;
+
+                async_prep_readv(&cb, s->fd, s->iov, s->segments, offset,
+                        NULL);
+                async_submit(&actx, cbs, 1);
+                (void)async_reap(&actx, &event, 1, 1, NULL);
+                die_if_with_errno(event.res < 0, "readv", (int)-event.res);
+                break;
+            }
+            default:
+                assert(0);
+        }
+
+        now_ns = get_cur_ns();
+        sample_buf_add(lat, now_ns - t0);
+    }
+
+    if (method == READ_AIO_READV)
+        async_destroy(&actx);
+
+    *p_elapsed_ns = now_ns - start_ns;
+}
+
+
+
+/*
+ * Print the extra cost per segment of a vectored read method, compared to
+ * the contiguous read. The difference may be negative.
+ */
+static void print_segment_cost(const char *method, uint64_t mean_ns,
+        uint64_t contiguous_mean_ns, unsigned int segments)
+{
+    const int faster = mean_ns < contiguous_mean_ns;
+    const uint64_t diff_ns = faster ? contiguous_mean_ns - mean_ns
+                                    : mean_ns - contiguous_mean_ns;
+    char *const cost = humanize_time(diff_ns / segments, 3);
+
+    printf(" Extra cost per segment (%s): %s%s\n",
+           method, faster && diff_ns / segments != 0 ? "-" : "", cost);
+
+    free(cost);
+}
+
+
+
+/*
+ * Run the vectored read benchmark on a block device, and print the
+ * results.
+ *
+ * Reads opts->segments segments of opts->segment_size bytes at random
+ * offsets, first with a single contiguous read, then with preadv and
+ * with an AIO vectored read, each for opts->duration_ns. Exits in case of
+ * error.
+ */
+void run_and_print_vecread(const char *devname,
+        const struct bench_options *opts)
+{
+    const unsigned int segments = opts->segments != 0
+                                  ? opts->segments : DEFAULT_SEGMENTS;
+    struct latency_stats stats[NUM_READ_METHODS];
+    struct vecread_setup s;
+    struct blkdev_info info;
+    struct human_value seg_size, total_size;
+    uint64_t elapsed_ns[NUM_READ_METHODS];
+    uint64_t seed;
+    size_t segment_size;
+    char *pool;
+    char *duration;
+    int i;
+
+    s.fd = open_blkdev(devname);
+    get_blkdev_info(s.fd, &info);
+    init_randomness();
+    seed = random64();
+
+    /* direct I/O needs every segment aligned, in memory and on disk */
+    segment_size = opts->segment_size != 0
+                   ? opts->segment_size : DEFAULT_SEGMENT_SIZE;
+    segment_size = align_ceil(segment_size, max(info.alignment,
+                                                 (size_t)info.block_size));
+
+    s.info = &info;
+    s.segments = segments;
+    s.total_size = (size_t)segments * segment_size;
+    s.duration_ns = opts->duration_ns;
+
+    if (s.total_size > info.dev_size)
+    {
+        fprintf(stderr, "error: read size (%zu) is greater than device itself (%" PRIu64 ")\n",
+                s.total_size, info.dev_size);
+        exit(1);
+    }
+
+    s.iov = malloc(segments * sizeof(*s.iov));
+    die_if(s.iov == NULL, "malloc");
+    pool = allocate_segments(s.iov, segments, segment_size, info.alignment,
+            &seed);
+    s.contiguous = allocate_aligned_memory(info.alignment, s.total_size);
+
+    seg_size = humanize_binary_size(segment_size);
+    total_size = humanize_binary_size(s.total_size);
+    duration = humanize_time(opts->duration_ns, 3);
+
+    for (i=0; i<NUM_READ_METHODS; i++)
+    {
+        struct sample_buf lat;
+
+        printf("Doing %s random reads for %s, please wait...\n",
+               READ_METHOD_NAMES[i], duration);
+
+        sample_buf_init(&lat);
+        run_method(&s, i, &seed, &lat, &elapsed_ns[i]);
+        get_latency_stats(&lat, &stats[i]);
+        sample_buf_free(&lat);
+    }
+
+    close(s.fd);
+
+    printf("\n"
+           "%s:\n"
+           " %u x %.2Lf %s segments (%.2Lf %s per read), %s per method\n"
+           "\n",
+           devname, segments, seg_size.value, seg_size.unit,
+           total_size.value, total_size.unit, duration);
+
+    print_stats_header("method");
+    for (i=0; i<NUM_READ_METHODS; i++)
+        print_stats_row(READ_METHOD_NAMES[i], &stats[i],
+                (uint64_t)stats[i].count * s.total_size, elapsed_ns[i]);
+
+    printf("\n");
+    print_segment_cost(READ_METHOD_NAMES[READ_PREADV],
+            stats[READ_PREADV].mean, stats[READ_CONTIGUOUS].mean, segments);
+    print_segment_cost(READ_METHOD_NAMES[READ_AIO_READV],
+            stats[READ_AIO_READV].mean, stats[READ_CONTIGUOUS].mean, segments);
+
+    free(duration);
+    free(s.contiguous);
+    free(pool);
+    free(s.iov);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
@@ -0,0 +1,405 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* verify.c - slow sector verification
+ *
+ * Runs random reads, then re-reads every block that was slower than a
+ * threshold several times, to tell persistently slow blocks from
+ * transient outliers. A weak sector that needs ECC retries is slow every
+ * time it's read; a read that was merely queued behind something else,
+ * or caught the drive doing garbage collection, isn't. Re-reads go
+ * through all suspects in a new random order each round, with random
+ * reads elsewhere in between, so that the drive's cache doesn't serve
+ * them.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "humanize.h"
+#include "latency.h"
+#include "verify.h"
+#include "workload.h"
+
+
+/* Default number of concurrent readers, in the first pass. */
+#define DEFAULT_READERS 1
+
+/* Default threshold, as a multiple of the first pass's p99. */
+#define DEFAULT_SLOW_P99_FACTOR 4
+
+/* Most slow blocks to verify; the slowest are kept. */
+#define MAX_SUSPECTS 1000
+
+/* Times each slow block is re-read. */
+#define NUM_REREADS 5
+
+/* Random reads elsewhere before each round of re-reads, to evict the
+ * suspects from the drive's cache. */
+#define EVICT_READS 128
+
+/* Most persistently slow blocks to list. */
+#define MAX_LISTED 20
+
+
+/* A block that was slow in the first pass. */
+struct suspect {
+    uint64_t offset;
+    uint64_t first_ns;                  /* latency in the first pass */
+    uint64_t reread_ns[NUM_REREADS];    /* sorted, once all are done */
+    unsigned int slow_rereads;
+};
+
+
+
+/*
+ * Compare two suspects by offset, for qsort.
+ */
+static int cmp_offset(const void *a, const void *b)
+{
+    const struct suspect *x = a, *y = b;
+
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+
+
+/*
+ * Compare two suspects by first pass latency, slowest first, for qsort.
+ */
+static int cmp_first_desc(const void *a, const void *b)
+{
+    const struct suspect *x = a, *y = b;
+
+    return (x->first_ns < y->first_ns) - (x->first_ns > y->first_ns);
+}
+
+
+
+/*
+ * Compare two suspects by median re-read latency, slowest first, for
+ * qsort.
+ */
+static int cmp_median_desc(const void *a, const void *b)
+{
+    const uint64_t x = ((const struct suspect *)a)->reread_ns[NUM_REREADS / 2];
+    const uint64_t y = ((const struct suspect *)b)->reread_ns[NUM_REREADS / 2];
+
+    return (x < y) - (x > y);
+}
+
+
+
+/*
+ * Find the reads of the first pass slower than threshold_ns.
+ *
+ * Blocks read more than once are kept once, with their worst latency. If
+ * there are more than MAX_SUSPECTS, only the slowest are kept. Returns a
+ * newly allocated array, and stores its length in *p_count.
+ */
+static struct suspect *find_suspects(const struct rr_worker *workers,
+        unsigned int num_workers, uint64_t threshold_ns, size_t *p_count)
+{
+    struct suspect *suspects = NULL;
+    size_t count = 0, capacity = 0, i, j;
+    unsigned int k;
+
+    for (k=0; k<num_workers; k++)
+        for (i=0; i<workers[k].lat.count; i++)
+        {
+            if (workers[k].lat.ns[i] <= threshold_ns)
+                continue;
+
+            if (count == capacity)
+            {
+                capacity = capacity != 0 ? 2 * capacity : 64;
+                suspects = realloc(suspects, capacity * sizeof(*suspects));
+                die_if(suspects == NULL, "realloc");
+            }
+
+            memset(&suspects[count], 0, sizeof(suspects[count]));
+            suspects[count].offset = workers[k].offsets.ns[i];
+            suspects[count].first_ns = workers[k].lat.ns[i];
+            count++;
+        }
+
+    /* merge repeated offsets */
+    qsort(suspects, count, sizeof(*suspects), cmp_offset);
+    for (i=0, j=0; i<count; i++)
+    {
+        if (j > 0 && suspects[j-1].offset == suspects[i].offset)
+            suspects[j-1].first_ns = max(suspects[j-1].first_ns,
+                                         suspects[i].first_ns);
+        else
+            suspects[j++] = suspects[i];
+    }
+    count = j;
+
+    if (count > MAX_SUSPECTS)
+    {
+        qsort(suspects, count, sizeof(*suspects), cmp_first_desc);
+        count = MAX_SUSPECTS;
+    }
+
+    *p_count = count;
+    return suspects;
+}
+
+
+
+/*
+ * Re-read every suspect NUM_REREADS times, and count how many of its
+ * re-reads were slower than threshold_ns.
+ *
+ * Each round reads the suspects in a new random order, after EVICT_READS
+ * random reads elsewhere. On return, each suspect's re-read latencies
+ * are sorted.
+ */
+static void reread_suspects(int fd, const struct blkdev_info *info,
+        size_t read_size, struct suspect *suspects, size_t count,
+        uint64_t threshold_ns)
+{
+    const uint64_t choices = info->num_blocks - read_size / info->block_size + 1;
+    struct suspect **order = malloc(count * sizeof(*order));
+    char *buffer = allocate_aligned_memory(info->alignment, read_size);
+    unsigned int round;
+    size_t i;
+
+    die_if(order == NULL, "malloc");
+
+    for (i=0; i<count; i++)
+        order[i] = &suspects[i];
+
+    for (round=0; round<NUM_REREADS; round++)
+    {
+        for (i=0; i<EVICT_READS; i++)
+            read_at(fd, buffer, read_size,
+                    (random64() % choices) * info->block_size);
+
+        /* Fisher-Yates */
+        for (i=count; i>1; i--)
+        {
+            const size_t j = random64() % i;
+            struct suspect *const tmp = order[i-1];
+
+            order[i-1] = order[j];
+            order[j] = tmp;
+        }
+
+        for (i=0; i<count; i++)
+        {
+            struct suspect *const s = order[i];
+            const uint64_t t0 = get_cur_ns();
+
+            read_at(fd, buffer, read_size, s->offset);
+            s->reread_ns[round] = get_cur_ns() - t0;
+
+            if (s->reread_ns[round] > threshold_ns)
+                s->slow_rereads++;
+        }
+    }
+
+    for (i=0; i<count; i++)
+        qsort(suspects[i].reread_ns, NUM_REREADS, sizeof(uint64_t),
+              cmp_uint64);
+
+    free(buffer);
+    free(order);
+}
+
+
+
+/*
+ * Print the persistently slow blocks, slowest first. They must be at the
+ * start of the suspects array.
+ */
+static void print_persistent(const struct suspect *suspects, size_t count,
+        size_t read_size)
+{
+    size_t i;
+
+    printf("\n %4s %14s %8s %11s %11s %11s %8s\n",
+           "rank", "sector", "sectors", "first read", "median", "max",
+           "slow");
+
+    for (i=0; i < count && i < MAX_LISTED; i++)
+    {
+        const struct suspect *const s = &suspects[i];
+        char *const first = humanize_time(s->first_ns, 3);
+        char *const median = humanize_time(s->reread_ns[NUM_REREADS / 2], 3);
+        char *const max_ = humanize_time(s->reread_ns[NUM_REREADS - 1], 3);
+
+        printf(" %4zu %14" PRIu64 " %8zu %11s %11s %11s %6u/%u\n",
+               i + 1, s->offset / 512, read_size / 512, first, median,
+               max_, s->slow_rereads, NUM_REREADS);
+
+        free(first);
+        free(median);
+        free(max_);
+    }
+
+    if (count > MAX_LISTED)
+        printf(" ... and %zu more\n", count - MAX_LISTED);
+}
+
+
+
+/*
+ * Look for persistently slow blocks on a block device, and print the
+ * results.
+ *
+ * The first pass does random reads of opts->read_size (the physical
+ * block size if zero) for opts->duration_ns, with opts->jobs readers
+ * (DEFAULT_READERS if zero). Reads slower than opts->slow_ns (or
+ * DEFAULT_SLOW_P99_FACTOR times the first pass's p99, if zero) are
+ * verified. Exits in case of error.
+ */
+void run_and_print_verify(const char *devname,
+        const struct bench_options *opts)
+{
+    const unsigned int num_readers = opts->jobs != 0
+                                     ? opts->jobs : DEFAULT_READERS;
+    struct rr_worker *workers;
+    struct suspect *suspects;
+    struct blkdev_info info;
+    struct sample_buf all;
+    struct latency_stats stats;
+    uint64_t threshold_ns, bytes = 0, elapsed_ns = 0;
+    size_t read_size, num_suspects, num_persistent, i;
+    char *duration, *threshold;
+    unsigned int k;
+    int fd;
+
+    fd = open_blkdev(devname);
+    get_blkdev_info(fd, &info);
+    init_randomness();
+
+    read_size = opts->read_size != 0
+                ? align_ceil(opts->read_size, info.block_size)
+                : info.block_size;
+    if (read_size > info.dev_size)
+    {
+        fprintf(stderr, "error: read size (%zu) is greater than device (%" PRIu64 ")\n",
+                read_size, info.dev_size);
+        exit(1);
+    }
+
+    workers = malloc(num_readers * sizeof(*workers));
+    die_if(workers == NULL, "malloc");
+
+    for (k=0; k<num_readers; k++)
+    {
+        init_rr_worker(&workers[k], fd, &info, read_size, opts->duration_ns);
+        workers[k].keep_offsets = 1;
+    }
+
+    duration = humanize_time(opts->duration_ns, 3);
+    printf("Reading %zu-byte random blocks for %s, please wait...\n",
+           read_size, duration);
+    free(duration);
+
+    run_random_read_workers(workers, num_readers);
+
+    sample_buf_init(&all);
+    for (k=0; k<num_readers; k++)
+    {
+        sample_buf_append(&all, &workers[k].lat);
+        bytes += workers[k].bytes;
+        elapsed_ns = max(elapsed_ns, workers[k].elapsed_ns);
+    }
+    get_latency_stats(&all, &stats);
+    sample_buf_free(&all);
+
+    threshold_ns = opts->slow_ns != 0
+                   ? opts->slow_ns : DEFAULT_SLOW_P99_FACTOR * stats.p99;
+
+    suspects = find_suspects(workers, num_readers, threshold_ns,
+                             &num_suspects);
+
+    for (k=0; k<num_readers; k++)
+    {
+        sample_buf_free(&workers[k].lat);
+        sample_buf_free(&workers[k].offsets);
+    }
+    free(workers);
+
+    threshold = humanize_time(threshold_ns, 3);
+
+    if (num_suspects > 0)
+    {
+        printf("Re-reading %zu blocks slower than %s, %d times each, please wait...\n",
+               num_suspects, threshold, NUM_REREADS);
+        reread_suspects(fd, &info, read_size, suspects, num_suspects,
+                        threshold_ns);
+    }
+
+    close(fd);
+
+    /* persistently slow: most re-reads were slow too */
+    for (i=0, num_persistent=0; i<num_suspects; i++)
+        if (suspects[i].reread_ns[NUM_REREADS / 2] > threshold_ns)
+        {
+            const struct suspect tmp = suspects[num_persistent];
+
+            suspects[num_persistent++] = suspects[i];
+            suspects[i] = tmp;
+        }
+    qsort(suspects, num_persistent, sizeof(*suspects), cmp_median_desc);
+
+    printf("\n%s:\n\n", devname);
+    print_stats_header("pass");
+    print_stats_row("random", &stats, bytes, elapsed_ns);
+
+    printf("\n Slow threshold: %s", threshold);
+    if (opts->slow_ns == 0)
+        printf(" (%d x p99)", DEFAULT_SLOW_P99_FACTOR);
+    printf("\n Slow blocks verified: %zu%s\n"
+           "   persistently slow: %zu\n"
+           "   transient: %zu\n",
+           num_suspects,
+           num_suspects == MAX_SUSPECTS ? " (the slowest ones)" : "",
+           num_persistent, num_suspects - num_persistent);
+
+    if (num_persistent > 0)
+    {
+        printf("\nPersistently slow blocks (sectors of 512 bytes):\n");
+        print_persistent(suspects, num_persistent, read_size);
+    }
+
+    free(threshold);
+    free(suspects);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
@@ -0,0 +1,429 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* watchdog.c - detection of hung reads
+ *
+ * Reads register themselves while in flight: synchronous ones around the
+ * system call, asynchronous ones from submission to reaping (see
+ * asyncio.c). A background thread checks their age every so often, and
+ * reports those which have been pending for longer than the timeout.
+ * Times are printed as plain seconds, as humanize_time isn't thread-safe.
+ * A failing drive often hangs for seconds on a bad sector long before
+ * returning an error; without this, hdtime would simply appear stuck.
+ *
+ * When aborting on hangs, the timed loops check watchdog_aborting and end
+ * their phase early, so the mode still prints what it measured. A read
+ * that never completes would keep its phase from ending; if the program
+ * is still running a while later, the watchdog prints its report and
+ * exits.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "watchdog.h"
+
+
+/* Maximum number of reads tracked at the same time. */
+#define MAX_WATCHED 8192
+
+/* Maximum number of hung reads kept for the report; more are counted. */
+#define MAX_HUNG_KEPT 32
+
+/* Longest device name kept for the report. */
+#define MAX_DEVNAME_LEN 64
+
+/* Longest time between checks. */
+#define MAX_CHECK_INTERVAL_NS (100 * 1000000UL)
+
+/* Values of watched_io.hung besides an index into wd.hung. */
+#define NOT_HUNG (-1)
+#define COMPLETED (-2)
+
+/* Time to wait for the phase to end, once aborting: this many timeouts,
+ * but at least MIN_ABORT_GRACE_NS. */
+#define ABORT_GRACE_TIMEOUTS 2
+#define MIN_ABORT_GRACE_NS (1000 * 1000000UL)
+
+
+struct watched_io {
+    int owner;              /* slot in use */
+    uint64_t start_ns;      /* 0 = not yet published */
+    int fd;
+    uint64_t offset;
+    size_t count;
+    int hung;               /* index into wd.hung, NOT_HUNG or COMPLETED */
+};
+
+struct hung_io {
+    char devname[MAX_DEVNAME_LEN];
+    uint64_t offset;
+    size_t count;
+    uint64_t latency_ns;    /* once completed; 0 = still pending */
+};
+
+
+static struct {
+    int enabled;
+    int abort_on_hang;
+    int aborting;
+    int stopping;
+    uint64_t timeout_ns;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    unsigned int high_water;
+    unsigned int num_hung;
+    struct hung_io hung[MAX_HUNG_KEPT];
+    struct watched_io slots[MAX_WATCHED];
+} wd;
+
+/* Slot last used by this thread; usually free again for its next read. */
+static __thread unsigned int slot_hint;
+
+
+
+/*
+ * Get the name of the device open as fd, e.g. "/dev/sda", into buf.
+ * Falls back to the fd number if the name can't be found.
+ */
+static void get_fd_devname(int fd, char *buf, size_t size)
+{
+    char link[32];
+    ssize_t len;
+
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+    len = readlink(link, buf, size - 1);
+
+    if (len <= 0)
+        snprintf(buf, size, "fd %d", fd);
+    else
+        buf[len] = '\0';
+}
+
+
+
+/*
+ * Look for reads pending for longer than the timeout. Reports each one
+ * once, on stderr. Must be called with wd.lock held.
+ */
+static void check_slots(void)
+{
+    const unsigned int num_slots = __atomic_load_n(&wd.high_water,
+                                                   __ATOMIC_ACQUIRE);
+    const uint64_t now_ns = get_cur_ns();
+    unsigned int i;
+
+    for (i=0; i<num_slots; i++)
+    {
+        struct watched_io *const io = &wd.slots[i];
+        const uint64_t start_ns = __atomic_load_n(&io->start_ns, __ATOMIC_ACQUIRE);
+        int expected = NOT_HUNG;
+        char devname[MAX_DEVNAME_LEN];
+        uint64_t offset;
+        size_t count;
+
+        /* reads started after now_ns are too young anyway */
+        if (start_ns == 0 || start_ns > now_ns
+            || now_ns - start_ns <= wd.timeout_ns)
+            continue;
+
+        /* fails if already reported, or if the read just completed */
+        if (!__atomic_compare_exchange_n(&io->hung, &expected,
+                    (int)wd.num_hung, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            continue;
+
+        offset = __atomic_load_n(&io->offset, __ATOMIC_RELAXED);
+        count = __atomic_load_n(&io->count, __ATOMIC_RELAXED);
+
+        /* the read is still pending, so its fd is still open */
+        get_fd_devname(__atomic_load_n(&io->fd, __ATOMIC_RELAXED), devname,
+                       sizeof(devname));
+
+        if (wd.num_hung < MAX_HUNG_KEPT)
+        {
+            memcpy(wd.hung[wd.num_hung].devname, devname, sizeof(devname));
+            wd.hung[wd.num_hung].offset = offset;
+            wd.hung[wd.num_hung].count = count;
+            wd.hung[wd.num_hung].latency_ns = 0;
+        }
+        wd.num_hung++;
+
+        fprintf(stderr, "warning: %s: read of %zu bytes at offset %" PRIu64
+                " pending for %.3f s\n", devname, count, offset,
+                (double)(now_ns - start_ns) / NS_PER_SEC);
+    }
+}
+
+
+
+/*
+ * Watchdog thread. Checks the in-flight reads periodically, until
+ * stopped. If aborting on hangs, tells the running phase to stop as soon
+ * as a hung read is found; if the program doesn't finish in time, prints
+ * the report and exits.
+ */
+static void *watchdog_main(void *arg)
+{
+    const uint64_t interval_ns = min(wd.timeout_ns / 4, MAX_CHECK_INTERVAL_NS);
+    const uint64_t grace_ns = max(ABORT_GRACE_TIMEOUTS * wd.timeout_ns,
+                                  MIN_ABORT_GRACE_NS);
+    uint64_t abort_ns = 0;
+
+    (void)arg;
+
+    pthread_mutex_lock(&wd.lock);
+
+    while (!wd.stopping)
+    {
+        struct timespec deadline;
+
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += (deadline.tv_nsec + interval_ns) / NS_PER_SEC;
+        deadline.tv_nsec = (deadline.tv_nsec + interval_ns) % NS_PER_SEC;
+
+        pthread_cond_timedwait(&wd.wake, &wd.lock, &deadline);
+
+        check_slots();
+
+        if (wd.abort_on_hang && wd.num_hung > 0 && abort_ns == 0)
+        {
+            fprintf(stderr, "error: hung read, stopping the test early\n");
+            __atomic_store_n(&wd.aborting, 1, __ATOMIC_RELEASE);
+            abort_ns = get_cur_ns();
+        }
+
+        if (abort_ns != 0
+            && get_cur_ns() - abort_ns > grace_ns)
+        {
+            pthread_mutex_unlock(&wd.lock);
+            fflush(stdout);
+            fprintf(stderr, "error: the hung read didn't complete, exiting\n");
+            watchdog_print_report(1);
+            exit(EXIT_HUNG);
+        }
+    }
+
+    pthread_mutex_unlock(&wd.lock);
+
+    return NULL;
+}
+
+
+
+/*
+ * Start watching reads, reporting those pending for longer than
+ * timeout_ns. If abort_on_hang is true, the running test is stopped as
+ * soon as one is found (see watchdog_aborting). Exits in case of error.
+ */
+void watchdog_start(uint64_t timeout_ns, int abort_on_hang)
+{
+    pthread_condattr_t attr;
+    int retval;
+
+    assert(!wd.enabled && timeout_ns > 0);
+
+    wd.timeout_ns = timeout_ns;
+    wd.abort_on_hang = abort_on_hang;
+
+    pthread_mutex_init(&wd.lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wd.wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    retval = pthread_create(&wd.thread, NULL, watchdog_main, NULL);
+    die_if_with_errno(retval != 0, "pthread_create", retval);
+
+    wd.enabled = 1;
+}
+
+
+
+/*
+ * Stop the watchdog thread. Reads are no longer watched, but what was
+ * found so far is kept for watchdog_print_report.
+ */
+void watchdog_stop(void)
+{
+    if (!wd.enabled)
+        return;
+
+    pthread_mutex_lock(&wd.lock);
+    wd.stopping = 1;
+    pthread_cond_signal(&wd.wake);
+    pthread_mutex_unlock(&wd.lock);
+
+    pthread_join(wd.thread, NULL);
+    wd.enabled = 0;
+}
+
+
+
+/*
+ * Check whether the test should stop because of a hung read. Timed loops
+ * call this to end their phase early, keeping what they measured.
+ */
+int watchdog_aborting(void)
+{
+    return __atomic_load_n(&wd.aborting, __ATOMIC_ACQUIRE);
+}
+
+
+
+/*
+ * Register a read of fd which is about to start. Returns the slot to give
+ * to watchdog_end when it completes, or -1 if the read isn't being
+ * watched.
+ */
+int watchdog_begin(int fd, uint64_t offset, size_t count)
+{
+    unsigned int high_water;
+    unsigned int i;
+
+    if (!wd.enabled)
+        return -1;
+
+    for (i=0; i<MAX_WATCHED; i++)
+    {
+        const unsigned int idx = (slot_hint + i) % MAX_WATCHED;
+        struct watched_io *const io = &wd.slots[idx];
+        int expected = 0;
+
+        if (__atomic_load_n(&io->owner, __ATOMIC_RELAXED) != 0
+            || !__atomic_compare_exchange_n(&io->owner, &expected, 1, 0,
+                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            continue;
+
+        __atomic_store_n(&io->fd, fd, __ATOMIC_RELAXED);
+        __atomic_store_n(&io->offset, offset, __ATOMIC_RELAXED);
+        __atomic_store_n(&io->count, count, __ATOMIC_RELAXED);
+        __atomic_store_n(&io->hung, NOT_HUNG, __ATOMIC_RELAXED);
+        __atomic_store_n(&io->start_ns, get_cur_ns(), __ATOMIC_RELEASE);
+
+        /* make sure the watchdog scans this far */
+        high_water = __atomic_load_n(&wd.high_water, __ATOMIC_RELAXED);
+        while (high_water <= idx
+               && !__atomic_compare_exchange_n(&wd.high_water, &high_water,
+                       idx + 1, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+
+        slot_hint = idx;
+        return (int)idx;
+    }
+
+    /* too many reads in flight; leave this one unwatched */
+    return -1;
+}
+
+
+
+/*
+ * Unregister a completed read, given the slot from watchdog_begin. If it
+ * had been reported as hung, records how long it finally took.
+ */
+void watchdog_end(int slot)
+{
+    struct watched_io *io;
+    int hung;
+
+    if (slot < 0)
+        return;
+
+    io = &wd.slots[slot];
+    hung = __atomic_exchange_n(&io->hung, COMPLETED, __ATOMIC_ACQ_REL);
+
+    if (hung >= 0 && hung < MAX_HUNG_KEPT)
+    {
+        const uint64_t latency_ns = get_cur_ns() - io->start_ns;
+
+        pthread_mutex_lock(&wd.lock);
+        wd.hung[hung].latency_ns = latency_ns;
+        pthread_mutex_unlock(&wd.lock);
+    }
+
+    __atomic_store_n(&io->start_ns, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&io->owner, 0, __ATOMIC_RELEASE);
+}
+
+
+
+/*
+ * Print the number of hung reads found, their devices and offsets, and
+ * whether they eventually completed. If there were none, prints that only
+ * if verbose is true. Prints nothing if the watchdog was never started.
+ */
+void watchdog_print_report(int verbose)
+{
+    const double timeout = (double)wd.timeout_ns / NS_PER_SEC;
+    unsigned int i;
+
+    if (wd.timeout_ns == 0)
+        return;
+
+    pthread_mutex_lock(&wd.lock);
+
+    if (wd.num_hung == 0)
+    {
+        if (verbose)
+            printf("\nHung reads (pending over %g s): none\n", timeout);
+        pthread_mutex_unlock(&wd.lock);
+        return;
+    }
+
+    printf("\nHung reads (pending over %g s): %u\n", timeout, wd.num_hung);
+
+    for (i=0; i < min(wd.num_hung, (unsigned int)MAX_HUNG_KEPT); i++)
+    {
+        const struct hung_io *const h = &wd.hung[i];
+
+        if (h->latency_ns != 0)
+            printf(" %s, offset %" PRIu64 " (%zu bytes): completed after %.3f s\n",
+                   h->devname, h->offset, h->count,
+                   (double)h->latency_ns / NS_PER_SEC);
+        else
+            printf(" %s, offset %" PRIu64 " (%zu bytes): still pending\n",
+                   h->devname, h->offset, h->count);
+    }
+
+    if (wd.num_hung > MAX_HUNG_KEPT)
+        printf(" ... and %u more\n", wd.num_hung - MAX_HUNG_KEPT);
+
+    pthread_mutex_unlock(&wd.lock);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
@@ -0,0 +1,56 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* watchdog.h - detection of hung reads */
+
+
+#ifndef _WATCHDOG_H
+#define _WATCHDOG_H
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+
+/* get size_t */
+#include <stddef.h>
+
+/* get uint64_t */
+#include <stdint.h>
+
+
+void watchdog_start(uint64_t timeout_ns, int abort_on_hang);
+
+void watchdog_stop(void);
+
+int watchdog_aborting(void);
+
+int watchdog_begin(int fd, uint64_t offset, size_t count);
+
+void watchdog_end(int slot);
+
+void watchdog_print_report(int verbose);
+
+/* Exit status when the test was stopped because of a hung read. */
+#define EXIT_HUNG 3
+
+
+#endif  /* _WATCHDOG_H */
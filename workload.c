@@ -0,0 +1,328 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* workload.c - concurrent random read workers */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/ioprio.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#if !defined(DEBUG) || !DEBUG
+#  define NDEBUG 1
+#endif
+#include <assert.h>
+
+#include "devio.h"
+#include "latency.h"
+#include "asyncio.h"
+#include "watchdog.h"
+#include "workload.h"
+
+
+#ifndef IOPRIO_WHO_PROCESS
+#  define IOPRIO_WHO_PROCESS 1
+#endif
+
+
+
+/*
+ * Set the I/O priority of the calling thread.
+ *
+ * ioprio is a value built by IOPRIO_PRIO_VALUE. Returns zero on success,
+ * or an error number in case of error.
+ */
+int set_thread_ioprio(int ioprio)
+{
+    /* who == 0 means the calling thread, not the whole process */
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio) != 0)
+        return errno;
+
+    return 0;
+}
+
+
+
+/*
+ * Pin the calling thread to a CPU. Returns zero on success, or an error
+ * number in case of error.
+ */
+int set_thread_cpu(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+
+
+/*
+ * Initialize a random read worker with default parameters.
+ *
+ * The worker will read from the whole device, with the current thread's
+ * I/O priority. Any parameter may be changed before running it.
+ */
+void init_rr_worker(struct rr_worker *w, int fd,
+        const struct blkdev_info *info, size_t read_size,
+        uint64_t duration_ns)
+{
+    assert(read_size % info->block_size == 0);
+
+    w->fd = fd;
+    w->info = info;
+    w->first_block = 0;
+    w->num_blocks = info->num_blocks;
+    w->read_size = read_size;
+    w->duration_ns = duration_ns;
+    w->ioprio = -1;
+    w->request_prio = 0;
+    w->keep_offsets = 0;
+    w->hist = NULL;
+    w->series = NULL;
+    w->series_len = 0;
+    w->interval_ns = 0;
+    w->seed = random64();
+
+    sample_buf_init(&w->lat);
+    sample_buf_init(&w->offsets);
+    w->bytes = 0;
+    w->elapsed_ns = 0;
+}
+
+
+
+/*
+ * Get the offset of the next random read of a worker. Reads never extend
+ * past the end of the worker's region.
+ */
+static uint64_t next_offset(struct rr_worker *w)
+{
+    const uint64_t read_blocks = w->read_size / w->info->block_size;
+    const uint64_t choices = w->num_blocks > read_blocks
+                             ? w->num_blocks - read_blocks + 1 : 1;
+
+    return (w->first_block + random64_r(&w->seed) % choices)
+           * w->info->block_size;
+}
+
+
+
+/*
+ * Record a completed read at offset, issued at t0_ns and completed at
+ * now_ns.
+ *
+ * In the series, a read counts towards every interval it was in flight,
+ * so a stall longer than an interval shows in all the intervals it
+ * covers, instead of leaving them empty.
+ */
+static inline void record_read(struct rr_worker *w, uint64_t offset,
+        uint64_t t0_ns, uint64_t now_ns, uint64_t start_ns)
+{
+    const uint64_t lat_ns = now_ns - t0_ns;
+
+    if (w->hist != NULL)
+        latency_hist_add(w->hist, lat_ns);
+    else
+        sample_buf_add(&w->lat, lat_ns);
+
+    if (w->series != NULL)
+    {
+        size_t k;
+
+        for (k = (t0_ns - start_ns) / w->interval_ns;
+             k <= (now_ns - start_ns) / w->interval_ns && k < w->series_len;
+             k++)
+            w->series[k] = max(w->series[k], lat_ns);
+    }
+
+    if (w->keep_offsets)
+        sample_buf_add(&w->offsets, offset);
+    w->bytes += w->read_size;
+}
+
+
+
+/*
+ * Do random reads until the worker's time is up, issuing each one through
+ * an AIO context and tagging it with the worker's priority.
+ */
+static void do_tagged_reads(struct rr_worker *w, char *buffer,
+        uint64_t start_ns)
+{
+    struct async_ctx actx;
+    struct io_event event;
+    uint64_t now_ns = start_ns;
+
+    async_init(&actx, 1);
+
+    while (now_ns - start_ns < w->duration_ns && !watchdog_aborting())
+    {
+        struct iocb cb;
+        struct iocb *cbs[1] = { &cb };
+        const uint64_t offset = next_offset(w);
+        uint64_t t0;
+
+        async_prep_read(&cb, w->fd, buffer, w->read_size, offset, NULL);
+        async_set_ioprio(&cb, w->ioprio);
+
+        t0 = get_cur_ns();
+        async_submit(&actx, cbs, 1);
+        (void)async_reap(&actx, &event, 1, 1, NULL);
+        now_ns = get_cur_ns();
+
+        die_if_with_errno(event.res < 0, "read", (int)-event.res);
+
+        record_read(w, offset, t0, now_ns, start_ns);
+    }
+
+    async_destroy(&actx);
+}
+
+
+
+/*
+ * Do random reads until the worker's time is up, with plain synchronous
+ * reads.
+ */
+static void do_sync_reads(struct rr_worker *w, char *buffer,
+        uint64_t start_ns)
+{
+    uint64_t now_ns = start_ns;
+
+    while (now_ns - start_ns < w->duration_ns && !watchdog_aborting())
+    {
+        /* pick the offset outside of the timed region */
+        const uint64_t offset = next_offset(w);
+        const uint64_t t0 = get_cur_ns();
+
+        read_at(w->fd, buffer, w->read_size, offset);
+        now_ns = get_cur_ns();
+
+        record_read(w, offset, t0, now_ns, start_ns);
+    }
+}
+
+
+
+static void *rr_worker_main(void *arg)
+{
+    struct thread_arg *t = arg;
+    struct rr_worker *w = t->data;
+    char *buffer;
+    uint64_t start_ns;
+    int retval;
+
+    buffer = allocate_aligned_memory(w->info->alignment, w->read_size);
+
+    if (w->ioprio >= 0 && !w->request_prio)
+    {
+        retval = set_thread_ioprio(w->ioprio);
+        die_if_with_errno(retval != 0, "ioprio_set", retval);
+    }
+
+    /* start all workers at the same time, so they compete throughout */
+    pthread_barrier_wait(t->start);
+
+    start_ns = get_cur_ns();
+
+    if (w->request_prio && w->ioprio >= 0)
+        do_tagged_reads(w, buffer, start_ns);
+    else
+        do_sync_reads(w, buffer, start_ns);
+
+    w->elapsed_ns = get_cur_ns() - start_ns;
+
+    free(buffer);
+
+    return NULL;
+}
+
+
+
+/*
+ * Run threads concurrently.
+ *
+ * Starts count threads running fn, and waits for them to finish. Thread i
+ * receives a pointer to a struct thread_arg, whose data points to the
+ * i-th element of the data array, where each element is data_size bytes
+ * long. Threads should wait on the start barrier once ready, so that all
+ * of them start measuring at the same time. Exits in case of error.
+ */
+void run_threads(void *(*fn)(void *), void *data, size_t data_size,
+        unsigned int count)
+{
+    pthread_t *threads = malloc(count * sizeof(*threads));
+    struct thread_arg *args = malloc(count * sizeof(*args));
+    pthread_barrier_t start;
+    unsigned int i;
+    int retval;
+
+    die_if(threads == NULL || args == NULL, "malloc");
+    assert(count > 0);
+
+    retval = pthread_barrier_init(&start, NULL, count);
+    die_if_with_errno(retval != 0, "pthread_barrier_init", retval);
+
+    for (i=0; i<count; i++)
+    {
+        args[i].data = (char *)data + i*data_size;
+        args[i].start = &start;
+
+        retval = pthread_create(&threads[i], NULL, fn, &args[i]);
+        die_if_with_errno(retval != 0, "pthread_create", retval);
+    }
+
+    for (i=0; i<count; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_barrier_destroy(&start);
+    free(args);
+    free(threads);
+}
+
+
+
+/*
+ * Run random read workers concurrently.
+ *
+ * Starts one thread per worker, all at the same time, and waits for them
+ * to finish. Each worker's results are stored in its struct. Exits in
+ * case of error.
+ */
+void run_random_read_workers(struct rr_worker *workers, unsigned int count)
+{
+    run_threads(rr_worker_main, workers, sizeof(workers[0]), count);
+}
+
+/* vim: set expandtab smarttab shiftwidth=4 softtabstop=4 tw=75 : */
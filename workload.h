@@ -0,0 +1,96 @@
+/*
+ * hdtime - performance measurements for block devices
+ * Copyright (C) 2012 Israel G. Lugo
+ *
+ * hdtime is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * hdtime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with hdtime.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For suggestions, feedback or bug reports: israel.lugo@lugosys.com
+ */
+
+
+/* workload.h - concurrent random read workers */
+
+
+#ifndef _WORKLOAD_H
+#define _WORKLOAD_H
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+
+/* get size_t */
+#include <stddef.h>
+
+/* get uint64_t */
+#include <stdint.h>
+
+#include <pthread.h>
+
+#include "devio.h"
+#include "latency.h"
+
+
+/* Argument of a thread started by run_threads. */
+struct thread_arg {
+    void *data;
+    pthread_barrier_t *start;
+};
+
+
+/*
+ * A timed random read worker. The caller fills in the parameters; the
+ * results are filled in by run_random_read_workers.
+ */
+struct rr_worker {
+    /* parameters */
+    int fd;
+    const struct blkdev_info *info;
+    uint64_t first_block;       /* start of the region to read from */
+    uint64_t num_blocks;        /* size of the region, in blocks */
+    size_t read_size;           /* multiple of info->block_size */
+    uint64_t duration_ns;
+    int ioprio;                 /* IOPRIO_PRIO_VALUE, or -1 to inherit */
+    int request_prio;           /* tag requests, instead of the thread */
+    int keep_offsets;           /* record read offsets in offsets */
+    struct latency_hist *hist;  /* if not NULL, record latencies here
+                                   instead of in lat */
+    uint64_t *series;           /* if not NULL, worst latency in each */
+    size_t series_len;          /* ... of series_len intervals */
+    uint64_t interval_ns;       /* ... of interval_ns since the start */
+    uint64_t seed;
+
+    /* results */
+    struct sample_buf lat;
+    struct sample_buf offsets;  /* offset of each read, in bytes */
+    uint64_t bytes;
+    uint64_t elapsed_ns;
+};
+
+
+int set_thread_ioprio(int ioprio);
+
+int set_thread_cpu(int cpu);
+
+void init_rr_worker(struct rr_worker *w, int fd,
+        const struct blkdev_info *info, size_t read_size,
+        uint64_t duration_ns);
+
+void run_threads(void *(*fn)(void *), void *data, size_t data_size,
+        unsigned int count);
+
+void run_random_read_workers(struct rr_worker *workers, unsigned int count);
+
+
+#endif  /* _WORKLOAD_H */